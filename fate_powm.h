@@ -0,0 +1,536 @@
+/*******************************************************************************
+* Copyright 2020 The FATE Authors. All Rights Reserved.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+/*!
+ *
+ *  \file
+ *
+ *  \brief C interface of the batched modular exponentiation engine.
+ *
+ *  The engine lives in rsa_mb-1k-type1-encryption-decryption_1228(2).cpp.
+ *  The same translation unit builds the library, the benchmark and the test
+ *  binary. CMakeLists.txt has a target for each (see there for locating IPP
+ *  Cryptography); by hand:
+ *
+ *    library:    g++ -O2 -fPIC -shared -fvisibility=hidden -DFATE_POWM_NO_MAIN <example>.cpp -o libfate_powm.so -lippcp -lgmp -lpthread
+ *    benchmark:  g++ -O2 <example>.cpp -o fate_powm -lippcp -lgmp -lpthread && ./fate_powm bench
+ *    tests:      ./fate_powm test
+ *    coroutines: add -std=c++20 to any of the lines above for fate_engine
+ *    autotune:   ./fate_powm tune [profile]
+ *    keygen:     ./fate_powm keygen [keys] [bits]
+ *    text:       ./fate_powm text [num] [limbs]
+ *    mixed jobs: ./fate_powm mixed [num] [threads]
+ *    service:    ./fate_powm serve [name] [limbs] [formers]   (add -lrt before glibc 2.34)
+ *    fuzzing:    clang++ -g -O1 -fsanitize=fuzzer,address -DFATE_POWM_NO_MAIN -DFATE_POWM_FUZZ <example>.cpp -lippcp -lgmp -lpthread
+ *
+ *  Add -DFATE_ENABLE_NUMA -lnuma for NUMA placement.
+ *
+ *  Operands cross the interface as fixed-width little-endian arrays of
+ *  64-bit limbs, element i of an array occupying limbs [i * limbs, (i + 1) * limbs),
+ *  so they can be handed over from Python (ctypes/numpy) or Java without
+ *  linking GMP on the caller side.
+ *
+ */
+
+#ifndef FATE_POWM_H
+#define FATE_POWM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <limits.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the library is built with -fvisibility=hidden, only the declarations below are exported */
+#if defined(_WIN32)
+#define FATE_API
+#else
+#define FATE_API __attribute__((visibility("default")))
+#endif
+
+#define FATE_MB_LANES 8
+#define FATE_HIST_BUCKETS 40
+#define FATE_FXP_AUTO_EXPONENT INT_MIN // per-element exponent, see fate_encrypt_f64
+
+/*! Per-element outcome of the batched API, aligned with res */
+enum fate_status
+{
+    FATE_STS_OK = 0,         // computed by the batched kernel
+    FATE_STS_MB = 0,         // computed by the multi-buffer engine
+    FATE_STS_GMP_RETRY = 1,  // rejected by the multi-buffer engine, recomputed with mpz_powm
+    FATE_STS_ERR = -1        // no result: zero modulus or negative exponent
+};
+
+/*! Pipeline stages tracked by the instrumentation */
+enum fate_stage
+{
+    FATE_STAGE_CONVERT = 0, // mpz_t <-> BigNumber conversion of operands and results
+    FATE_STAGE_KEY_SETUP,   // ippsRSA_Init*/Set* of the per-lane key contexts
+    FATE_STAGE_SCRATCH,     // ippsRSA_MB_GetBufferSize* and scratch allocation
+    FATE_STAGE_MB_CALL,     // the multi-buffer call itself
+    FATE_STAGE_BATCH_FILL,  // oldest operation of a queue/shm batch published -> batch dispatched
+    FATE_STAGE_NUM
+};
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t hist[FATE_HIST_BUCKETS]; // bucket k counts samples in [2^k, 2^(k+1)) ns
+} fate_stage_stats;
+
+typedef struct
+{
+    fate_stage_stats stage[FATE_STAGE_NUM];
+    uint64_t ops;                                // elements submitted to powm_avx
+    uint64_t mb_calls;                           // multi-buffer calls issued
+    uint64_t lanes_used;                         // lanes carrying a real operand
+    uint64_t lanes_retried;                      // elements recomputed with mpz_powm
+    uint64_t remote_batches;                     // batches processed off their NUMA node
+    uint64_t stolen_tasks;                       // tasks a worker took from another worker's deque
+    uint64_t cache_hits;                         // results served by the result cache
+    uint64_t cache_misses;                       // distinct triples computed while the cache was on
+    uint64_t cache_dedup;                        // repeats of a triple within the same call
+    uint64_t cache_evictions;
+    uint64_t lane_occupancy[FATE_MB_LANES + 1];  // lane_occupancy[k]: calls with k lanes filled
+} fate_stats;
+
+/*! Engine context options, zero-initialized fields take the defaults */
+typedef struct
+{
+    int threads;     // worker threads per call, 0: one per hardware thread
+    int numa_nodes;  // nodes to spread the workers over, 0: all nodes
+    int cache;       // 1: calls may use the result cache; leave 0 for secret or randomized inputs
+} fate_ctx_opts;
+
+typedef struct fate_ctx fate_ctx;
+typedef struct fate_job fate_job;
+
+/*! Create an engine context, opts may be NULL. Returns NULL on failure */
+FATE_API fate_ctx* fate_ctx_create(const fate_ctx_opts* opts);
+
+/*! Wait for the pending asynchronous jobs and release the context */
+FATE_API void fate_ctx_destroy(fate_ctx* ctx);
+
+/*
+ * res[i] = b[i]^e[i] mod m[i], i < num, every element `limbs` 64-bit limbs wide.
+ * status (may be NULL) receives one fate_status per element.
+ * Returns the number of elements without a valid result, -1 on bad arguments.
+ */
+FATE_API int fate_powm(fate_ctx* ctx, uint64_t* res, const uint64_t* b, const uint64_t* e, const uint64_t* m,
+                       int limbs, int num, int* status);
+
+/*
+ * Asynchronous fate_powm. All buffers must stay valid until fate_job_wait
+ * returns. Jobs of one context complete in submission order.
+ */
+FATE_API fate_job* fate_powm_submit(fate_ctx* ctx, uint64_t* res, const uint64_t* b, const uint64_t* e,
+                                    const uint64_t* m, int limbs, int num, int* status);
+
+/*! 1 when the job has completed, 0 otherwise */
+FATE_API int fate_job_done(fate_job* job);
+
+/*! Block until the job completes, release it and return what fate_powm would have returned */
+FATE_API int fate_job_wait(fate_job* job);
+
+/*
+ * Lock-free ingestion queue: many producers push single operations, batch
+ * former threads take them 8 at a time into the batched engine. Operands are
+ * `limbs` limbs each and are copied into the queue on push.
+ */
+typedef struct fate_queue fate_queue;
+
+typedef struct
+{
+    int capacity;   // cells, rounded up to a power of two, at least 1024
+    int limbs;      // operand width
+    int formers;    // batch former threads, 0: one
+    int linger_us;  // wait for a full batch at most this long, 0: 50 us
+} fate_queue_opts;
+
+/*
+ * Completion record of one queued operation, owned by the producer. Set
+ * complete to NULL to poll done; otherwise the engine calls complete(op) on
+ * a batch former thread after the result is written and no longer touches
+ * the record afterwards.
+ */
+typedef struct fate_op
+{
+    uint64_t* res;  // `limbs` limbs, set by the producer, written by the engine
+    int status;     // fate_status, valid once done
+    int done;
+    void (*complete)(struct fate_op* op);
+    void* user;
+} fate_op;
+
+typedef struct
+{
+    uint64_t depth;         // operations waiting
+    uint64_t capacity;
+    uint64_t pushed;
+    uint64_t popped;
+    uint64_t batches;       // batches formed, popped / batches is the average fill
+    uint64_t push_retries;  // lost CAS races among producers
+    uint64_t pop_retries;   // lost CAS races among batch formers
+    uint64_t full;          // pushes refused because the ring was full
+} fate_queue_stats;
+
+FATE_API fate_queue* fate_queue_create(const fate_queue_opts* opts);
+
+/*! Drain the queue, stop the batch formers and release it */
+FATE_API void fate_queue_destroy(fate_queue* q);
+
+/*! Enqueue op->res = b^e mod m without blocking. Returns 0, or -1 when the ring is full or on bad arguments */
+FATE_API int fate_queue_push(fate_queue* q, fate_op* op, const uint64_t* b, const uint64_t* e, const uint64_t* m);
+
+/*! 1 once op completed; fate_op_wait spins/yields until then and returns op->status */
+FATE_API int fate_op_done(const fate_op* op);
+FATE_API int fate_op_wait(fate_op* op);
+
+FATE_API void fate_queue_get_stats(const fate_queue* q, fate_queue_stats* out);
+
+/*
+ * Local service for multi-process clients (Linux). The server creates the
+ * POSIX shared-memory object `name` ("/something") and batches the
+ * operations of every attached process onto the engine; each client owns a
+ * ring of cells in the region, writes its operands there and finds the
+ * results in place, waking up through futexes. All operands of one service
+ * are `limbs` limbs wide. The rings of clients that die are reset by the
+ * server, and clients give up when the server process is gone.
+ */
+typedef struct fate_shm_server fate_shm_server;
+typedef struct fate_shm_client fate_shm_client;
+
+typedef struct
+{
+    const char* name;  // shared-memory object, must not exist yet
+    int limbs;         // operand width
+    int clients;       // clients attached at once, 0: 64
+    int capacity;      // cells per client, rounded up to a power of two, 0: 256
+    int formers;       // batch former threads, 0: one
+    int linger_us;     // wait for a full batch at most this long, 0: 50 us
+} fate_shm_opts;
+
+/*! Create the shared ring and start serving. Returns NULL when the object exists or cannot be created */
+FATE_API fate_shm_server* fate_shm_serve(const fate_shm_opts* opts);
+
+/*! Serve what is already queued, stop, and remove the shared-memory object */
+FATE_API void fate_shm_shutdown(fate_shm_server* s);
+FATE_API void fate_shm_get_stats(const fate_shm_server* s, uint64_t* served, uint64_t* batches);
+
+/*! Client rings reset because their process died */
+FATE_API int fate_shm_reaped(const fate_shm_server* s);
+
+/*! Attach to a running service, NULL when there is none or every client slot is taken. The handle belongs to the calling process */
+FATE_API fate_shm_client* fate_shm_connect(const char* name);
+FATE_API void fate_shm_disconnect(fate_shm_client* c);
+FATE_API int fate_shm_limbs(const fate_shm_client* c);
+
+/*
+ * res[i] = b[i]^e[i] mod m[i] on the service, i < num, fate_shm_limbs(c)
+ * limbs each; blocks until all results are in. Elements that could not be
+ * served because the service stopped or died get FATE_STS_ERR.
+ * Returns the number of elements without a valid result, -1 on bad arguments.
+ */
+FATE_API int fate_shm_powm(fate_shm_client* c, uint64_t* res, const uint64_t* b, const uint64_t* e, const uint64_t* m,
+                           int num, int* status);
+
+/*
+ * Uniformly random values from the ChaCha20 generator of the calling thread:
+ * out[i] in [0, m[i]), or [0, m[0]) for all i when shared_modulus is set.
+ * Returns 0, or -1 on bad arguments or a zero modulus.
+ */
+FATE_API int fate_random_below(uint64_t* out, const uint64_t* m, int limbs, int num, int shared_modulus);
+
+/*
+ * Encode a double/float tensor as FATE fixed-point numbers (BASE 16) and
+ * Paillier-encrypt it with public key n (g = n + 1). c receives 2 * limbs
+ * limbs per element (mod n^2). With fixed_exponent == FATE_FXP_AUTO_EXPONENT
+ * each element's exponent is written to exponent[i]; otherwise all share
+ * fixed_exponent and exponent may be NULL.
+ * Returns the number of elements that failed (NaN/Inf/overflow), -1 on bad arguments.
+ */
+FATE_API int fate_encrypt_f64(uint64_t* c, int* exponent, const double* x, int num, const uint64_t* n, int limbs,
+                              int fixed_exponent, int* status);
+FATE_API int fate_encrypt_f32(uint64_t* c, int* exponent, const float* x, int num, const uint64_t* n, int limbs,
+                              int fixed_exponent, int* status);
+
+/*
+ * Text interchange. fate_parse_hex/dec read str[i] (len[i] characters, or
+ * up to the NUL when len is NULL; hex may start with 0x) into
+ * out + i * limbs; elements with a bad digit, a sign or a value wider than
+ * limbs limbs are zeroed and get status[i] = -1 (status may be NULL).
+ * fate_format_hex/dec write element i as a NUL-terminated lowercase hex or
+ * decimal string without leading zeros at out + i * stride, stride being at
+ * least FATE_HEX_CHARS(limbs) or FATE_DEC_CHARS(limbs).
+ * Return the number of failed elements, -1 on bad arguments.
+ */
+#define FATE_HEX_CHARS(limbs) (16 * (size_t)(limbs) + 1)
+#define FATE_DEC_CHARS(limbs) (20 * (size_t)(limbs) + 1)
+
+FATE_API int fate_parse_hex(uint64_t* out, const char* const* str, const size_t* len, int limbs, int num,
+                            int* status);
+FATE_API int fate_parse_dec(uint64_t* out, const char* const* str, const size_t* len, int limbs, int num,
+                            int* status);
+FATE_API int fate_format_hex(char* out, size_t stride, const uint64_t* in, int limbs, int num);
+FATE_API int fate_format_dec(char* out, size_t stride, const uint64_t* in, int limbs, int num);
+
+/*
+ * PKCS#1 v2.2 with SHA-256 and MGF1-SHA-256 for one RSA key (n, e, d given as
+ * limbs limbs each), k = byte length of n. Ciphertexts and signatures are
+ * k bytes apiece in ct/sig; message i is msg[i][0..msg_len[i]).
+ * OAEP uses an empty label and takes messages of up to k - 66 bytes; a
+ * decrypted message i lands at msg + k * i. PSS uses 32-byte salts.
+ * Failed or invalid elements get status[i] = -1 (status may be NULL).
+ * Return the number of such elements, -1 on bad arguments.
+ */
+FATE_API int fate_rsa_oaep_encrypt(uint8_t* ct, const uint8_t* const* msg, const size_t* msg_len, int num,
+                                   const uint64_t* n, const uint64_t* e, int limbs, int* status);
+FATE_API int fate_rsa_oaep_decrypt(uint8_t* msg, size_t* msg_len, const uint8_t* ct, int num, const uint64_t* n,
+                                   const uint64_t* d, int limbs, int* status);
+FATE_API int fate_rsa_pss_sign(uint8_t* sig, const uint8_t* const* msg, const size_t* msg_len, int num,
+                               const uint64_t* n, const uint64_t* d, int limbs, int* status);
+FATE_API int fate_rsa_pss_verify(const uint8_t* sig, const uint8_t* const* msg, const size_t* msg_len, int num,
+                                 const uint64_t* n, const uint64_t* e, int limbs, int* status);
+
+/*
+ * Generate num key pairs with a `bits`-bit modulus (a multiple of 128); the
+ * Miller-Rabin rounds of all prime candidates run through the batched engine
+ * from 2048-bit keys on, smaller keys test their candidates one at a time.
+ * RSA: e = 65537, n and d get bits / 64 limbs per key.
+ * Paillier (g = n + 1): n gets bits / 64 limbs, p and q bits / 128 limbs;
+ * n^2 always has 2 * bits bits.
+ * Return the number of keys that could not be made, -1 on bad arguments.
+ */
+FATE_API int fate_rsa_keygen(uint64_t* n, uint64_t* d, int bits, int num);
+FATE_API int fate_paillier_keygen(uint64_t* n, uint64_t* p, uint64_t* q, int bits, int num);
+
+/*
+ * Benchmark the multi-buffer engine against scalar and threaded mpz_powm for
+ * every supported modulus size and write the crossover points to a
+ * key=value profile at path (NULL: $FATE_TUNE_PROFILE, else ./fate_powm.tune).
+ * The first engine call loads that profile by itself, and tunes when there is
+ * none and FATE_AUTOTUNE=1 is set. Call these while no engine call is running.
+ * Return 0, or -1 when the profile cannot be written/read.
+ */
+FATE_API int fate_autotune(const char* path);
+FATE_API int fate_tune_load(const char* path);
+FATE_API void fate_tune_print(FILE* fp);
+
+/*
+ * Size the process-wide result cache to about `entries` triples, 0 turns it
+ * off (the default). Only powm_avx calls and contexts created with
+ * fate_ctx_opts.cache use it. Call while no engine call is running.
+ * Returns 0, or -1 when out of memory.
+ */
+FATE_API int fate_cache_configure(size_t entries);
+
+/*! Process-wide instrumentation */
+FATE_API void fate_stats_get(fate_stats* out);
+FATE_API void fate_stats_reset(void);
+FATE_API void fate_stats_print(FILE* fp);
+FATE_API void fate_stats_set_dump(FILE* fp, double interval_ms);
+FATE_API uint64_t fate_stats_quantile(const fate_stage_stats* st, double q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(__cplusplus) && defined(__cpp_impl_coroutine)
+/*
+ * C++20 coroutine interface on top of the ingestion queue:
+ *
+ *    fate_engine engine(16, &executor);
+ *    int status = co_await engine.powm(res, b, e, m);
+ *
+ * The coroutine is suspended while its operation waits for a batch and is
+ * resumed through the executor passed to the engine, by default a thread the
+ * engine owns. An operation that finds the queue full is parked in the
+ * engine and pushed, in order, as operations of the engine complete, so no
+ * thread ever waits for queue space. The constructor throws
+ * std::runtime_error when the queue cannot be created. Needs -std=c++20
+ * (GCC 10, Clang 14).
+ */
+#include <coroutine>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+/*! Where completed operations resume their coroutines */
+struct fate_executor
+{
+    virtual void post(std::coroutine_handle<> h) = 0;
+    virtual ~fate_executor() {}
+};
+
+/*! Resume on the batch former that completed the operation */
+struct fate_inline_executor : fate_executor
+{
+    void post(std::coroutine_handle<> h) override { h.resume(); }
+};
+
+/*! One thread resuming coroutines in completion order */
+class fate_thread_executor : public fate_executor
+{
+public:
+    fate_thread_executor() : stop_(false), thread_([this] { run(); }) {}
+
+    ~fate_thread_executor()
+    {
+        {
+            std::lock_guard<std::mutex> lk(lock_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    void post(std::coroutine_handle<> h) override
+    {
+        {
+            std::lock_guard<std::mutex> lk(lock_);
+            ready_.push_back(h);
+        }
+        wake_.notify_one();
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lk(lock_);
+        for (;;)
+        {
+            wake_.wait(lk, [this] { return stop_ || !ready_.empty(); });
+            if (ready_.empty())
+                return;
+            std::coroutine_handle<> h = ready_.front();
+            ready_.pop_front();
+            lk.unlock();
+            h.resume();
+            lk.lock();
+        }
+    }
+
+    std::mutex lock_;
+    std::condition_variable wake_;
+    std::deque<std::coroutine_handle<>> ready_;
+    bool stop_;
+    std::thread thread_;
+};
+
+class fate_engine
+{
+public:
+    /*! Operands of `limbs` limbs; exec == nullptr resumes on a thread of the engine */
+    explicit fate_engine(int limbs, fate_executor* exec = nullptr, int formers = 1, int capacity = 1 << 16,
+                         int linger_us = 0)
+    {
+        if (exec == nullptr)
+            own_.reset(new fate_thread_executor);
+        exec_ = exec ? exec : own_.get();
+
+        fate_queue_opts opts = { capacity, limbs, formers, linger_us };
+        queue_ = fate_queue_create(&opts);
+        if (queue_ == nullptr)
+            throw std::runtime_error("fate_engine: cannot create the ingestion queue");
+    }
+
+    ~fate_engine() { fate_queue_destroy(queue_); }
+
+    fate_engine(const fate_engine&) = delete;
+    fate_engine& operator=(const fate_engine&) = delete;
+
+    /*! Awaitable of one res = b^e mod m, yields its fate_status */
+    class powm_op
+    {
+    public:
+        powm_op(fate_engine* engine, uint64_t* res, const uint64_t* b, const uint64_t* e, const uint64_t* m)
+            : engine_(engine), b_(b), e_(e), m_(m)
+        {
+            op_ = fate_op{ res, FATE_STS_ERR, 0, &powm_op::complete, this };
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            handle_ = h;
+            fate_engine* engine = engine_; // *this may be gone once the op is parked
+            {
+                std::lock_guard<std::mutex> lk(engine->lock_);
+                if (engine->parked_.empty() && push())
+                    return;
+                engine->parked_.push_back(this);
+            }
+            /* completions that freed space before we parked did not see us */
+            engine->drain();
+        }
+
+        int await_resume() const noexcept { return op_.status; }
+
+    private:
+        friend class fate_engine;
+
+        bool push() { return fate_queue_push(engine_->queue_, &op_, b_, e_, m_) == 0; }
+
+        static void complete(fate_op* op)
+        {
+            powm_op* self = static_cast<powm_op*>(op->user);
+            fate_engine* engine = self->engine_;
+            std::coroutine_handle<> h = self->handle_;
+            engine->drain();
+            engine->exec_->post(h);
+        }
+
+        fate_engine* engine_;
+        const uint64_t *b_, *e_, *m_;
+        fate_op op_;
+        std::coroutine_handle<> handle_;
+    };
+
+    powm_op powm(uint64_t* res, const uint64_t* b, const uint64_t* e, const uint64_t* m)
+    {
+        return powm_op(this, res, b, e, m);
+    }
+
+    /*! The underlying queue, for fate_queue_get_stats; operations pushed there directly do not move parked ones */
+    fate_queue* queue() const { return queue_; }
+
+private:
+    /*! Push parked operations while the queue takes them */
+    void drain()
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        while (!parked_.empty() && parked_.front()->push())
+            parked_.pop_front();
+    }
+
+    std::unique_ptr<fate_thread_executor> own_; // outlives queue_: formers post until they are joined
+    fate_executor* exec_;
+    fate_queue* queue_;
+    std::mutex lock_;
+    std::deque<powm_op*> parked_;               // found the queue full, in arrival order
+};
+#endif /* __cpp_impl_coroutine */
+
+#endif /* FATE_POWM_H */
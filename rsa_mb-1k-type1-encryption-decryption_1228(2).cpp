@@ -33,9 +33,31 @@
  */
 
 #include <cstring>
+#include <cerrno>
 #include <cstdlib>
 #include <time.h>
 #include <chrono>
+#include <atomic>
+#include <cstdint>
+#include <cmath>
+#include <climits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
+#include <map>
+#include <algorithm>
+#include <sys/random.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
 
 #include <stdio.h>
 
@@ -47,7 +69,11 @@
 #include "bignum.h"
 #include "rsa_mb_data.h"
 #include "requests.h"
+#include "fate_powm.h"
 #include "immintrin.h"
+#ifdef FATE_ENABLE_NUMA
+#include <numa.h>
+#endif
 #define ENABLE_GMP 1
 using namespace std;
 using namespace chrono;
@@ -91,9 +117,187 @@ typedef struct
     mpz_t* bigint;
     int num;
     bool ismalloc = 0;
+    bool ismont = 0; // bigint holds Montgomery residues x * R mod m, see fate_mont_ctx
 
 }fate_bignum;
 
+/*================================================ STATS ================================================*/
+/*
+ * Built-in instrumentation of the batched modexp pipeline.
+ * Every stage keeps a sample count, total/max time and a log2 histogram of
+ * nanoseconds, so p50/p99 can be estimated without storing samples.
+ * Counters are atomics: they are updated from any thread calling powm_avx.
+ * The snapshot structures are part of the C interface in fate_powm.h.
+ */
+
+static const char* fate_stage_name[FATE_STAGE_NUM] = { "convert", "key_setup", "scratch", "mb_call", "batch_fill" };
+
+static struct
+{
+    struct
+    {
+        std::atomic<uint64_t> count, total_ns, max_ns;
+        std::atomic<uint64_t> hist[FATE_HIST_BUCKETS];
+    } stage[FATE_STAGE_NUM];
+    std::atomic<uint64_t> ops, mb_calls, lanes_used, lanes_retried, remote_batches, stolen_tasks;
+    std::atomic<uint64_t> cache_hits, cache_misses, cache_dedup, cache_evictions;
+    std::atomic<uint64_t> lane_occupancy[FATE_MB_LANES + 1];
+
+    std::atomic<uint64_t> dump_interval_ns; // 0: periodic dump disabled
+    std::atomic<uint64_t> last_dump_ns;
+    std::atomic<FILE*> dump_fp;             // set by fate_stats_set_dump, read by every engine thread
+} g_fate_stats;
+
+static inline uint64_t fate_now_ns()
+{
+    return (uint64_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/*! Add one timing sample of the given stage */
+static void fate_stats_record(fate_stage s, uint64_t ns)
+{
+    int b = 0;
+    while (b < FATE_HIST_BUCKETS - 1 && (ns >> (b + 1)) != 0)
+        b++;
+
+    g_fate_stats.stage[s].count.fetch_add(1, memory_order_relaxed);
+    g_fate_stats.stage[s].total_ns.fetch_add(ns, memory_order_relaxed);
+    g_fate_stats.stage[s].hist[b].fetch_add(1, memory_order_relaxed);
+
+    uint64_t cur = g_fate_stats.stage[s].max_ns.load(memory_order_relaxed);
+    while (ns > cur && !g_fate_stats.stage[s].max_ns.compare_exchange_weak(cur, ns, memory_order_relaxed))
+        ;
+}
+
+/*! Account one multi-buffer call with `lanes` real operands */
+static void fate_stats_record_call(int lanes)
+{
+    g_fate_stats.mb_calls.fetch_add(1, memory_order_relaxed);
+    g_fate_stats.lanes_used.fetch_add(lanes, memory_order_relaxed);
+    g_fate_stats.lane_occupancy[lanes].fetch_add(1, memory_order_relaxed);
+}
+
+/*! Take a consistent-enough snapshot of all counters */
+void fate_stats_get(fate_stats* out)
+{
+    memset(out, 0, sizeof(fate_stats));
+    for (int s = 0; s < FATE_STAGE_NUM; s++)
+    {
+        out->stage[s].count = g_fate_stats.stage[s].count.load(memory_order_relaxed);
+        out->stage[s].total_ns = g_fate_stats.stage[s].total_ns.load(memory_order_relaxed);
+        out->stage[s].max_ns = g_fate_stats.stage[s].max_ns.load(memory_order_relaxed);
+        for (int b = 0; b < FATE_HIST_BUCKETS; b++)
+            out->stage[s].hist[b] = g_fate_stats.stage[s].hist[b].load(memory_order_relaxed);
+    }
+    out->ops = g_fate_stats.ops.load(memory_order_relaxed);
+    out->mb_calls = g_fate_stats.mb_calls.load(memory_order_relaxed);
+    out->lanes_used = g_fate_stats.lanes_used.load(memory_order_relaxed);
+    out->lanes_retried = g_fate_stats.lanes_retried.load(memory_order_relaxed);
+    out->remote_batches = g_fate_stats.remote_batches.load(memory_order_relaxed);
+    out->stolen_tasks = g_fate_stats.stolen_tasks.load(memory_order_relaxed);
+    out->cache_hits = g_fate_stats.cache_hits.load(memory_order_relaxed);
+    out->cache_misses = g_fate_stats.cache_misses.load(memory_order_relaxed);
+    out->cache_dedup = g_fate_stats.cache_dedup.load(memory_order_relaxed);
+    out->cache_evictions = g_fate_stats.cache_evictions.load(memory_order_relaxed);
+    for (int k = 0; k <= FATE_MB_LANES; k++)
+        out->lane_occupancy[k] = g_fate_stats.lane_occupancy[k].load(memory_order_relaxed);
+}
+
+void fate_stats_reset(void)
+{
+    for (int s = 0; s < FATE_STAGE_NUM; s++)
+    {
+        g_fate_stats.stage[s].count = 0;
+        g_fate_stats.stage[s].total_ns = 0;
+        g_fate_stats.stage[s].max_ns = 0;
+        for (int b = 0; b < FATE_HIST_BUCKETS; b++)
+            g_fate_stats.stage[s].hist[b] = 0;
+    }
+    g_fate_stats.ops = 0;
+    g_fate_stats.mb_calls = 0;
+    g_fate_stats.lanes_used = 0;
+    g_fate_stats.lanes_retried = 0;
+    g_fate_stats.remote_batches = 0;
+    g_fate_stats.stolen_tasks = 0;
+    g_fate_stats.cache_hits = 0;
+    g_fate_stats.cache_misses = 0;
+    g_fate_stats.cache_dedup = 0;
+    g_fate_stats.cache_evictions = 0;
+    for (int k = 0; k <= FATE_MB_LANES; k++)
+        g_fate_stats.lane_occupancy[k] = 0;
+}
+
+/*! Upper bound (ns) of the histogram bucket holding quantile q of the stage samples */
+uint64_t fate_stats_quantile(const fate_stage_stats* st, double q)
+{
+    if (st->count == 0)
+        return 0;
+
+    uint64_t target = (uint64_t)(q * (double)st->count);
+    uint64_t seen = 0;
+    for (int b = 0; b < FATE_HIST_BUCKETS; b++)
+    {
+        seen += st->hist[b];
+        if (seen > target)
+            return ((uint64_t)2 << b) < st->max_ns ? ((uint64_t)2 << b) : st->max_ns;
+    }
+    return st->max_ns;
+}
+
+void fate_stats_print(FILE* fp)
+{
+    fate_stats st;
+    fate_stats_get(&st);
+
+    fprintf(fp, "fate stats: ops = %llu mb_calls = %llu lanes/call = %.2f retried = %llu\n",
+            (unsigned long long)st.ops, (unsigned long long)st.mb_calls,
+            st.mb_calls ? (double)st.lanes_used / (double)st.mb_calls : 0.0,
+            (unsigned long long)st.lanes_retried);
+    for (int s = 0; s < FATE_STAGE_NUM; s++)
+    {
+        const fate_stage_stats* t = &st.stage[s];
+        fprintf(fp, "  %-10s n = %-8llu total = %10.3lf ms avg = %9.3lf us p50 <= %9.3lf us p99 <= %9.3lf us max = %9.3lf us\n",
+                fate_stage_name[s], (unsigned long long)t->count, t->total_ns / 1e6,
+                t->count ? t->total_ns / 1e3 / t->count : 0.0,
+                fate_stats_quantile(t, 0.5) / 1e3, fate_stats_quantile(t, 0.99) / 1e3, t->max_ns / 1e3);
+    }
+    uint64_t lookups = st.cache_hits + st.cache_misses + st.cache_dedup;
+    if (lookups)
+        fprintf(fp, "  cache      hits = %llu dedup = %llu misses = %llu evictions = %llu hit rate = %.1f%%\n",
+                (unsigned long long)st.cache_hits, (unsigned long long)st.cache_dedup,
+                (unsigned long long)st.cache_misses, (unsigned long long)st.cache_evictions,
+                100.0 * (st.cache_hits + st.cache_dedup) / lookups);
+    fprintf(fp, "  occupancy ");
+    for (int k = 1; k <= FATE_MB_LANES; k++)
+        fprintf(fp, " %d:%llu", k, (unsigned long long)st.lane_occupancy[k]);
+    fprintf(fp, "\n");
+    fflush(fp);
+}
+
+/*! Enable the periodic dump to `fp` every `interval_ms` (0 disables it) */
+void fate_stats_set_dump(FILE* fp, double interval_ms)
+{
+    g_fate_stats.dump_fp.store(fp, memory_order_release);
+    g_fate_stats.last_dump_ns = fate_now_ns();
+    g_fate_stats.dump_interval_ns = (uint64_t)(interval_ms * 1e6);
+}
+
+/*! Called at the end of each powm_avx, dumps the stats when the interval elapsed */
+static void fate_stats_maybe_dump()
+{
+    uint64_t interval = g_fate_stats.dump_interval_ns.load(memory_order_relaxed);
+    if (interval == 0)
+        return;
+
+    uint64_t now = fate_now_ns();
+    uint64_t last = g_fate_stats.last_dump_ns.load(memory_order_relaxed);
+    if (now - last >= interval && g_fate_stats.last_dump_ns.compare_exchange_strong(last, now))
+    {
+        FILE* fp = g_fate_stats.dump_fp.load(memory_order_acquire);
+        fate_stats_print(fp ? fp : stdout);
+    }
+}
+
 
 void vec2gmp(vector<Ipp32u> &vec, mpz_t g)
 {
@@ -143,6 +347,26 @@ BigNumber gmp2num(mpz_t g)
     return BigNumber(ipp, 32);
 }
 
+/*! mpz_t -> BigNumber of any size (gmp2num only accepts exactly 1024 bits) */
+BigNumber mpz2num(const mpz_t g)
+{
+    vector<Ipp32u> tmp((mpz_sizeinbase(g, 2) + 31) / 32, 0);
+    size_t words = 0;
+    mpz_export(tmp.data(), &words, -1, sizeof(Ipp32u), 0, 0, g);
+    if (words == 0)
+        return BigNumber((Ipp32u)0);
+
+    return BigNumber(tmp.data(), (int)words);
+}
+
+/*! BigNumber -> already initialized mpz_t */
+void num2mpz(BigNumber& n, mpz_t g)
+{
+    vector<Ipp32u> tmp;
+    n.num2vec(tmp);
+    mpz_import(g, tmp.size(), -1, sizeof(Ipp32u), 0, 0, tmp.data());
+}
+
 void rsa(mpz_t res, mpz_t pln, mpz_t e, mpz_t n, bool out)
 {
     //mpz_init(res);
@@ -175,7 +399,7 @@ void g_printf(mpz_t g, vector<Ipp32u> &v)
 
     for (int i = 0; i < gs; i++)
     {
-        printf("%d %d\n", iter[i], v[i]);
+        printf("%d %u\n", iter[i], v[i]);
     }
 }
 
@@ -196,8 +420,7 @@ int g_Comp(mpz_t g, vector<Ipp32u> &v)
     {
         if (v[i] != iter[i])
         {
-            printf("error ~~~\n", v[i], iter[i]);
-            printf("%d %d\n", iter[i], v[i]);
+            printf("error ~~~ [%d] %u %u\n", i, iter[i], v[i]);
             return -1;
         }
     }
@@ -245,46 +468,328 @@ int numComp(BigNumber a, BigNumber b)
     for (int i = 0; i < v.size(); i++)
     {
 
-        printf("[%d]val = %d %d\n", i, v[i], u[i]);
-
         if (v[i] != u[i])
         {
-            printf("error ~~~\n", v[i], u[i]);
+            printf("error ~~~ [%d] %u %u\n", i, v[i], u[i]);
             return -1;
         }
     }
     return 1;
 }
 
-BigNumber genrand()
+/*================================================ RANDOM ================================================*/
+/*
+ * ChaCha20 keystream generator (RFC 7539 block function, 64-bit block
+ * counter), seeded from the OS. With AVX2 eight blocks are computed at once,
+ * one block per 32-bit lane. Every thread owns its own generator, so bulk
+ * generation needs no locking and never repeats across threads.
+ */
+
+#define FATE_RNG_BLOCK 64
+#define FATE_RNG_WIDE 8
+
+typedef struct
+{
+    uint32_t key[8];
+    uint64_t counter;
+    uint32_t nonce[2];
+    uint8_t buf[FATE_RNG_BLOCK * FATE_RNG_WIDE];
+    size_t pos; // consumed bytes of buf
+} fate_rng;
+
+#define CHACHA_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define CHACHA_QR(a, b, c, d)                                      \
+    a += b; d ^= a; d = CHACHA_ROTL(d, 16);                        \
+    c += d; b ^= c; b = CHACHA_ROTL(b, 12);                        \
+    a += b; d ^= a; d = CHACHA_ROTL(d, 8);                         \
+    c += d; b ^= c; b = CHACHA_ROTL(b, 7);
+
+static void chacha_init_state(const fate_rng* rng, uint64_t counter, uint32_t s[16])
+{
+    s[0] = 0x61707865;
+    s[1] = 0x3320646e;
+    s[2] = 0x79622d32;
+    s[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++)
+        s[4 + i] = rng->key[i];
+    s[12] = (uint32_t)counter;
+    s[13] = (uint32_t)(counter >> 32);
+    s[14] = rng->nonce[0];
+    s[15] = rng->nonce[1];
+}
+
+/*! One 64-byte block, the generator itself only uses it without AVX2 */
+static inline void chacha_block(const fate_rng* rng, uint64_t counter, uint8_t* out)
 {
-    srand((unsigned int)clock());
+    uint32_t in[16], x[16];
+    chacha_init_state(rng, counter, in);
+    memcpy(x, in, sizeof(x));
 
-    Ipp32u *ipp = (Ipp32u *)malloc(sizeof(int) * 32);
-    for (int i = 0; i < 32; i++)
+    for (int r = 0; r < 10; r++)
     {
-        ipp[i] = rand();
+        CHACHA_QR(x[0], x[4], x[8], x[12]);
+        CHACHA_QR(x[1], x[5], x[9], x[13]);
+        CHACHA_QR(x[2], x[6], x[10], x[14]);
+        CHACHA_QR(x[3], x[7], x[11], x[15]);
+        CHACHA_QR(x[0], x[5], x[10], x[15]);
+        CHACHA_QR(x[1], x[6], x[11], x[12]);
+        CHACHA_QR(x[2], x[7], x[8], x[13]);
+        CHACHA_QR(x[3], x[4], x[9], x[14]);
     }
+    for (int i = 0; i < 16; i++)
+        x[i] += in[i];
+    memcpy(out, x, FATE_RNG_BLOCK);
+}
 
-    return BigNumber(ipp, 32);
+#ifdef __AVX2__
+static inline __m256i chacha_rotl(__m256i v, int n)
+{
+    return _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - n));
 }
 
-void genrand_gmp(mpz_t g)
+#define CHACHA_QR8(a, b, c, d)                                                          \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16); \
+    c = _mm256_add_epi32(c, d); b = chacha_rotl(_mm256_xor_si256(b, c), 12);            \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8);  \
+    c = _mm256_add_epi32(c, d); b = chacha_rotl(_mm256_xor_si256(b, c), 7);
+
+/*! Eight consecutive blocks, lane j computes block counter + j */
+static void chacha_block8(const fate_rng* rng, uint64_t counter, uint8_t* out)
 {
-    printf("size = %d \n", g->_mp_size);
-    printf("alloc = %d \n", g->_mp_alloc);
-    assert(g->_mp_alloc== 16);
+    const __m256i rot16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                           2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+    const __m256i rot8 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                          3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+    uint32_t s[16];
+    chacha_init_state(rng, counter, s);
+
+    __m256i in[16], x[16];
+    for (int i = 0; i < 16; i++)
+        in[i] = _mm256_set1_epi32((int)s[i]);
+
+    /* 64-bit counter + lane, carried into word 13 */
+    __m256i lo = _mm256_add_epi32(in[12], _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256i bias = _mm256_set1_epi32((int)0x80000000);
+    __m256i carry = _mm256_cmpgt_epi32(_mm256_xor_si256(in[12], bias), _mm256_xor_si256(lo, bias));
+    in[12] = lo;
+    in[13] = _mm256_sub_epi32(in[13], carry);
+
+    for (int i = 0; i < 16; i++)
+        x[i] = in[i];
+
+    for (int r = 0; r < 10; r++)
+    {
+        CHACHA_QR8(x[0], x[4], x[8], x[12]);
+        CHACHA_QR8(x[1], x[5], x[9], x[13]);
+        CHACHA_QR8(x[2], x[6], x[10], x[14]);
+        CHACHA_QR8(x[3], x[7], x[11], x[15]);
+        CHACHA_QR8(x[0], x[5], x[10], x[15]);
+        CHACHA_QR8(x[1], x[6], x[11], x[12]);
+        CHACHA_QR8(x[2], x[7], x[8], x[13]);
+        CHACHA_QR8(x[3], x[4], x[9], x[14]);
+    }
 
-    srand((unsigned int)clock());
-    int* iter = (int*)g->_mp_d;
-    for (int i = 0; i < 32; i++)
+    /* word-major registers -> block-major output */
+    alignas(32) uint32_t w[16][8];
+    for (int i = 0; i < 16; i++)
+        _mm256_store_si256((__m256i*)w[i], _mm256_add_epi32(x[i], in[i]));
+
+    uint32_t* o = (uint32_t*)out;
+    for (int j = 0; j < 8; j++)
+        for (int i = 0; i < 16; i++)
+            o[j * 16 + i] = w[i][j];
+}
+#endif
+
+/*! Next FATE_RNG_WIDE blocks of keystream */
+static void fate_rng_refill(fate_rng* rng, uint8_t* out)
+{
+#ifdef __AVX2__
+    chacha_block8(rng, rng->counter, out);
+#else
+    for (int j = 0; j < FATE_RNG_WIDE; j++)
+        chacha_block(rng, rng->counter + j, out + j * FATE_RNG_BLOCK);
+#endif
+    rng->counter += FATE_RNG_WIDE;
+}
+
+void fate_rng_seed(fate_rng* rng, const uint8_t seed[32], uint64_t stream)
+{
+    memcpy(rng->key, seed, 32);
+    rng->counter = 0;
+    rng->nonce[0] = (uint32_t)stream;
+    rng->nonce[1] = (uint32_t)(stream >> 32);
+    rng->pos = sizeof(rng->buf);
+}
+
+/*! Seed from the OS entropy source, returns false when none is available */
+bool fate_rng_init(fate_rng* rng)
+{
+    uint8_t seed[32];
+    size_t got = 0;
+    while (got < sizeof(seed))
+    {
+        ssize_t n = getrandom(seed + got, sizeof(seed) - got, 0);
+        if (n <= 0)
+            break;
+        got += (size_t)n;
+    }
+    if (got < sizeof(seed))
+    {
+        FILE* fp = fopen("/dev/urandom", "rb");
+        if (fp == NULL)
+            return false;
+        got = fread(seed, 1, sizeof(seed), fp);
+        fclose(fp);
+        if (got != sizeof(seed))
+            return false;
+    }
+
+    fate_rng_seed(rng, seed, 0);
+    memset(seed, 0, sizeof(seed));
+    return true;
+}
+
+void fate_rng_bytes(fate_rng* rng, void* out, size_t n)
+{
+    uint8_t* p = (uint8_t*)out;
+
+    size_t take = sizeof(rng->buf) - rng->pos;
+    take = take < n ? take : n;
+    memcpy(p, rng->buf + rng->pos, take);
+    rng->pos += take;
+    p += take;
+    n -= take;
+
+    /* whole chunks go straight to the destination */
+    while (n >= sizeof(rng->buf))
+    {
+        fate_rng_refill(rng, p);
+        p += sizeof(rng->buf);
+        n -= sizeof(rng->buf);
+    }
+
+    if (n > 0)
+    {
+        fate_rng_refill(rng, rng->buf);
+        memcpy(p, rng->buf, n);
+        rng->pos = n;
+    }
+}
+
+/* bumped in the child of every fork, so a forked process does not replay its parent's keystream */
+static atomic<uint64_t> g_fate_rng_forks(0);
+
+static void fate_rng_atfork_child()
+{
+    g_fate_rng_forks.fetch_add(1, memory_order_relaxed);
+}
+
+/*
+ * Generator of the calling thread, seeded on first use and again after a
+ * fork. Without an entropy source the process aborts: an unseeded generator
+ * would hand out OAEP seeds, PSS salts and prime search starts from an
+ * all-zero key.
+ */
+static fate_rng* fate_thread_rng()
+{
+    static std::once_flag atfork;
+    static thread_local fate_rng rng;
+    static thread_local uint64_t seededAt = UINT64_MAX; // g_fate_rng_forks at seeding
+    std::call_once(atfork, [] { pthread_atfork(NULL, NULL, fate_rng_atfork_child); });
+
+    uint64_t forks = g_fate_rng_forks.load(memory_order_relaxed);
+    if (seededAt != forks)
+    {
+        if (!fate_rng_init(&rng))
+        {
+            fprintf(stderr, "fate_powm: no entropy source for the random generator\n");
+            abort();
+        }
+        seededAt = forks;
+    }
+    return &rng;
+}
+
+/*
+ * Uniform values below m: out[i * limbs .. ) gets a value in [0, m[i]) (or
+ * [0, m[0]) when sharedModulus), by masking random limbs to the bit length
+ * of the modulus and rejecting candidates >= m. A whole chunk of candidates
+ * is drawn from the keystream at once.
+ */
+int fate_rand_below_limbs(fate_rng* rng, uint64_t* out, const uint64_t* m, int limbs, int num, bool sharedModulus)
+{
+    const int chunk = 64;
+    vector<uint64_t> cand((size_t)chunk * limbs);
+
+    for (int i = 0; i < num;)
     {
-        iter[i] = rand();
+        const uint64_t* mi = sharedModulus ? m : m + (size_t)i * limbs;
+        int top = limbs - 1;
+        while (top >= 0 && mi[top] == 0)
+            top--;
+        if (top < 0)
+            return -1;
+        int shift = 63;
+        while (((mi[top] >> shift) & 1) == 0)
+            shift--;
+        uint64_t mask = shift == 63 ? ~(uint64_t)0 : (((uint64_t)1 << (shift + 1)) - 1);
+
+        /* with a shared modulus a chunk serves many outputs, otherwise one */
+        int want = sharedModulus ? (num - i < chunk ? num - i : chunk) : 1;
+        fate_rng_bytes(rng, cand.data(), sizeof(uint64_t) * limbs * want);
+
+        for (int c = 0; c < want; c++)
+        {
+            uint64_t* v = cand.data() + (size_t)c * limbs;
+            for (int k = top + 1; k < limbs; k++)
+                v[k] = 0;
+            v[top] &= mask;
+
+            int k = top;
+            while (k > 0 && v[k] == mi[k])
+                k--;
+            if (v[k] < mi[k])
+                memcpy(out + (size_t)(i++) * limbs, v, sizeof(uint64_t) * limbs);
+        }
     }
-    g->_mp_size = 16;
+    return 0;
+}
+
+/*! fate_bignum flavour: out->bigint[i] uniform in [0, m), i < num */
+int fate_rand_below(fate_bignum* out, const mpz_t m, int num)
+{
+    assert(out->ismalloc == 1 && out->num >= num);
+    if (mpz_sgn(m) <= 0)
+        return -1;
 
+    int limbs = (int)((mpz_sizeinbase(m, 2) + 63) / 64);
+    vector<uint64_t> ml(limbs, 0), v((size_t)limbs * num);
+    mpz_export(ml.data(), NULL, -1, sizeof(uint64_t), 0, 0, m);
+
+    if (fate_rand_below_limbs(fate_thread_rng(), v.data(), ml.data(), limbs, num, true) != 0)
+        return -1;
+    for (int i = 0; i < num; i++)
+        mpz_import(out->bigint[i], limbs, -1, sizeof(uint64_t), 0, 0, v.data() + (size_t)i * limbs);
+
+    return 0;
+}
+
+BigNumber genrand()
+{
+    Ipp32u ipp[32];
+    fate_rng_bytes(fate_thread_rng(), ipp, sizeof(ipp));
+
+    return BigNumber(ipp, 32);
 }
 
+/*! 1024 uniformly random bits into an initialized mpz_t */
+void genrand_gmp(mpz_t g)
+{
+    uint64_t v[16];
+    fate_rng_bytes(fate_thread_rng(), v, sizeof(v));
+    mpz_import(g, 16, -1, sizeof(uint64_t), 0, 0, v);
+}
 
 static BigNumber _E("0x010001");
 
@@ -726,303 +1231,7271 @@ int main1()
     return 0;
 }
 
-int powm_avx(fate_bignum* res, fate_bignum* b, fate_bignum* e, fate_bignum* m, int num)
-{
-    /*CCCC**/
-    assert(res->ismalloc == 1);
-    assert(b->ismalloc == 1);
-    assert(e->ismalloc == 1);
-    assert(m->ismalloc == 1);
-
-    assert(res->num == b->num);
-    assert(e->num == b->num);
-    assert(m->num == b->num);
+/*================================================ NUMA ================================================*/
+/*
+ * Node placement helpers. Built with -DFATE_ENABLE_NUMA (and -lnuma) they use
+ * libnuma, otherwise the host is treated as a single node and memory comes
+ * from the regular heap.
+ */
 
+static int fate_numa_nodes()
+{
+#ifdef FATE_ENABLE_NUMA
+    if (numa_available() >= 0)
+        return numa_max_node() + 1;
+#endif
+    return 1;
+}
 
-    const int buf = 8;
-    const int crypt = 10;
+/*! NUMA node holding the page of `p`, -1 when unknown */
+static int fate_node_of(const void* p)
+{
+#ifdef FATE_ENABLE_NUMA
+    if (numa_available() >= 0)
+    {
+        void* page = (void*)((uintptr_t)p & ~(uintptr_t)(numa_pagesize() - 1));
+        int node = -1;
+        if (numa_move_pages(0, 1, &page, NULL, &node, 0) == 0 && node >= 0)
+            return node;
+    }
+#else
+    (void)p;
+#endif
+    return -1;
+}
 
-    if (num % buf != 0)
-        return 0;
+/*! Pin the calling thread to the CPUs of `node` and prefer its memory */
+static void fate_bind_node(int node)
+{
+#ifdef FATE_ENABLE_NUMA
+    if (node >= 0 && numa_available() >= 0)
+    {
+        numa_run_on_node(node);
+        numa_set_preferred(node);
+    }
+#else
+    (void)node;
+#endif
+}
 
-    Request** req = (Request**)malloc(sizeof(void*) * num);
-    clock_t str = clock();
-    int idx;
+static void* fate_node_alloc(size_t size, int node)
+{
+#ifdef FATE_ENABLE_NUMA
+    if (node >= 0 && numa_available() >= 0)
+        return numa_alloc_onnode(size, node);
+#else
+    (void)node;
+#endif
+    return malloc(size);
+}
 
+static void fate_node_free(void* p, size_t size)
+{
+    if (p == NULL)
+        return;
+#ifdef FATE_ENABLE_NUMA
+    if (numa_available() >= 0)
+    {
+        numa_free(p, size);
+        return;
+    }
+#else
+    (void)size;
+#endif
+    free(p);
+}
 
-    for (int i = 0; i < num; i++)
+/*
+ * Per-worker memory for key contexts and the scratch buffer of the
+ * multi-buffer call. The arenas only grow, so after the first batch no
+ * allocation happens on the hot path, and they stay on the worker's node.
+ */
+typedef struct
+{
+    int node;         // node of the arenas, -1: no binding
+    Ipp8u* keys;
+    size_t keys_size;
+    Ipp8u* scratch;
+    size_t scratch_size;
+} fate_mb_workspace;
+
+static Ipp8u* fate_ws_reserve(int node, Ipp8u** arena, size_t* size, size_t need)
+{
+    if (need > *size)
     {
-        req[i] = new Request(gmp2num(b->bigint[i]), gmp2num(m->bigint[i]), _E,\
-            gmp2num(e->bigint[i]));
+        fate_node_free(*arena, *size);
+        *size = need + need / 2;
+        *arena = (Ipp8u*)fate_node_alloc(*size, node);
+        if (*arena == NULL)
+            *size = 0; // the next batch tries again instead of running on a NULL arena
     }
+    return *arena;
+}
 
-    IppStatus status = ippStsNoErr;
-    IppStatus statusesArray[buf];
+static void fate_ws_init(fate_mb_workspace* ws, int node)
+{
+    memset(ws, 0, sizeof(fate_mb_workspace));
+    ws->node = node;
+}
 
-    IppsRSAPublicKeyState* pPubKey[buf];
-    IppsRSAPrivateKeyState* pPrivKey[buf];
-    IppsBigNumState* mbPlainTextArray[buf];
-    IppsBigNumState* mbCipherTextArray[buf];
-    IppsBigNumState* mbDecipherTextArray[buf];
+static void fate_ws_release(fate_mb_workspace* ws)
+{
+    fate_node_free(ws->keys, ws->keys_size);
+    fate_node_free(ws->scratch, ws->scratch_size);
+    fate_ws_init(ws, ws->node);
+}
 
-    int bitSizeN, bitSizeE, bitSizeD;
-    int bufId = 0;
+/*! Placement of the parallel batched engine */
+typedef struct
+{
+    int threads;     // worker threads, 0: one per hardware thread
+    int numa_nodes;  // nodes to spread the workers over, 0: all nodes, 1: single socket
+} fate_parallel_opts;
 
-    if (ENABLE_GMP)
+/*! Scalar fallback for a single element, mpz_powm_sec for secret exponents */
+static int powm_gmp_lane(mpz_t res, mpz_t b, mpz_t e, mpz_t m, bool secret = false)
+{
+    if (mpz_sgn(m) == 0 || mpz_sgn(e) < 0)
+        return FATE_STS_ERR;
+
+    /* mpz_powm_sec wants an odd modulus and a positive exponent, which every RSA and Paillier key has */
+    if (secret && mpz_odd_p(m) && mpz_sgn(e) > 0)
+        mpz_powm_sec(res, b, e, m);
+    else
+        mpz_powm(res, b, e, m);
+    g_fate_stats.lanes_retried.fetch_add(1, memory_order_relaxed);
+    return FATE_STS_GMP_RETRY;
+}
+
+/*! Check that an element can be handed to the multi-buffer engine at all */
+static bool CheckMbOperands(mpz_t b, mpz_t e, mpz_t m)
+{
+    return mpz_sgn(b) >= 0 && mpz_sgn(e) > 0 && mpz_odd_p(m) && mpz_cmp(b, m) < 0;
+}
+
+/*
+ * Compute res[j] = b[j]^e[j] mod m[j] for up to 8 lanes with one ippsRSA_MB_Decrypt call.
+ * Every lane gets its own status: lanes that are incompatible with the batch or
+ * that the multi-buffer engine rejects are recomputed with mpz_powm, so one bad
+ * operand does not abandon the rest of the batch.
+ * Key contexts and scratch come from `ws` when given, otherwise from the heap.
+ * With `secret` the recomputed lanes go through mpz_powm_sec.
+ * Returns the number of lanes without a valid result.
+ */
+static int powm_mb_batch(mpz_t* res, mpz_t* b, mpz_t* e, mpz_t* m, int lanes, int* status, fate_mb_workspace* ws = NULL,
+                         bool secret = false)
+{
+    const int buf = FATE_MB_LANES;
+    assert(lanes > 0 && lanes <= buf);
+
+    Request* req[buf] = { NULL };
+    IppsRSAPrivateKeyState* pPrivKey[buf] = { NULL };
+    IppsBigNumState* mbCipherTextArray[buf] = { NULL };
+    IppsBigNumState* mbDecipherTextArray[buf] = { NULL };
+    IppStatus statusesArray[buf];
+    bool inMb[buf] = { false };
+    int ref = -1; // first lane of the batch, all other lanes must be compatible with it
+    int mbLanes = 0;
+
+    uint64_t t0 = fate_now_ns();
+    for (int j = 0; j < lanes; j++)
     {
-        BigNumber _p = req[0]->GetPlainText();
-        BigNumber _c = req[0]->GetCipherText();
-        BigNumber _d = req[0]->GetDecipherText();
-        vector<Ipp32u> _vp;
-        vector<Ipp32u> _vc;
-        vector<Ipp32u> _vd;
-        _p.num2vec(_vp);
-        _c.num2vec(_vc);
-        _d.num2vec(_vd);
-        for (int i = 0; i < 8; i++)
-        {
-            printf("11111111 p = %d c = %d d = %d\n", _vp[i], _vc[i], _vd[i]);
-        }
+        if (CheckMbOperands(b[j], e[j], m[j]))
+            req[j] = new Request(mpz2num(b[j]), mpz2num(m[j]), _E, mpz2num(e[j]));
     }
-    /*========================================================= ENC =================================================*/
+    fate_stats_record(FATE_STAGE_CONVERT, fate_now_ns() - t0);
 
-    for (int i = 0; i < num; i++)
+    t0 = fate_now_ns();
+    int keySize[buf] = { 0 };
+    size_t keyOffset[buf] = { 0 };
+    size_t keysTotal = 0;
+    for (int j = 0; j < lanes; j++)
     {
-        bitSizeN = req[i]->GetBitSizeN();
-        bitSizeE = _E.BitSize();
-
-        //statue check
-        if (bufId > 0 && !CheckEncRequestsCompatibility(req[i - 1], req[i]))
-        {
-            req[i]->SetCompatibilityStatus(false);
+        if (req[j] == NULL)
             continue;
-        }
 
-        // embed data
-        int keySize = 0;
-        ippsRSA_GetSizePublicKey(bitSizeN, bitSizeE, &keySize);
-        pPubKey[bufId] = (IppsRSAPublicKeyState*)(new Ipp8u[keySize * 2]);
-        ippsRSA_InitPublicKey(bitSizeN, bitSizeE, pPubKey[bufId], keySize);
-        ippsRSA_SetPublicKey(req[i]->GetValueN(), E, pPubKey[bufId]);
-        mbCipherTextArray[bufId] = req[i]->GetCipherText();
-        mbPlainTextArray[bufId] = req[i]->GetPlainText();
+        ippsRSA_GetSizePrivateKeyType1(req[j]->GetBitSizeN(), req[j]->GetBitSizeD(), &keySize[j]);
+        keyOffset[j] = keysTotal;
+        keysTotal += (keySize[j] + 63) & ~63;
+    }
+    Ipp8u* keyArena = ws ? fate_ws_reserve(ws->node, &ws->keys, &ws->keys_size, keysTotal) : NULL;
 
-        bufId++;
+    for (int j = 0; j < lanes; j++)
+    {
+        if (req[j] == NULL)
+            continue;
 
-        //deal
-        int leave = buf;
+        int bitSizeD = req[j]->GetBitSizeD();
+        int bitSizeN = req[j]->GetBitSizeN();
 
-        if (num % buf != 0 && i == num - 1)
+        pPrivKey[j] = (IppsRSAPrivateKeyState*)(keyArena ? keyArena + keyOffset[j] : new Ipp8u[keySize[j]]);
+        ippsRSA_InitPrivateKeyType1(bitSizeN, bitSizeD, pPrivKey[j], keySize[j]);
+        ippsRSA_SetPrivateKeyType1(req[j]->GetValueN(), req[j]->GetValueD(), pPrivKey[j]);
+
+        /* Lanes incompatible with the reference lane are left to the scalar path */
+        if (ref >= 0 && (!CheckDecRequestsCompatibility(req[ref], req[j]) || !CheckPrivateKeyCompatibility(pPrivKey[ref], pPrivKey[j])))
         {
-            leave = num % buf;
-            while (bufId != buf)
-            {
-                pPubKey[bufId] = NULL;
-                mbCipherTextArray[bufId] = NULL;
-                mbPlainTextArray[bufId] = NULL;
-                bufId++;
-            }
+            req[j]->SetCompatibilityStatus(false);
+            continue;
         }
+        if (ref < 0)
+            ref = j;
 
-        /* Check if there are enough requests for the operation */
-        if (bufId == buf)
+        mbCipherTextArray[j] = req[j]->GetCipherText();
+        mbDecipherTextArray[j] = req[j]->GetDecipherText();
+        inMb[j] = true;
+        mbLanes++;
+    }
+    fate_stats_record(FATE_STAGE_KEY_SETUP, fate_now_ns() - t0);
+
+    if (mbLanes > 0)
+    {
+        /* Unused lanes stay NULL, the engine reports ippStsNullPtrErr for them */
+        const IppsRSAPrivateKeyState* mbKeys[buf];
+        for (int j = 0; j < buf; j++)
+            mbKeys[j] = inMb[j] ? pPrivKey[j] : NULL;
+
+        t0 = fate_now_ns();
+        int privBufSize = 0;
+        IppStatus ippSts = ippsRSA_MB_GetBufferSizePrivateKey(&privBufSize, mbKeys);
+        Ipp8u* pScratchBuffer = NULL;
+        if (ippSts == ippStsNoErr)
+            pScratchBuffer = ws ? fate_ws_reserve(ws->node, &ws->scratch, &ws->scratch_size, privBufSize) : new Ipp8u[privBufSize];
+        fate_stats_record(FATE_STAGE_SCRATCH, fate_now_ns() - t0);
+
+        if (ippSts == ippStsNoErr)
         {
-            /* Calculate temporary buffer size */
-            int pubBufSize = 0;
-            status = ippsRSA_MB_GetBufferSizePublicKey(&pubBufSize, pPubKey);
-            if (!checkStatus("ippsRSA_MB_GetBufferSizePublicKey", ippStsNoErr, status))
+            t0 = fate_now_ns();
+            ippSts = ippsRSA_MB_Decrypt(mbCipherTextArray, mbDecipherTextArray,
+                                        mbKeys, statusesArray,
+                                        pScratchBuffer);
+            fate_stats_record(FATE_STAGE_MB_CALL, fate_now_ns() - t0);
+            fate_stats_record_call(mbLanes);
+            if (ws == NULL)
+                delete[] pScratchBuffer;
+        }
+
+        /* Keep only the lanes the engine actually completed */
+        for (int j = 0; j < buf; j++)
+            if (inMb[j] && ((ippSts != ippStsNoErr && ippSts != ippStsMbWarning) || statusesArray[j] != ippStsNoErr))
+                inMb[j] = false;
+    }
+
+    t0 = fate_now_ns();
+    for (int j = 0; j < lanes; j++)
+    {
+        if (inMb[j])
+        {
+            num2mpz(req[j]->GetDecipherText(), res[j]);
+            status[j] = FATE_STS_MB;
+        }
+    }
+    fate_stats_record(FATE_STAGE_CONVERT, fate_now_ns() - t0);
+
+    int failed = 0;
+    for (int j = 0; j < lanes; j++)
+    {
+        if (!inMb[j])
+            status[j] = powm_gmp_lane(res[j], b[j], e[j], m[j], secret);
+        if (status[j] == FATE_STS_ERR)
+            failed++;
+
+        if (keyArena == NULL)
+            delete[](Ipp8u*) pPrivKey[j];
+        delete req[j];
+    }
+
+    return failed;
+}
+
+/*================================================ RESULT CACHE ================================================*/
+/*
+ * Optional bounded cache of b^e mod m in front of powm_avx and
+ * powm_avx_parallel, off until fate_cache_configure is called. Identical
+ * triples inside one call are computed once as well. Keys are a 64-bit hash
+ * of (b, e, m) confirmed by comparing the operands; the table is 2-way set
+ * associative, one lock per stripe of sets.
+ *
+ * Never cache secret or randomized inputs (private exponents, obfuscators):
+ * such callers run inside a fate_cache_bypass scope, and C API contexts only
+ * use the cache when created with fate_ctx_opts.cache set.
+ */
+
+#define FATE_CACHE_WAYS 2
+#define FATE_CACHE_STRIPES 64
+
+typedef struct
+{
+    uint64_t hash;
+    bool used;
+    bool recent;
+    mpz_t b, e, m, r;
+} fate_cache_entry;
+
+static struct
+{
+    std::mutex stripe[FATE_CACHE_STRIPES];
+    fate_cache_entry* entries;
+    size_t sets;
+    atomic<bool> enabled;
+} g_fate_cache;
+
+static thread_local int t_fate_cache_bypass = 0;
+
+/*! Keep the operations of the enclosing scope out of the cache */
+struct fate_cache_bypass
+{
+    fate_cache_bypass() { t_fate_cache_bypass++; }
+    ~fate_cache_bypass() { t_fate_cache_bypass--; }
+};
+
+static inline bool fate_cache_active()
+{
+    return t_fate_cache_bypass == 0 && g_fate_cache.enabled.load(memory_order_acquire);
+}
+
+static uint64_t fate_cache_hash(const mpz_t b, const mpz_t e, const mpz_t m)
+{
+    uint64_t h = 0x243F6A8885A308D3ull;
+    const mpz_srcptr x[3] = { b, e, m };
+    for (int k = 0; k < 3; k++)
+    {
+        const mp_limb_t* d = mpz_limbs_read(x[k]);
+        size_t n = mpz_size(x[k]);
+        h = (h ^ ((uint64_t)n << 1 | (mpz_sgn(x[k]) < 0))) * 0x9E3779B97F4A7C15ull;
+        for (size_t i = 0; i < n; i++)
+        {
+            h = (h ^ d[i]) * 0x9E3779B97F4A7C15ull;
+            h ^= h >> 29;
+        }
+    }
+    return h;
+}
+
+static bool fate_cache_match(const fate_cache_entry* c, uint64_t hash, const mpz_t b, const mpz_t e, const mpz_t m)
+{
+    return c->used && c->hash == hash && mpz_cmp(c->b, b) == 0 && mpz_cmp(c->e, e) == 0 && mpz_cmp(c->m, m) == 0;
+}
+
+static bool fate_cache_lookup(uint64_t hash, const mpz_t b, const mpz_t e, const mpz_t m, mpz_t r)
+{
+    size_t set = hash & (g_fate_cache.sets - 1);
+    lock_guard<mutex> lk(g_fate_cache.stripe[set % FATE_CACHE_STRIPES]);
+    fate_cache_entry* c = &g_fate_cache.entries[set * FATE_CACHE_WAYS];
+    for (int w = 0; w < FATE_CACHE_WAYS; w++)
+    {
+        if (fate_cache_match(&c[w], hash, b, e, m))
+        {
+            mpz_set(r, c[w].r);
+            c[w].recent = true;
+            c[1 - w].recent = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void fate_cache_insert(uint64_t hash, const mpz_t b, const mpz_t e, const mpz_t m, const mpz_t r)
+{
+    size_t set = hash & (g_fate_cache.sets - 1);
+    lock_guard<mutex> lk(g_fate_cache.stripe[set % FATE_CACHE_STRIPES]);
+    fate_cache_entry* c = &g_fate_cache.entries[set * FATE_CACHE_WAYS];
+    int w = !c[0].used ? 0 : !c[1].used ? 1 : c[0].recent ? 1 : 0;
+    if (c[w].used)
+        g_fate_stats.cache_evictions.fetch_add(1, memory_order_relaxed);
+    c[w].hash = hash;
+    c[w].used = true;
+    c[w].recent = true;
+    c[1 - w].recent = false;
+    mpz_set(c[w].b, b);
+    mpz_set(c[w].e, e);
+    mpz_set(c[w].m, m);
+    mpz_set(c[w].r, r);
+}
+
+int fate_cache_configure(size_t entries)
+{
+    g_fate_cache.enabled.store(false, memory_order_release);
+    if (g_fate_cache.entries)
+    {
+        for (size_t i = 0; i < g_fate_cache.sets * FATE_CACHE_WAYS; i++)
+            mpz_clears(g_fate_cache.entries[i].b, g_fate_cache.entries[i].e, g_fate_cache.entries[i].m,
+                       g_fate_cache.entries[i].r, NULL);
+        free(g_fate_cache.entries);
+        g_fate_cache.entries = NULL;
+        g_fate_cache.sets = 0;
+    }
+    if (entries == 0)
+        return 0;
+
+    size_t sets = 1;
+    while (sets * FATE_CACHE_WAYS < entries)
+        sets <<= 1;
+    fate_cache_entry* c = (fate_cache_entry*)malloc(sizeof(fate_cache_entry) * sets * FATE_CACHE_WAYS);
+    if (c == NULL)
+        return -1;
+    for (size_t i = 0; i < sets * FATE_CACHE_WAYS; i++)
+    {
+        c[i].used = false;
+        c[i].recent = false;
+        mpz_inits(c[i].b, c[i].e, c[i].m, c[i].r, NULL);
+    }
+    g_fate_cache.entries = c;
+    g_fate_cache.sets = sets;
+    g_fate_cache.enabled.store(true, memory_order_release);
+
+    return 0;
+}
+
+/*
+ * Serve what the cache and the call itself already have, run the remaining
+ * distinct triples through `run` (the engine, with the cache bypassed) and
+ * remember their results.
+ */
+template <typename Run>
+static int fate_cache_run(fate_bignum* res, fate_bignum* b, fate_bignum* e, fate_bignum* m, int num, int* status,
+                          Run run)
+{
+    vector<uint64_t> hash(num);
+    vector<int> src(num);           // -2: cache hit, -1: computed, otherwise copy of element src[i]
+    vector<int> laneStatus(num);
+    std::unordered_map<uint64_t, int> first;
+    vector<int> miss;
+
+    for (int i = 0; i < num; i++)
+    {
+        hash[i] = fate_cache_hash(b->bigint[i], e->bigint[i], m->bigint[i]);
+        if (fate_cache_lookup(hash[i], b->bigint[i], e->bigint[i], m->bigint[i], res->bigint[i]))
+        {
+            src[i] = -2;
+            laneStatus[i] = FATE_STS_OK;
+            continue;
+        }
+        auto it = first.find(hash[i]);
+        if (it != first.end() && mpz_cmp(b->bigint[it->second], b->bigint[i]) == 0 &&
+            mpz_cmp(e->bigint[it->second], e->bigint[i]) == 0 && mpz_cmp(m->bigint[it->second], m->bigint[i]) == 0)
+        {
+            src[i] = it->second;
+            continue;
+        }
+        if (it == first.end())
+            first.emplace(hash[i], i);
+        src[i] = -1;
+        miss.push_back(i);
+    }
+
+    int k = (int)miss.size();
+    g_fate_stats.cache_hits.fetch_add(std::count(src.begin(), src.end(), -2), memory_order_relaxed);
+    g_fate_stats.cache_misses.fetch_add(k, memory_order_relaxed);
+    g_fate_stats.cache_dedup.fetch_add(num - k - std::count(src.begin(), src.end(), -2), memory_order_relaxed);
+
+    if (k > 0)
+    {
+        /*
+         * Compact the misses into copies: res may alias an operand, so the
+         * operands cannot be moved out, and the cache keys are taken from
+         * the copies once the caller's arrays hold results.
+         */
+        fate_bignum fb[4];
+        fate_bignum* orig[4] = { res, b, e, m };
+        for (int t = 0; t < 4; t++)
+        {
+            fb[t].bigint = (mpz_t*)malloc(sizeof(mpz_t) * k);
+            fb[t].num = k;
+            fb[t].ismalloc = 1;
+            fb[t].ismont = 0;
+            for (int j = 0; j < k; j++)
+            {
+                if (t == 0)
+                    mpz_init(fb[t].bigint[j]);
+                else
+                    mpz_init_set(fb[t].bigint[j], orig[t]->bigint[miss[j]]);
+            }
+        }
+        vector<int> missStatus(k);
+        {
+            fate_cache_bypass bypass;
+            run(&fb[0], &fb[1], &fb[2], &fb[3], k, missStatus.data());
+        }
+        for (int j = 0; j < k; j++)
+        {
+            int i = miss[j];
+            mpz_swap(fb[0].bigint[j], res->bigint[i]);
+            laneStatus[i] = missStatus[j];
+            if (missStatus[j] != FATE_STS_ERR)
+                fate_cache_insert(hash[i], fb[1].bigint[j], fb[2].bigint[j], fb[3].bigint[j], res->bigint[i]);
+        }
+        for (int t = 0; t < 4; t++)
+        {
+            for (int j = 0; j < k; j++)
+                mpz_clear(fb[t].bigint[j]);
+            free(fb[t].bigint);
+        }
+    }
+
+    int failed = 0;
+    for (int i = 0; i < num; i++)
+    {
+        if (src[i] >= 0)
+        {
+            mpz_set(res->bigint[i], res->bigint[src[i]]);
+            laneStatus[i] = laneStatus[src[i]];
+        }
+        if (laneStatus[i] == FATE_STS_ERR)
+            failed++;
+        if (status)
+            status[i] = laneStatus[i];
+    }
+
+    return failed;
+}
+
+/*================================================ TUNING ================================================*/
+/*
+ * Host profile written by fate_autotune. Per modulus size it records from
+ * how many filled lanes one multi-buffer call beats mpz_powm on the same
+ * lanes, and from how many elements a call is worth spreading over threads.
+ * Without a profile every batch goes to the multi-buffer engine on the
+ * calling thread.
+ */
+
+#define FATE_TUNE_SIZES 4
+
+typedef struct
+{
+    int bits;          // modulus size, one of the sizes ippsRSA_MB_Decrypt accepts
+    int mb_min_lanes;  // batches with fewer lanes go to mpz_powm, FATE_MB_LANES + 1: never multi-buffer
+    int mt_min;        // calls with at least this many elements run threaded, 0: never
+    int threads;       // worker threads of the threaded calls
+    int shared_exp;    // 1: batches whose lanes share one exponent take the lockstep kernel
+    int gmp_ns;        // one mpz_powm with a full-size exponent, 0: not measured
+    int mb_ns;         // one full multi-buffer call with full-size exponents, 0: not measured
+} fate_tune_entry;
+
+static fate_tune_entry g_fate_tune[FATE_TUNE_SIZES] = {
+    { 1024, 1, 0, 1, 0, 0, 0 }, { 2048, 1, 0, 1, 0, 0, 0 }, { 3072, 1, 0, 1, 0, 0, 0 }, { 4096, 1, 0, 1, 0, 0, 0 }
+};
+static atomic<bool> g_fate_tune_loaded(false);
+static atomic<bool> g_fate_tuning(false); // set while fate_autotune measures the backends
+static std::once_flag g_fate_tune_once;
+
+/* moduli the multi-buffer engine rejects anyway */
+static const fate_tune_entry g_fate_tune_gmp = { 0, FATE_MB_LANES + 1, 0, 1, 0, 0, 0 };
+
+static void fate_tune_startup();
+
+/*! Profile entry for modulus m, NULL: no profile */
+static const fate_tune_entry* fate_tune_lookup(const mpz_t m)
+{
+    if (g_fate_tuning.load(memory_order_relaxed))
+        return NULL;
+    std::call_once(g_fate_tune_once, fate_tune_startup);
+    if (!g_fate_tune_loaded.load(memory_order_acquire))
+        return NULL;
+
+    int bits = (int)mpz_sizeinbase(m, 2);
+    for (int k = 0; k < FATE_TUNE_SIZES; k++)
+        if (g_fate_tune[k].bits == bits)
+            return &g_fate_tune[k];
+    return &g_fate_tune_gmp;
+}
+
+/*! mpz_powm picked by the profile, as opposed to a retry of a rejected lane */
+static int powm_gmp_direct(mpz_t res, mpz_t b, mpz_t e, mpz_t m)
+{
+    if (mpz_sgn(m) == 0 || mpz_sgn(e) < 0)
+        return FATE_STS_ERR;
+
+    mpz_powm(res, b, e, m);
+    return FATE_STS_OK;
+}
+
+static bool fate_lanes_share_exponent(mpz_t* e, int lanes);
+static int powm_shared_batch(mpz_t* res, mpz_t* b, mpz_t* e, mpz_t* m, int lanes, int* status);
+
+/*! One batch through the backend `tune` picks for its fill, multi-buffer when tune is NULL */
+static int powm_batch_with(const fate_tune_entry* tune, mpz_t* res, mpz_t* b, mpz_t* e, mpz_t* m, int lanes,
+                           int* status, fate_mb_workspace* ws = NULL)
+{
+    if (tune && tune->shared_exp && fate_lanes_share_exponent(e, lanes))
+        return powm_shared_batch(res, b, e, m, lanes, status);
+    if (tune == NULL || lanes >= tune->mb_min_lanes)
+        return powm_mb_batch(res, b, e, m, lanes, status, ws);
+
+    int failed = 0;
+    for (int j = 0; j < lanes; j++)
+    {
+        status[j] = powm_gmp_direct(res[j], b[j], e[j], m[j]);
+        if (status[j] == FATE_STS_ERR)
+            failed++;
+    }
+
+    return failed;
+}
+
+static int powm_tuned_batch(mpz_t* res, mpz_t* b, mpz_t* e, mpz_t* m, int lanes, int* status,
+                            fate_mb_workspace* ws = NULL)
+{
+    return powm_batch_with(fate_tune_lookup(m[0]), res, b, e, m, lanes, status, ws);
+}
+
+int powm_avx_parallel(fate_bignum* res, fate_bignum* b, fate_bignum* e, fate_bignum* m, int num, int* status,
+                      const fate_parallel_opts* opts);
+
+/*
+ * res[i] = b[i]^e[i] mod m[i], i < num, batched 8 lanes at a time.
+ * `status`, when given, receives one fate_status per element, aligned with res.
+ * Returns the number of elements without a valid result.
+ */
+int powm_avx(fate_bignum* res, fate_bignum* b, fate_bignum* e, fate_bignum* m, int num, int* status = NULL)
+{
+    /*CCCC**/
+    assert(res->ismalloc == 1);
+    assert(b->ismalloc == 1);
+    assert(e->ismalloc == 1);
+    assert(m->ismalloc == 1);
+
+    assert(res->num == b->num);
+    assert(e->num == b->num);
+    assert(m->num == b->num);
+
+    if (fate_cache_active())
+        return fate_cache_run(res, b, e, m, num, status, [](fate_bignum* r, fate_bignum* x, fate_bignum* y,
+                                                            fate_bignum* z, int n, int* st) {
+            return powm_avx(r, x, y, z, n, st);
+        });
+
+    const int buf = FATE_MB_LANES;
+
+    const fate_tune_entry* tune = num > 0 ? fate_tune_lookup(m->bigint[0]) : NULL;
+    if (tune && tune->mt_min > 0 && num >= tune->mt_min && tune->threads > 1)
+    {
+        fate_parallel_opts opts = { tune->threads, 0 };
+        return powm_avx_parallel(res, b, e, m, num, status, &opts);
+    }
+
+    g_fate_stats.ops.fetch_add(num, memory_order_relaxed);
+
+    int laneStatus[buf];
+    int failed = 0;
+    for (int i = 0; i < num; i += buf)
+    {
+        int lanes = num - i < buf ? num - i : buf;
+        failed += powm_tuned_batch(res->bigint + i, b->bigint + i, e->bigint + i, m->bigint + i, lanes,
+                                   status ? status + i : laneStatus);
+    }
+
+    fate_stats_maybe_dump();
+
+    return failed;
+}
+
+/*
+ * powm_avx for secret exponents (RSA private keys, Paillier lambda): every
+ * batch goes to the multi-buffer engine whatever its fill and whatever the
+ * profile says, the variable-time shared-exponent kernel is never used,
+ * lanes the engine rejects are recomputed with mpz_powm_sec, and the result
+ * cache is not consulted. Runs on the calling thread.
+ */
+int powm_avx_secret(fate_bignum* res, fate_bignum* b, fate_bignum* e, fate_bignum* m, int num, int* status = NULL)
+{
+    assert(res->ismalloc == 1);
+    assert(b->ismalloc == 1);
+    assert(e->ismalloc == 1);
+    assert(m->ismalloc == 1);
+
+    assert(res->num == b->num);
+    assert(e->num == b->num);
+    assert(m->num == b->num);
+
+    const int buf = FATE_MB_LANES;
+
+    g_fate_stats.ops.fetch_add(num, memory_order_relaxed);
+
+    fate_mb_workspace ws;
+    fate_ws_init(&ws, -1);
+    int laneStatus[buf];
+    int failed = 0;
+    for (int i = 0; i < num; i += buf)
+    {
+        int lanes = num - i < buf ? num - i : buf;
+        failed += powm_mb_batch(res->bigint + i, b->bigint + i, e->bigint + i, m->bigint + i, lanes,
+                                status ? status + i : laneStatus, &ws, true);
+    }
+    fate_ws_release(&ws);
+
+    fate_stats_maybe_dump();
+
+    return failed;
+}
+
+
+/*================================================ MULTI-EXP / INVERSE ================================================*/
+/*
+ * Kernels around powm_avx for the Paillier and aggregation paths. IPP's
+ * multi-buffer API only exposes complete per-lane exponentiations, so the
+ * shared-squaring multi-exponentiation cannot be spread over its lanes; it
+ * runs on GMP arithmetic where one squaring chain serves all k bases.
+ */
+
+/*! w bits of e starting at bit pos */
+static unsigned long exp_digit(const mpz_t e, mp_bitcnt_t pos, int w)
+{
+    unsigned long d = 0;
+    for (int t = w - 1; t >= 0; t--)
+        d = (d << 1) | (unsigned long)mpz_tstbit(e, pos + t);
+    return d;
+}
+
+static size_t exp_max_bits(mpz_t* e, int k)
+{
+    size_t bits = 0;
+    for (int i = 0; i < k; i++)
+        if (mpz_sgn(e[i]) > 0 && mpz_sizeinbase(e[i], 2) > bits)
+            bits = mpz_sizeinbase(e[i], 2);
+    return bits;
+}
+
+/*! Straus: per-base tables of b^0..b^(2^w-1), one shared squaring chain */
+static void multiexp_straus(mpz_t res, mpz_t* b, mpz_t* e, int k, const mpz_t m, int w)
+{
+    const int tsize = 1 << w;
+    size_t windows = (exp_max_bits(e, k) + w - 1) / w;
+
+    mpz_t* table = (mpz_t*)malloc(sizeof(mpz_t) * k * tsize);
+    for (int i = 0; i < k; i++)
+    {
+        mpz_t* t = table + (size_t)i * tsize;
+        mpz_init_set_ui(t[0], 1);
+        mpz_init(t[1]);
+        mpz_mod(t[1], b[i], m);
+        for (int d = 2; d < tsize; d++)
+        {
+            mpz_init(t[d]);
+            mpz_mul(t[d], t[d - 1], t[1]);
+            mpz_mod(t[d], t[d], m);
+        }
+    }
+
+    mpz_set_ui(res, 1);
+    mpz_mod(res, res, m);
+    for (size_t win = windows; win-- > 0;)
+    {
+        if (win + 1 != windows)
+            for (int s = 0; s < w; s++)
+            {
+                mpz_mul(res, res, res);
+                mpz_mod(res, res, m);
+            }
+
+        for (int i = 0; i < k; i++)
+        {
+            unsigned long d = mpz_sgn(e[i]) > 0 ? exp_digit(e[i], win * w, w) : 0;
+            if (d)
+            {
+                mpz_mul(res, res, table[(size_t)i * tsize + d]);
+                mpz_mod(res, res, m);
+            }
+        }
+    }
+
+    for (size_t t = 0; t < (size_t)k * tsize; t++)
+        mpz_clear(table[t]);
+    free(table);
+}
+
+/*! Pippenger: per window, bases are dropped into 2^w-1 buckets, the buckets are folded with a running product */
+static void multiexp_pippenger(mpz_t res, mpz_t* b, mpz_t* e, int k, const mpz_t m, int w)
+{
+    const int nb = (1 << w) - 1;
+    size_t windows = (exp_max_bits(e, k) + w - 1) / w;
+
+    mpz_t* base = (mpz_t*)malloc(sizeof(mpz_t) * k);
+    for (int i = 0; i < k; i++)
+    {
+        mpz_init(base[i]);
+        mpz_mod(base[i], b[i], m);
+    }
+
+    mpz_t* bucket = (mpz_t*)malloc(sizeof(mpz_t) * (nb + 1));
+    bool* used = (bool*)malloc(sizeof(bool) * (nb + 1));
+    for (int d = 0; d <= nb; d++)
+        mpz_init(bucket[d]);
+
+    mpz_t acc, sum;
+    mpz_init(acc);
+    mpz_init(sum);
+
+    mpz_set_ui(res, 1);
+    mpz_mod(res, res, m);
+    for (size_t win = windows; win-- > 0;)
+    {
+        if (win + 1 != windows)
+            for (int s = 0; s < w; s++)
+            {
+                mpz_mul(res, res, res);
+                mpz_mod(res, res, m);
+            }
+
+        memset(used, 0, sizeof(bool) * (nb + 1));
+        for (int i = 0; i < k; i++)
+        {
+            unsigned long d = mpz_sgn(e[i]) > 0 ? exp_digit(e[i], win * w, w) : 0;
+            if (d == 0)
+                continue;
+            if (!used[d])
+                mpz_set(bucket[d], base[i]);
+            else
+            {
+                mpz_mul(bucket[d], bucket[d], base[i]);
+                mpz_mod(bucket[d], bucket[d], m);
+            }
+            used[d] = true;
+        }
+
+        /* prod_d bucket[d]^d = prod_d (prod_{j>=d} bucket[j]) */
+        bool accSet = false, sumSet = false;
+        for (int d = nb; d >= 1; d--)
+        {
+            if (used[d])
+            {
+                if (accSet)
+                {
+                    mpz_mul(acc, acc, bucket[d]);
+                    mpz_mod(acc, acc, m);
+                }
+                else
+                    mpz_set(acc, bucket[d]);
+                accSet = true;
+            }
+            if (!accSet)
+                continue;
+            if (sumSet)
+            {
+                mpz_mul(sum, sum, acc);
+                mpz_mod(sum, sum, m);
+            }
+            else
+                mpz_set(sum, acc);
+            sumSet = true;
+        }
+        if (sumSet)
+        {
+            mpz_mul(res, res, sum);
+            mpz_mod(res, res, m);
+        }
+    }
+
+    for (int d = 0; d <= nb; d++)
+        mpz_clear(bucket[d]);
+    for (int i = 0; i < k; i++)
+        mpz_clear(base[i]);
+    mpz_clear(acc);
+    mpz_clear(sum);
+    free(bucket);
+    free(used);
+    free(base);
+}
+
+/*
+ * res = prod_i b[i]^e[i] mod m, i < k, with one shared squaring chain.
+ * Exponents must be non-negative. Straus or Pippenger and the window width
+ * are picked by counting modular multiplications of each variant.
+ */
+int multiexp(mpz_t res, mpz_t* b, mpz_t* e, int k, const mpz_t m)
+{
+    if (mpz_sgn(m) == 0)
+        return FATE_STS_ERR;
+    for (int i = 0; i < k; i++)
+        if (mpz_sgn(e[i]) < 0)
+            return FATE_STS_ERR;
+
+    double bits = (double)exp_max_bits(e, k);
+    double best = -1;
+    int bestW = 1;
+    bool pippenger = false;
+    for (int w = 1; w <= 16; w++)
+    {
+        double windows = ceil(bits / w);
+        double straus = (double)k * (1 << w) + windows * k;
+        double buckets = windows * (k + (double)(2 << w));
+        if (w <= 8 && (best < 0 || straus < best))
+        {
+            best = straus;
+            bestW = w;
+            pippenger = false;
+        }
+        if (buckets < best)
+        {
+            best = buckets;
+            bestW = w;
+            pippenger = true;
+        }
+    }
+
+    if (pippenger)
+        multiexp_pippenger(res, b, e, k, m, bestW);
+    else
+        multiexp_straus(res, b, e, k, m, bestW);
+    return FATE_STS_OK;
+}
+
+/*! rows independent products: res[r] = prod_i b[r*k+i]^e[r*k+i] mod m[r] */
+int multiexp_batch(fate_bignum* res, fate_bignum* b, fate_bignum* e, fate_bignum* m, int rows, int k, int* status)
+{
+    assert(b->num >= rows * k && e->num >= rows * k);
+    assert(res->num >= rows && m->num >= rows);
+
+    int failed = 0;
+    for (int r = 0; r < rows; r++)
+    {
+        int st = multiexp(res->bigint[r], b->bigint + (size_t)r * k, e->bigint + (size_t)r * k, k, m->bigint[r]);
+        if (status)
+            status[r] = st;
+        if (st == FATE_STS_ERR)
+            failed++;
+    }
+    return failed;
+}
+
+/*
+ * res[i] = a[i]^-1 mod m for a shared modulus, Montgomery's trick: one
+ * mpz_invert of the product of all elements plus 3 multiplications per
+ * element. Elements that are not invertible get FATE_STS_ERR.
+ * res may alias a. Returns the number of elements without an inverse.
+ */
+int modinv_batch(fate_bignum* res, fate_bignum* a, const mpz_t m, int num, int* status)
+{
+    assert(res->num >= num && a->num >= num);
+
+    if (mpz_sgn(m) == 0)
+    {
+        for (int i = 0; status && i < num; i++)
+            status[i] = FATE_STS_ERR;
+        return num;
+    }
+
+    mpz_t* red = (mpz_t*)malloc(sizeof(mpz_t) * num);
+    mpz_t* pre = (mpz_t*)malloc(sizeof(mpz_t) * num);
+    bool* ok = (bool*)malloc(sizeof(bool) * num);
+
+    mpz_t acc, inv, tmp;
+    mpz_init_set_ui(acc, 1);
+    mpz_init(inv);
+    mpz_init(tmp);
+
+    /* prefix products, zero residues are left out of the chain */
+    for (int i = 0; i < num; i++)
+    {
+        mpz_init(red[i]);
+        mpz_init(pre[i]);
+        mpz_mod(red[i], a->bigint[i], m);
+        ok[i] = mpz_sgn(red[i]) != 0;
+        if (!ok[i])
+            continue;
+        mpz_set(pre[i], acc);
+        mpz_mul(acc, acc, red[i]);
+        mpz_mod(acc, acc, m);
+    }
+
+    int failed = 0;
+    if (mpz_invert(inv, acc, m))
+    {
+        for (int i = num - 1; i >= 0; i--)
+        {
+            if (!ok[i])
+                continue;
+            mpz_mul(tmp, inv, pre[i]);
+            mpz_mul(inv, inv, red[i]);
+            mpz_mod(inv, inv, m);
+            mpz_mod(res->bigint[i], tmp, m);
+        }
+    }
+    else
+    {
+        /* some element shares a factor with m: find it the slow way */
+        for (int i = 0; i < num; i++)
+            if (ok[i])
+                ok[i] = mpz_invert(res->bigint[i], red[i], m) != 0;
+    }
+
+    for (int i = 0; i < num; i++)
+    {
+        if (!ok[i])
+            failed++;
+        if (status)
+            status[i] = ok[i] ? FATE_STS_OK : FATE_STS_ERR;
+        mpz_clear(red[i]);
+        mpz_clear(pre[i]);
+    }
+
+    mpz_clear(acc);
+    mpz_clear(inv);
+    mpz_clear(tmp);
+    free(red);
+    free(pre);
+    free(ok);
+
+    return failed;
+}
+
+/*! Paillier L function, res[i] = (u[i] - 1) / n, u[i] = 1 mod n */
+void lfunc_batch(fate_bignum* res, fate_bignum* u, const mpz_t n, int num)
+{
+    assert(res->num >= num && u->num >= num);
+
+    for (int i = 0; i < num; i++)
+    {
+        mpz_sub_ui(res->bigint[i], u->bigint[i], 1);
+        mpz_divexact(res->bigint[i], res->bigint[i], n);
+    }
+}
+
+/*================================================ MONTGOMERY ================================================*/
+/*
+ * Montgomery-domain persistence for chained operations on one odd modulus.
+ * A fate_bignum with ismont set holds x * R mod m, R = 2^(64 * limbs), so a
+ * chain of multiplications costs one REDC each instead of a full division,
+ * and the conversions are paid once at the ends of the chain through
+ * fate_to_mont / fate_from_mont. IPP's multi-buffer call keeps its own
+ * Montgomery state internally, so powm_avx_mont converts copies at that
+ * boundary; small batches stay in the domain through fate_mont_powm.
+ */
+
+typedef struct
+{
+    int limbs;
+    mp_limb_t* m;     // modulus, `limbs` limbs
+    mp_limb_t* r2;    // R^2 mod m
+    mp_limb_t* one;   // R mod m, the Montgomery form of 1
+    mp_limb_t n0inv;  // -m^-1 mod 2^64
+    mpz_t mz;         // modulus as mpz_t
+} fate_mont_ctx;
+
+static void mpz_to_limbs(mp_limb_t* out, const mpz_t x, int limbs)
+{
+    size_t n = mpz_size(x);
+    assert(n <= (size_t)limbs);
+    if (n)
+        mpn_copyi(out, mpz_limbs_read(x), n);
+    if ((size_t)limbs > n)
+        mpn_zero(out + n, limbs - n);
+}
+
+static void limbs_to_mpz(mpz_t x, const mp_limb_t* in, int limbs)
+{
+    mp_limb_t* d = mpz_limbs_write(x, limbs);
+    mpn_copyi(d, in, limbs);
+    mpz_limbs_finish(x, limbs);
+}
+
+/*! r = t * R^-1 mod m; t has 2 * limbs limbs and is destroyed */
+static void mont_redc(mp_limb_t* r, mp_limb_t* t, const fate_mont_ctx* ctx)
+{
+    const int n = ctx->limbs;
+    /* t[i] is zero after its row, park the row carry there and add all carries at once */
+    for (int i = 0; i < n; i++)
+    {
+        mp_limb_t q = t[i] * ctx->n0inv;
+        t[i] = mpn_addmul_1(t + i, ctx->m, n, q);
+    }
+    mp_limb_t carry = mpn_add_n(t + n, t + n, t, n);
+
+    if (carry || mpn_cmp(t + n, ctx->m, n) >= 0)
+        mpn_sub_n(r, t + n, ctx->m, n);
+    else
+        mpn_copyi(r, t + n, n);
+}
+
+/*! r = a * b * R^-1 mod m, t is 2 * limbs limbs of scratch, r may alias a or b */
+static void mont_mul(mp_limb_t* r, const mp_limb_t* a, const mp_limb_t* b, mp_limb_t* t, const fate_mont_ctx* ctx)
+{
+    if (a == b)
+        mpn_sqr(t, a, ctx->limbs);
+    else
+        mpn_mul_n(t, a, b, ctx->limbs);
+    mont_redc(r, t, ctx);
+}
+
+/*! Returns false when m is even or zero */
+bool fate_mont_init(fate_mont_ctx* ctx, const mpz_t m)
+{
+    if (mpz_sgn(m) <= 0 || mpz_even_p(m))
+        return false;
+
+    int n = (int)mpz_size(m);
+    ctx->limbs = n;
+    ctx->m = (mp_limb_t*)malloc(sizeof(mp_limb_t) * n * 3);
+    ctx->r2 = ctx->m + n;
+    ctx->one = ctx->m + 2 * n;
+    mpz_init_set(ctx->mz, m);
+    mpz_to_limbs(ctx->m, m, n);
+
+    /* Newton iteration for m0^-1 mod 2^64, each step doubles the correct bits */
+    mp_limb_t inv = ctx->m[0];
+    for (int i = 0; i < 6; i++)
+        inv *= 2 - ctx->m[0] * inv;
+    ctx->n0inv = -inv;
+
+    mpz_t t;
+    mpz_init(t);
+    mpz_setbit(t, 64 * n);
+    mpz_mod(t, t, m);
+    mpz_to_limbs(ctx->one, t, n);
+    mpz_set_ui(t, 0);
+    mpz_setbit(t, 128 * n);
+    mpz_mod(t, t, m);
+    mpz_to_limbs(ctx->r2, t, n);
+    mpz_clear(t);
+
+    return true;
+}
+
+void fate_mont_clear(fate_mont_ctx* ctx)
+{
+    free(ctx->m);
+    mpz_clear(ctx->mz);
+}
+
+/*! x[i] -> x[i] * R mod m in place, i < num */
+void fate_to_mont(fate_bignum* x, const fate_mont_ctx* ctx, int num)
+{
+    if (x->ismont)
+        return;
+
+    const int n = ctx->limbs;
+    vector<mp_limb_t> a(n), t(2 * n);
+    for (int i = 0; i < num; i++)
+    {
+        mpz_mod(x->bigint[i], x->bigint[i], ctx->mz);
+        mpz_to_limbs(a.data(), x->bigint[i], n);
+        mont_mul(a.data(), a.data(), ctx->r2, t.data(), ctx);
+        limbs_to_mpz(x->bigint[i], a.data(), n);
+    }
+    x->ismont = 1;
+}
+
+/*! x[i] * R mod m -> x[i] in place, i < num */
+void fate_from_mont(fate_bignum* x, const fate_mont_ctx* ctx, int num)
+{
+    if (!x->ismont)
+        return;
+
+    const int n = ctx->limbs;
+    vector<mp_limb_t> a(n), t(2 * n);
+    for (int i = 0; i < num; i++)
+    {
+        mpz_to_limbs(t.data(), x->bigint[i], n);
+        mpn_zero(t.data() + n, n);
+        mont_redc(a.data(), t.data(), ctx);
+        limbs_to_mpz(x->bigint[i], a.data(), n);
+    }
+    x->ismont = 0;
+}
+
+/*! res[i] = a[i] * b[i] in the Montgomery domain, one REDC per element */
+void fate_mont_mul_batch(fate_bignum* res, fate_bignum* a, fate_bignum* b, const fate_mont_ctx* ctx, int num)
+{
+    assert(a->ismont && b->ismont);
+
+    const int n = ctx->limbs;
+    vector<mp_limb_t> x(n), y(n), t(2 * n);
+    for (int i = 0; i < num; i++)
+    {
+        mpz_to_limbs(x.data(), a->bigint[i], n);
+        mpz_to_limbs(y.data(), b->bigint[i], n);
+        mont_mul(x.data(), x.data(), y.data(), t.data(), ctx);
+        limbs_to_mpz(res->bigint[i], x.data(), n);
+    }
+    res->ismont = 1;
+}
+
+/*! r = base^e in the Montgomery domain (base and r in Montgomery form), fixed 4-bit windows */
+void fate_mont_powm(mp_limb_t* r, const mp_limb_t* base, const mpz_t e, const fate_mont_ctx* ctx)
+{
+    const int n = ctx->limbs;
+    const int w = 4;
+    vector<mp_limb_t> table((size_t)n << w), t(2 * n), acc(n);
+
+    mpn_copyi(&table[0], ctx->one, n);
+    mpn_copyi(&table[n], base, n);
+    for (int d = 2; d < (1 << w); d++)
+        mont_mul(&table[(size_t)d * n], &table[(size_t)(d - 1) * n], base, t.data(), ctx);
+
+    mpn_copyi(acc.data(), ctx->one, n);
+    size_t windows = mpz_sgn(e) > 0 ? (mpz_sizeinbase(e, 2) + w - 1) / w : 0;
+    for (size_t win = windows; win-- > 0;)
+    {
+        for (int s = 0; s < w && win + 1 != windows; s++)
+            mont_mul(acc.data(), acc.data(), acc.data(), t.data(), ctx);
+
+        unsigned long d = exp_digit(e, win * w, w);
+        if (d)
+            mont_mul(acc.data(), acc.data(), &table[(size_t)d * n], t.data(), ctx);
+    }
+    mpn_copyi(r, acc.data(), n);
+}
+
+/*
+ * res[i] = b[i]^e[i] mod m for the modulus of ctx. b may be in either domain
+ * and is not modified; res is left in the Montgomery domain when mont_out is
+ * set. Batches of at least one full multi-buffer call go through powm_avx,
+ * which keeps its own representation: a Montgomery b costs one REDC per
+ * element into a scratch copy and mont_out one multiplication per result, so
+ * there the domain saves nothing. It saves the conversions below a full
+ * batch, where the elements stay in the domain on fate_mont_powm, and between
+ * fate_mont_mul_batch steps. res may alias b.
+ */
+int powm_avx_mont(fate_bignum* res, fate_bignum* b, fate_bignum* e, const fate_mont_ctx* ctx, int num,
+                  int* status, bool mont_out)
+{
+    const int n = ctx->limbs;
+    int failed = 0;
+
+    if (num < FATE_MB_LANES && b->ismont)
+    {
+        vector<mp_limb_t> x(n), t(2 * n);
+        for (int i = 0; i < num; i++)
+        {
+            int st = mpz_sgn(e->bigint[i]) < 0 ? FATE_STS_ERR : FATE_STS_OK;
+            if (st == FATE_STS_OK)
+            {
+                mpz_to_limbs(x.data(), b->bigint[i], n);
+                fate_mont_powm(x.data(), x.data(), e->bigint[i], ctx);
+                if (!mont_out)
+                {
+                    mpn_copyi(t.data(), x.data(), n);
+                    mpn_zero(t.data() + n, n);
+                    mont_redc(x.data(), t.data(), ctx);
+                }
+                limbs_to_mpz(res->bigint[i], x.data(), n);
+            }
+            else
+                failed++;
+            if (status)
+                status[i] = st;
+        }
+        res->ismont = mont_out;
+        g_fate_stats.ops.fetch_add(num, memory_order_relaxed);
+        return failed;
+    }
+
+    fate_bignum m, plain;
+    m.bigint = (mpz_t*)malloc(sizeof(mpz_t) * num);
+    m.num = num;
+    m.ismalloc = 1;
+    m.ismont = 0;
+    for (int i = 0; i < num; i++)
+        mpz_init_set(m.bigint[i], ctx->mz);
+
+    /* the caller's b stays as it is, other threads may be reading it */
+    fate_bignum* base = b;
+    if (b->ismont)
+    {
+        plain.bigint = (mpz_t*)malloc(sizeof(mpz_t) * num);
+        plain.num = num;
+        plain.ismalloc = 1;
+        plain.ismont = 1;
+        for (int i = 0; i < num; i++)
+            mpz_init_set(plain.bigint[i], b->bigint[i]);
+        fate_from_mont(&plain, ctx, num);
+        base = &plain;
+    }
+
+    res->ismont = 0;
+    failed = powm_avx(res, base, e, &m, num, status);
+    if (mont_out)
+        fate_to_mont(res, ctx, num);
+
+    if (base == &plain)
+    {
+        for (int i = 0; i < num; i++)
+            mpz_clear(plain.bigint[i]);
+        free(plain.bigint);
+    }
+    for (int i = 0; i < num; i++)
+        mpz_clear(m.bigint[i]);
+    free(m.bigint);
+
+    return failed;
+}
+
+/*================================================ SHARED EXPONENT ================================================*/
+/*
+ * When every lane of a batch raises to the same exponent (RSA and Paillier
+ * decryption, the example's main), the sliding-window recoding is done once
+ * and the lanes walk the same square/multiply schedule in lockstep, each on
+ * its own table of odd powers, with no per-lane exponent scanning. Lanes
+ * sharing a modulus share one Montgomery context.
+ */
+
+typedef struct
+{
+    int w;      // window width, the tables hold b^1, b^3, ..., b^(2^w - 1)
+    int first;  // leading digit
+    int steps;  // multiplications after the leading digit
+    int* sq;    // sq[k]: squarings before multiplication k
+    int* dig;   // dig[k]: odd digit of multiplication k
+    int tail;   // squarings after the last multiplication
+} fate_exp_recoding;
+
+/*! Left-to-right sliding-window recoding of e > 0 */
+static void fate_recode(fate_exp_recoding* rc, const mpz_t e)
+{
+    long bits = (long)mpz_sizeinbase(e, 2);
+    rc->w = bits > 1536 ? 6 : bits > 384 ? 5 : bits > 96 ? 4 : bits > 24 ? 3 : 1;
+    rc->sq = (int*)malloc(sizeof(int) * 2 * bits);
+    rc->dig = rc->sq + bits;
+    rc->first = 0;
+    rc->steps = 0;
+
+    int pending = 0;
+    for (long i = bits - 1; i >= 0;)
+    {
+        if (!mpz_tstbit(e, i))
+        {
+            pending++;
+            i--;
+            continue;
+        }
+
+        long j = i - rc->w + 1 < 0 ? 0 : i - rc->w + 1;
+        while (!mpz_tstbit(e, j))
+            j++;
+        int d = 0;
+        for (long k = i; k >= j; k--)
+            d = (d << 1) | mpz_tstbit(e, k);
+
+        if (rc->first == 0)
+            rc->first = d;
+        else
+        {
+            rc->sq[rc->steps] = pending + (int)(i - j + 1);
+            rc->dig[rc->steps++] = d;
+        }
+        pending = 0;
+        i = j - 1;
+    }
+    rc->tail = pending;
+}
+
+static void fate_recoding_clear(fate_exp_recoding* rc)
+{
+    free(rc->sq);
+}
+
+/*
+ * res[j] = b[j]^e mod m[j] for up to 8 lanes, rc the recoding of e (NULL
+ * when e <= 0). Even moduli go to mpz_powm.
+ */
+static int powm_shared_lanes(mpz_t* res, mpz_t* b, const mpz_t e, mpz_t* m, int lanes, int* status,
+                             const fate_exp_recoding* rc)
+{
+    const int buf = FATE_MB_LANES;
+    assert(lanes > 0 && lanes <= buf);
+
+    fate_mont_ctx ctx[buf];
+    int ctxOf[buf];
+    int nctx = 0;
+    int failed = 0;
+    int maxLimbs = 0;
+
+    for (int j = 0; j < lanes; j++)
+    {
+        ctxOf[j] = -1;
+        if (mpz_sgn(m[j]) == 0 || mpz_sgn(e) < 0)
+            status[j] = FATE_STS_ERR;
+        else if (mpz_sgn(e) == 0)
+        {
+            mpz_set_ui(res[j], 1);
+            mpz_mod(res[j], res[j], m[j]);
+            status[j] = FATE_STS_OK;
+        }
+        else if (mpz_sgn(m[j]) < 0 || mpz_even_p(m[j]))
+            status[j] = powm_gmp_direct(res[j], b[j], (mpz_ptr)e, m[j]);
+        else
+        {
+            for (int k = 0; k < nctx && ctxOf[j] < 0; k++)
+                if (mpz_cmp(ctx[k].mz, m[j]) == 0)
+                    ctxOf[j] = k;
+            if (ctxOf[j] < 0)
+            {
+                fate_mont_init(&ctx[nctx], m[j]);
+                if (ctx[nctx].limbs > maxLimbs)
+                    maxLimbs = ctx[nctx].limbs;
+                ctxOf[j] = nctx++;
+            }
+            status[j] = FATE_STS_OK;
+        }
+        if (status[j] == FATE_STS_ERR)
+            failed++;
+    }
+
+    if (nctx == 0)
+        return failed;
+
+    /* lane j: odd powers at table[j * stride], accumulator at acc[j * maxLimbs] */
+    const size_t stride = (size_t)maxLimbs << (rc->w - 1);
+    vector<mp_limb_t> table(stride * lanes), acc((size_t)maxLimbs * lanes), sq(maxLimbs), t(2 * maxLimbs);
+    mpz_t x;
+    mpz_init(x);
+    for (int j = 0; j < lanes; j++)
+    {
+        if (ctxOf[j] < 0)
+            continue;
+        const fate_mont_ctx* c = &ctx[ctxOf[j]];
+        mp_limb_t* tab = &table[j * stride];
+        mpz_mod(x, b[j], c->mz);
+        mpz_to_limbs(tab, x, c->limbs);
+        mont_mul(tab, tab, c->r2, t.data(), c);
+        mont_mul(sq.data(), tab, tab, t.data(), c);
+        for (int d = 1; d < (1 << (rc->w - 1)); d++)
+            mont_mul(tab + (size_t)d * c->limbs, tab + (size_t)(d - 1) * c->limbs, sq.data(), t.data(), c);
+        mpn_copyi(&acc[(size_t)j * maxLimbs], tab + (size_t)(rc->first >> 1) * c->limbs, c->limbs);
+    }
+
+    for (int k = 0; k <= rc->steps; k++)
+    {
+        int squarings = k < rc->steps ? rc->sq[k] : rc->tail;
+        for (int s = 0; s < squarings; s++)
+            for (int j = 0; j < lanes; j++)
+            {
+                if (ctxOf[j] < 0)
+                    continue;
+                mp_limb_t* a = &acc[(size_t)j * maxLimbs];
+                mont_mul(a, a, a, t.data(), &ctx[ctxOf[j]]);
+            }
+
+        if (k == rc->steps)
+            break;
+        for (int j = 0; j < lanes; j++)
+        {
+            if (ctxOf[j] < 0)
+                continue;
+            const fate_mont_ctx* c = &ctx[ctxOf[j]];
+            mp_limb_t* a = &acc[(size_t)j * maxLimbs];
+            mont_mul(a, a, &table[j * stride + (size_t)(rc->dig[k] >> 1) * c->limbs], t.data(), c);
+        }
+    }
+
+    for (int j = 0; j < lanes; j++)
+    {
+        if (ctxOf[j] < 0)
+            continue;
+        const fate_mont_ctx* c = &ctx[ctxOf[j]];
+        mpn_copyi(t.data(), &acc[(size_t)j * maxLimbs], c->limbs);
+        mpn_zero(t.data() + c->limbs, c->limbs);
+        mont_redc(sq.data(), t.data(), c);
+        limbs_to_mpz(res[j], sq.data(), c->limbs);
+    }
+
+    mpz_clear(x);
+    for (int k = 0; k < nctx; k++)
+        fate_mont_clear(&ctx[k]);
+
+    return failed;
+}
+
+static bool fate_lanes_share_exponent(mpz_t* e, int lanes)
+{
+    for (int j = 1; j < lanes; j++)
+        if (mpz_cmp(e[j], e[0]) != 0)
+            return false;
+    return true;
+}
+
+/*! One batch whose lanes all use e[0] */
+static int powm_shared_batch(mpz_t* res, mpz_t* b, mpz_t* e, mpz_t* m, int lanes, int* status)
+{
+    if (mpz_sgn(e[0]) <= 0)
+        return powm_shared_lanes(res, b, e[0], m, lanes, status, NULL);
+
+    fate_exp_recoding rc;
+    fate_recode(&rc, e[0]);
+    int failed = powm_shared_lanes(res, b, e[0], m, lanes, status, &rc);
+    fate_recoding_clear(&rc);
+
+    return failed;
+}
+
+/*
+ * res[i] = b[i]^e mod m[i], i < num, one exponent for the whole call: it is
+ * recoded once and every group of 8 lanes runs the same schedule.
+ */
+int powm_shared_exp(fate_bignum* res, fate_bignum* b, const mpz_t e, fate_bignum* m, int num, int* status = NULL)
+{
+    assert(res->num >= num && b->num >= num && m->num >= num);
+
+    const int buf = FATE_MB_LANES;
+    fate_exp_recoding rc;
+    bool coded = mpz_sgn(e) > 0;
+    if (coded)
+        fate_recode(&rc, e);
+
+    g_fate_stats.ops.fetch_add(num, memory_order_relaxed);
+
+    int laneStatus[buf];
+    int failed = 0;
+    for (int i = 0; i < num; i += buf)
+    {
+        int lanes = num - i < buf ? num - i : buf;
+        failed += powm_shared_lanes(res->bigint + i, b->bigint + i, e, m->bigint + i, lanes,
+                                    status ? status + i : laneStatus, coded ? &rc : NULL);
+    }
+
+    if (coded)
+        fate_recoding_clear(&rc);
+
+    return failed;
+}
+
+/*================================================ PAILLIER ================================================*/
+/*
+ * Fixed-point encoding compatible with FATE's FixedPointNumber (BASE = 16):
+ * x is stored as round(x * 16^exponent) mod n, negatives wrapping to the top
+ * of Z_n, positives limited to max_int = n / 3 - 1. The automatic exponent is
+ * FATE's floor((53 - frexp(x).exp) / 4), so encodings interoperate with
+ * FATE; it keeps at least 50 of the 53 mantissa bits.
+ */
+
+#define FATE_FXP_BASE_BITS 4
+#define FATE_FXP_MANTISSA_BITS 53
+
+typedef struct
+{
+    mpz_t n;
+    mpz_t nsquare;
+    mpz_t max_int; // n / 3 - 1
+} fate_paillier_pub;
+
+void fate_paillier_pub_init(fate_paillier_pub* pub, const mpz_t n)
+{
+    mpz_init_set(pub->n, n);
+    mpz_init(pub->nsquare);
+    mpz_mul(pub->nsquare, n, n);
+    mpz_init(pub->max_int);
+    mpz_tdiv_q_ui(pub->max_int, n, 3);
+    mpz_sub_ui(pub->max_int, pub->max_int, 1);
+}
+
+void fate_paillier_pub_clear(fate_paillier_pub* pub)
+{
+    mpz_clear(pub->n);
+    mpz_clear(pub->nsquare);
+    mpz_clear(pub->max_int);
+}
+
+/*
+ * Split doubles into integer mantissa and binary exponent, x = mant * 2^bexp,
+ * straight from the IEEE-754 fields; the loop has no calls and vectorizes.
+ * Returns false for NaN/Inf in `ok`.
+ */
+static void fate_split_doubles(const double* x, int num, int64_t* mant, int* bexp, bool* ok)
+{
+    for (int i = 0; i < num; i++)
+    {
+        uint64_t bits;
+        memcpy(&bits, &x[i], sizeof(bits));
+        int64_t field = (int64_t)((bits >> 52) & 0x7ff);
+        int64_t frac = (int64_t)(bits & 0xfffffffffffffull);
+        int64_t sign = (int64_t)(bits >> 63);
+
+        int64_t m = field ? (frac | (1ll << 52)) : frac;
+        mant[i] = sign ? -m : m;
+        bexp[i] = (int)(field ? field - 1075 : -1074);
+        ok[i] = field != 0x7ff;
+    }
+}
+
+/*
+ * out[i] = encoding of x[i]. With fixed_exponent == FATE_FXP_AUTO_EXPONENT
+ * every element gets its own exponent (written to exponent[i]), otherwise
+ * all share fixed_exponent, which homomorphic additions need.
+ * status[i] (may be NULL) is FATE_STS_ERR for NaN/Inf or |mantissa| > max_int.
+ * Returns the number of failed elements.
+ */
+int fate_encode_batch(fate_bignum* out, int* exponent, const double* x, int num, const fate_paillier_pub* pub,
+                      int fixed_exponent, int* status)
+{
+    assert(out->num >= num);
+    assert(exponent != NULL || fixed_exponent != FATE_FXP_AUTO_EXPONENT);
+
+    vector<int64_t> mant(num);
+    vector<int> bexp(num);
+    bool* ok = (bool*)malloc(sizeof(bool) * (num > 0 ? num : 1));
+    fate_split_doubles(x, num, mant.data(), bexp.data(), ok);
+
+    int failed = 0;
+    for (int i = 0; i < num; i++)
+    {
+        mpz_ptr v = out->bigint[i];
+        int exp = fixed_exponent;
+        if (exp == FATE_FXP_AUTO_EXPONENT)
+        {
+            /* frexp exponent of x is bexp + bit length of the mantissa */
+            int len = 0;
+            for (uint64_t a = (uint64_t)llabs(mant[i]); a; a >>= 1)
+                len++;
+            int fexp = mant[i] ? bexp[i] + len : 0;
+            int lsb = FATE_FXP_MANTISSA_BITS - fexp;
+            exp = lsb >= 0 ? lsb / FATE_FXP_BASE_BITS : -((-lsb + FATE_FXP_BASE_BITS - 1) / FATE_FXP_BASE_BITS);
+        }
+        if (exponent)
+            exponent[i] = exp;
+
+        /* round(mant * 2^(bexp + 4 * exp)), ties away from zero */
+        mpz_set_si(v, mant[i]);
+        long shift = (long)bexp[i] + (long)FATE_FXP_BASE_BITS * exp;
+        if (shift >= 0)
+            mpz_mul_2exp(v, v, shift);
+        else
+        {
+            bool neg = mpz_sgn(v) < 0;
+            mpz_abs(v, v);
+            mpz_tdiv_q_2exp(v, v, -shift - 1);
+            mpz_add_ui(v, v, 1);
+            mpz_tdiv_q_2exp(v, v, 1);
+            if (neg)
+                mpz_neg(v, v);
+        }
+
+        bool good = ok[i] && mpz_cmpabs(v, pub->max_int) <= 0;
+        if (good)
+            mpz_mod(v, v, pub->n);
+        else
+        {
+            mpz_set_ui(v, 0);
+            failed++;
+        }
+        if (status)
+            status[i] = good ? FATE_STS_OK : FATE_STS_ERR;
+    }
+
+    free(ok);
+    return failed;
+}
+
+/*
+ * Inverse of fate_encode_batch: mantissas <= max_int are positive, those
+ * >= n - max_int negative, anything in between is an overflow (NaN, status
+ * FATE_STS_ERR). The mantissa goes through mpz_get_d_2exp, the power-of-two
+ * scaling is applied to the whole vector on the double bit patterns.
+ */
+int fate_decode_batch(double* x, fate_bignum* in, const int* exponent, int fixed_exponent, int num,
+                      const fate_paillier_pub* pub, int* status)
+{
+    assert(in->num >= num);
+
+    vector<double> frac(num);
+    vector<long> scale(num);
+    int failed = 0;
+
+    mpz_t v, lo;
+    mpz_init(v);
+    mpz_init(lo);
+    mpz_sub(lo, pub->n, pub->max_int);
+    for (int i = 0; i < num; i++)
+    {
+        int st = FATE_STS_OK;
+        if (mpz_cmp(in->bigint[i], pub->max_int) <= 0)
+            mpz_set(v, in->bigint[i]);
+        else if (mpz_cmp(in->bigint[i], lo) >= 0 && mpz_cmp(in->bigint[i], pub->n) < 0)
+            mpz_sub(v, in->bigint[i], pub->n);
+        else
+        {
+            st = FATE_STS_ERR;
+            mpz_set_ui(v, 0);
+            failed++;
+        }
+
+        long e2 = 0;
+        frac[i] = st == FATE_STS_OK ? mpz_get_d_2exp(&e2, v) : NAN;
+        int exp = fixed_exponent == FATE_FXP_AUTO_EXPONENT ? exponent[i] : fixed_exponent;
+        scale[i] = e2 - (long)FATE_FXP_BASE_BITS * exp;
+        if (status)
+            status[i] = st;
+    }
+    mpz_clear(v);
+    mpz_clear(lo);
+
+    /* frac in [0.5, 1): adding scale to the biased exponent field is exact while the result stays normal */
+    for (int i = 0; i < num; i++)
+    {
+        uint64_t bits;
+        memcpy(&bits, &frac[i], sizeof(bits));
+        long field = (long)((bits >> 52) & 0x7ff) + scale[i];
+        if (frac[i] != 0.0 && field > 0 && field < 0x7ff)
+        {
+            bits = (bits & ~(0x7ffull << 52)) | ((uint64_t)field << 52);
+            memcpy(&x[i], &bits, sizeof(bits));
+        }
+        else
+            x[i] = frac[i] == 0.0 ? 0.0 : ldexp(frac[i], (int)scale[i]);
+    }
+
+    return failed;
+}
+
+/*
+ * c[i] = (1 + m[i] * n) * r[i]^n mod n^2, g = n + 1. The obfuscators r^n are
+ * the expensive part and go through powm_avx in one batch; with obfuscate
+ * unset r = 1 (deterministic, only for tests and benchmarks).
+ */
+int fate_paillier_encrypt_batch(fate_bignum* c, fate_bignum* m, int num, const fate_paillier_pub* pub, bool obfuscate,
+                                int* status)
+{
+    assert(c->num >= num && m->num >= num);
+
+    int failed = 0;
+    fate_bignum r, e, mod;
+    fate_bignum* fb[3] = { &r, &e, &mod };
+    for (int k = 0; k < 3 && obfuscate; k++)
+    {
+        fb[k]->bigint = (mpz_t*)malloc(sizeof(mpz_t) * (num > 0 ? num : 1));
+        fb[k]->num = num;
+        fb[k]->ismalloc = 1;
+        for (int i = 0; i < num; i++)
+            mpz_init(fb[k]->bigint[i]);
+    }
+
+    if (obfuscate && num > 0)
+    {
+        fate_rand_below(&r, pub->n, num);
+        for (int i = 0; i < num; i++)
+        {
+            if (mpz_sgn(r.bigint[i]) == 0)
+                mpz_set_ui(r.bigint[i], 1);
+            mpz_set(e.bigint[i], pub->n);
+            mpz_set(mod.bigint[i], pub->nsquare);
+        }
+        /* r^n mod n^2, in place; random obfuscators stay out of the cache */
+        fate_cache_bypass bypass;
+        failed = powm_avx(&r, &r, &e, &mod, num, status);
+    }
+
+    for (int i = 0; i < num; i++)
+    {
+        mpz_ptr ci = c->bigint[i];
+        mpz_mul(ci, m->bigint[i], pub->n);
+        mpz_add_ui(ci, ci, 1);
+        mpz_mod(ci, ci, pub->nsquare);
+        if (obfuscate)
+        {
+            mpz_mul(ci, ci, r.bigint[i]);
+            mpz_mod(ci, ci, pub->nsquare);
+        }
+        else if (status)
+            status[i] = FATE_STS_OK;
+    }
+
+    for (int k = 0; k < 3 && obfuscate; k++)
+    {
+        for (int i = 0; i < num; i++)
+            mpz_clear(fb[k]->bigint[i]);
+        free(fb[k]->bigint);
+    }
+
+    return failed;
+}
+
+/*! Encode and encrypt a double tensor in one call */
+int fate_paillier_encrypt_f64(fate_bignum* c, int* exponent, const double* x, int num, const fate_paillier_pub* pub,
+                              int fixed_exponent, int* status)
+{
+    vector<int> codeStatus(num), encStatus(num);
+    fate_encode_batch(c, exponent, x, num, pub, fixed_exponent, codeStatus.data());
+    fate_paillier_encrypt_batch(c, c, num, pub, true, encStatus.data());
+
+    /* an element failing both steps is still one failed element */
+    int failed = 0;
+    for (int i = 0; i < num; i++)
+    {
+        bool bad = codeStatus[i] == FATE_STS_ERR || encStatus[i] == FATE_STS_ERR;
+        failed += bad;
+        if (status)
+            status[i] = bad ? FATE_STS_ERR : codeStatus[i];
+    }
+
+    return failed;
+}
+
+/*! float flavour, each value widened to double exactly */
+int fate_paillier_encrypt_f32(fate_bignum* c, int* exponent, const float* x, int num, const fate_paillier_pub* pub,
+                              int fixed_exponent, int* status)
+{
+    vector<double> wide(x, x + num);
+    return fate_paillier_encrypt_f64(c, exponent, wide.data(), num, pub, fixed_exponent, status);
+}
+
+/*! Paillier private key, lambda = lcm(p - 1, q - 1), mu = lambda^-1 mod n (g = n + 1) */
+typedef struct
+{
+    mpz_t lambda;
+    mpz_t mu;
+} fate_paillier_priv;
+
+bool fate_paillier_priv_init(fate_paillier_priv* priv, const fate_paillier_pub* pub, const mpz_t p, const mpz_t q)
+{
+    mpz_t p1, q1;
+    mpz_init(p1);
+    mpz_init(q1);
+    mpz_sub_ui(p1, p, 1);
+    mpz_sub_ui(q1, q, 1);
+    mpz_init(priv->lambda);
+    mpz_init(priv->mu);
+    mpz_lcm(priv->lambda, p1, q1);
+    bool ok = mpz_invert(priv->mu, priv->lambda, pub->n) != 0;
+    mpz_clear(p1);
+    mpz_clear(q1);
+
+    return ok;
+}
+
+void fate_paillier_priv_clear(fate_paillier_priv* priv)
+{
+    mpz_clear(priv->lambda);
+    mpz_clear(priv->mu);
+}
+
+/*! m[i] = L(c[i]^lambda mod n^2) * mu mod n; the c^lambda share one exponent and run through powm_avx */
+int fate_paillier_decrypt_batch(fate_bignum* m, fate_bignum* c, int num, const fate_paillier_pub* pub,
+                                const fate_paillier_priv* priv, int* status)
+{
+    assert(m->num >= num && c->num >= num);
+
+    fate_bignum e, mod;
+    fate_bignum* fb[2] = { &e, &mod };
+    for (int k = 0; k < 2; k++)
+    {
+        fb[k]->bigint = (mpz_t*)malloc(sizeof(mpz_t) * (num > 0 ? num : 1));
+        fb[k]->num = num;
+        fb[k]->ismalloc = 1;
+    }
+    for (int i = 0; i < num; i++)
+    {
+        mpz_init_set(e.bigint[i], priv->lambda);
+        mpz_init_set(mod.bigint[i], pub->nsquare);
+    }
+
+    /* views of the first num elements, powm_avx wants equal lengths */
+    fate_bignum cv = *c, mv = *m;
+    cv.num = mv.num = num;
+    int failed = powm_avx_secret(&mv, &cv, &e, &mod, num, status); // lambda is secret
+    lfunc_batch(m, m, pub->n, num);
+    for (int i = 0; i < num; i++)
+    {
+        mpz_mul(m->bigint[i], m->bigint[i], priv->mu);
+        mpz_mod(m->bigint[i], m->bigint[i], pub->n);
+    }
+
+    for (int k = 0; k < 2; k++)
+    {
+        for (int i = 0; i < num; i++)
+            mpz_clear(fb[k]->bigint[i]);
+        free(fb[k]->bigint);
+    }
+
+    return failed;
+}
+
+/*================================================ PACKING ================================================*/
+/*
+ * Several fixed-point values per Paillier plaintext. Slot j of a plaintext
+ * holds value + 2^(value_bits - 1) (offset binary, so slots never borrow from
+ * each other) at bit j * slot_bits; the guard bits above each value absorb
+ * the carries of up to 2^guard_bits packed additions. Unpacking removes
+ * terms * 2^(value_bits - 1) from every slot, terms being the number of
+ * packed ciphertexts that were added together.
+ */
+
+typedef struct
+{
+    int value_bits;  // signed mantissa range [-2^(value_bits-1), 2^(value_bits-1)), at most 63
+    int guard_bits;  // room for 2^guard_bits additions
+    int slot_bits;   // value_bits + guard_bits, at most 127
+    int slots;       // values per plaintext
+    int exponent;    // shared fixed-point exponent, value = mantissa / 16^exponent
+} fate_pack_layout;
+
+/*! Returns false when the parameters do not fit the key */
+bool fate_pack_layout_init(fate_pack_layout* layout, const fate_paillier_pub* pub, int value_bits, int guard_bits,
+                           int exponent)
+{
+    if (value_bits < 2 || value_bits > 63 || guard_bits < 0 || value_bits + guard_bits > 127)
+        return false;
+
+    layout->value_bits = value_bits;
+    layout->guard_bits = guard_bits;
+    layout->slot_bits = value_bits + guard_bits;
+    layout->exponent = exponent;
+    /* the packed plaintext must stay below n, one bit of margin */
+    layout->slots = (int)((mpz_sizeinbase(pub->n, 2) - 1) / layout->slot_bits);
+
+    return layout->slots > 0;
+}
+
+static void pack_put(uint64_t* limbs, size_t bit, unsigned __int128 v)
+{
+    size_t k = bit / 64, s = bit % 64;
+    limbs[k] |= (uint64_t)(v << s);
+    if (s)
+        v >>= 64 - s;
+    else
+        v >>= 64;
+    limbs[k + 1] |= (uint64_t)v;
+    limbs[k + 2] |= (uint64_t)(v >> 64);
+}
+
+static unsigned __int128 pack_get(const uint64_t* limbs, size_t bit, int width)
+{
+    size_t k = bit / 64, s = bit % 64;
+    unsigned __int128 lo = ((unsigned __int128)limbs[k + 1] << 64) | limbs[k];
+    unsigned __int128 v = lo >> s;
+    if (s)
+        v |= (unsigned __int128)limbs[k + 2] << (128 - s);
+    return width >= 128 ? v : v & (((unsigned __int128)1 << width) - 1);
+}
+
+/*
+ * Encode x[0..num) into ceil(num / slots) packed plaintexts and encrypt them
+ * through the batched engine. status[i] (may be NULL) is per value:
+ * FATE_STS_ERR for NaN/Inf or a mantissa outside value_bits.
+ * Returns the number of ciphertexts written, -1 on error.
+ */
+int fate_pack_encrypt(fate_bignum* c, const double* x, int num, const fate_pack_layout* layout,
+                      const fate_paillier_pub* pub, int* status)
+{
+    const int cts = (num + layout->slots - 1) / layout->slots;
+    assert(c->num >= cts);
+
+    const int64_t half = (int64_t)1 << (layout->value_bits - 1);
+    const double scale = ldexp(1.0, FATE_FXP_BASE_BITS * layout->exponent);
+    const int limbs = (int)((mpz_sizeinbase(pub->n, 2) + 63) / 64) + 2;
+
+    vector<uint64_t> plain((size_t)limbs * cts, 0);
+    for (int i = 0; i < num; i++)
+    {
+        double v = x[i] * scale;
+        bool ok = isfinite(v) && v >= -(double)half && v < (double)half;
+        int64_t mant = ok ? llround(v) : 0;
+        ok = ok && mant >= -half && mant < half;
+        if (status)
+            status[i] = ok ? FATE_STS_OK : FATE_STS_ERR;
+
+        unsigned __int128 u = (unsigned __int128)(uint64_t)((ok ? mant : 0) + half);
+        pack_put(&plain[(size_t)(i / layout->slots) * limbs], (size_t)(i % layout->slots) * layout->slot_bits, u);
+    }
+
+    for (int k = 0; k < cts; k++)
+        mpz_import(c->bigint[k], limbs, -1, sizeof(uint64_t), 0, 0, &plain[(size_t)k * limbs]);
+
+    if (fate_paillier_encrypt_batch(c, c, cts, pub, true, NULL) != 0)
+        return -1;
+
+    return cts;
+}
+
+/*! Packed homomorphic addition, res[k] = a[k] * b[k] mod n^2: slot-wise sums of the plaintexts */
+void fate_pack_add(fate_bignum* res, fate_bignum* a, fate_bignum* b, int cts, const fate_paillier_pub* pub)
+{
+    for (int k = 0; k < cts; k++)
+    {
+        mpz_mul(res->bigint[k], a->bigint[k], b->bigint[k]);
+        mpz_mod(res->bigint[k], res->bigint[k], pub->nsquare);
+    }
+}
+
+/*
+ * Decrypt packed ciphertexts and unpack num values; terms is the number of
+ * packed encryptions summed into each ciphertext (1 for a fresh one).
+ * Returns the number of values that could not be recovered.
+ */
+int fate_pack_decrypt(double* x, int num, fate_bignum* c, int terms, const fate_pack_layout* layout,
+                      const fate_paillier_pub* pub, const fate_paillier_priv* priv)
+{
+    const int cts = (num + layout->slots - 1) / layout->slots;
+    assert(c->num >= cts);
+    if (terms < 1 || (layout->guard_bits < 31 && terms > (1 << layout->guard_bits)))
+        return num;
+
+    fate_bignum m;
+    m.bigint = (mpz_t*)malloc(sizeof(mpz_t) * (cts > 0 ? cts : 1));
+    m.num = cts;
+    m.ismalloc = 1;
+    for (int k = 0; k < cts; k++)
+        mpz_init(m.bigint[k]);
+
+    vector<int> st(cts);
+    fate_paillier_decrypt_batch(&m, c, cts, pub, priv, st.data());
+
+    const int limbs = (int)((mpz_sizeinbase(pub->n, 2) + 63) / 64) + 2;
+    const __int128 bias = (__int128)terms << (layout->value_bits - 1);
+    const int shift = -FATE_FXP_BASE_BITS * layout->exponent;
+    vector<uint64_t> plain(limbs);
+    int failed = 0;
+    for (int k = 0; k < cts; k++)
+    {
+        std::fill(plain.begin(), plain.end(), 0);
+        mpz_export(plain.data(), NULL, -1, sizeof(uint64_t), 0, 0, m.bigint[k]);
+        for (int j = 0; j < layout->slots && k * layout->slots + j < num; j++)
+        {
+            int i = k * layout->slots + j;
+            if (st[k] == FATE_STS_ERR)
+            {
+                x[i] = NAN;
+                failed++;
+                continue;
+            }
+            __int128 v = (__int128)pack_get(plain.data(), (size_t)j * layout->slot_bits, layout->slot_bits) - bias;
+            x[i] = ldexp((double)v, shift);
+        }
+        mpz_clear(m.bigint[k]);
+    }
+    free(m.bigint);
+
+    return failed;
+}
+
+/*================================================ SHA-256 ================================================*/
+/*
+ * SHA-256 (FIPS 180-4) for the PKCS#1 paddings. fate_sha256_x8 hashes up
+ * to eight messages at once: with AVX2 every 32-bit lane of a register
+ * carries the same word of a different message and all lanes run the
+ * compression function in lockstep; a lane whose message has no more blocks
+ * keeps its state. Without AVX2 the lanes are hashed one after another.
+ */
+
+#define FATE_SHA256_LEN 32
+
+static const uint32_t fate_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t fate_sha256_iv[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+#define SHA_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static inline uint32_t sha_load_be32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void sha256_compress(uint32_t st[8], const uint8_t* block)
+{
+    uint32_t w[64];
+    for (int t = 0; t < 16; t++)
+        w[t] = sha_load_be32(block + 4 * t);
+    for (int t = 16; t < 64; t++)
+    {
+        uint32_t s0 = SHA_ROTR(w[t - 15], 7) ^ SHA_ROTR(w[t - 15], 18) ^ (w[t - 15] >> 3);
+        uint32_t s1 = SHA_ROTR(w[t - 2], 17) ^ SHA_ROTR(w[t - 2], 19) ^ (w[t - 2] >> 10);
+        w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+    }
+
+    uint32_t a = st[0], b = st[1], c = st[2], d = st[3], e = st[4], f = st[5], g = st[6], h = st[7];
+    for (int t = 0; t < 64; t++)
+    {
+        uint32_t t1 = h + (SHA_ROTR(e, 6) ^ SHA_ROTR(e, 11) ^ SHA_ROTR(e, 25)) + ((e & f) ^ (~e & g)) + fate_sha256_k[t] + w[t];
+        uint32_t t2 = (SHA_ROTR(a, 2) ^ SHA_ROTR(a, 13) ^ SHA_ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    st[0] += a;
+    st[1] += b;
+    st[2] += c;
+    st[3] += d;
+    st[4] += e;
+    st[5] += f;
+    st[6] += g;
+    st[7] += h;
+}
+
+/* message bytes followed by the padding: 0x80, zeros, 64-bit bit length; the last one or two blocks */
+typedef struct
+{
+    const uint8_t* msg;
+    size_t full;        // whole 64-byte blocks taken from msg
+    size_t blocks;      // total blocks
+    uint8_t tail[128];
+} fate_sha_lane;
+
+static void sha_lane_init(fate_sha_lane* l, const uint8_t* msg, size_t len)
+{
+    l->msg = msg;
+    l->full = len / 64;
+    size_t rest = len % 64;
+    size_t tailLen = rest + 9 <= 64 ? 64 : 128;
+    memset(l->tail, 0, tailLen);
+    if (rest)
+        memcpy(l->tail, msg + l->full * 64, rest);
+    l->tail[rest] = 0x80;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; i++)
+        l->tail[tailLen - 1 - i] = (uint8_t)(bits >> (8 * i));
+    l->blocks = l->full + tailLen / 64;
+}
+
+static inline const uint8_t* sha_lane_block(const fate_sha_lane* l, size_t k)
+{
+    return k < l->full ? l->msg + 64 * k : l->tail + 64 * (k - l->full);
+}
+
+static void sha_store_digest(uint8_t* out, const uint32_t st[8])
+{
+    for (int i = 0; i < 8; i++)
+    {
+        out[4 * i] = (uint8_t)(st[i] >> 24);
+        out[4 * i + 1] = (uint8_t)(st[i] >> 16);
+        out[4 * i + 2] = (uint8_t)(st[i] >> 8);
+        out[4 * i + 3] = (uint8_t)st[i];
+    }
+}
+
+void fate_sha256(uint8_t out[FATE_SHA256_LEN], const uint8_t* msg, size_t len)
+{
+    fate_sha_lane l;
+    sha_lane_init(&l, msg, len);
+    uint32_t st[8];
+    memcpy(st, fate_sha256_iv, sizeof(st));
+    for (size_t k = 0; k < l.blocks; k++)
+        sha256_compress(st, sha_lane_block(&l, k));
+    sha_store_digest(out, st);
+}
+
+#ifdef __AVX2__
+static inline __m256i sha_rotr8(__m256i x, int n)
+{
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+/*! One block per lane, lane j reading block[j] */
+static void sha256_compress8(__m256i st[8], const uint8_t* const block[8])
+{
+    const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                           3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    __m256i w[64];
+
+    /* transpose: w[t] lane j = word t of block j */
+    alignas(32) uint32_t col[16][8];
+    for (int j = 0; j < 8; j++)
+    {
+        __m256i lo = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)block[j]), bswap);
+        __m256i hi = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(block[j] + 32)), bswap);
+        alignas(32) uint32_t tmp[16];
+        _mm256_store_si256((__m256i*)tmp, lo);
+        _mm256_store_si256((__m256i*)(tmp + 8), hi);
+        for (int t = 0; t < 16; t++)
+            col[t][j] = tmp[t];
+    }
+    for (int t = 0; t < 16; t++)
+        w[t] = _mm256_load_si256((const __m256i*)col[t]);
+    for (int t = 16; t < 64; t++)
+    {
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(sha_rotr8(w[t - 15], 7), sha_rotr8(w[t - 15], 18)),
+                                      _mm256_srli_epi32(w[t - 15], 3));
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(sha_rotr8(w[t - 2], 17), sha_rotr8(w[t - 2], 19)),
+                                      _mm256_srli_epi32(w[t - 2], 10));
+        w[t] = _mm256_add_epi32(_mm256_add_epi32(w[t - 16], s0), _mm256_add_epi32(w[t - 7], s1));
+    }
+
+    __m256i a = st[0], b = st[1], c = st[2], d = st[3], e = st[4], f = st[5], g = st[6], h = st[7];
+    for (int t = 0; t < 64; t++)
+    {
+        __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(sha_rotr8(e, 6), sha_rotr8(e, 11)), sha_rotr8(e, 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, S1),
+                                      _mm256_add_epi32(_mm256_add_epi32(ch, _mm256_set1_epi32((int)fate_sha256_k[t])), w[t]));
+        __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(sha_rotr8(a, 2), sha_rotr8(a, 13)), sha_rotr8(a, 22));
+        __m256i maj = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)),
+                                       _mm256_and_si256(b, c));
+        __m256i t2 = _mm256_add_epi32(S0, maj);
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(t1, t2);
+    }
+    st[0] = _mm256_add_epi32(st[0], a);
+    st[1] = _mm256_add_epi32(st[1], b);
+    st[2] = _mm256_add_epi32(st[2], c);
+    st[3] = _mm256_add_epi32(st[3], d);
+    st[4] = _mm256_add_epi32(st[4], e);
+    st[5] = _mm256_add_epi32(st[5], f);
+    st[6] = _mm256_add_epi32(st[6], g);
+    st[7] = _mm256_add_epi32(st[7], h);
+}
+#endif
+
+/*! out + 32 * j = SHA-256(msg[j][0..len[j])), j < lanes <= 8 */
+void fate_sha256_x8(uint8_t* out, const uint8_t* const* msg, const size_t* len, int lanes)
+{
+    assert(lanes > 0 && lanes <= 8);
+
+    fate_sha_lane l[8];
+    size_t maxBlocks = 0;
+    for (int j = 0; j < lanes; j++)
+    {
+        sha_lane_init(&l[j], msg[j], len[j]);
+        if (l[j].blocks > maxBlocks)
+            maxBlocks = l[j].blocks;
+    }
+
+#ifdef __AVX2__
+    static const uint8_t idle[64] = { 0 };
+    __m256i st[8];
+    for (int i = 0; i < 8; i++)
+        st[i] = _mm256_set1_epi32((int)fate_sha256_iv[i]);
+
+    for (size_t k = 0; k < maxBlocks; k++)
+    {
+        const uint8_t* block[8];
+        alignas(32) int32_t live[8];
+        for (int j = 0; j < 8; j++)
+        {
+            bool on = j < lanes && k < l[j].blocks;
+            block[j] = on ? sha_lane_block(&l[j], k) : idle;
+            live[j] = on ? -1 : 0;
+        }
+        __m256i keep[8];
+        for (int i = 0; i < 8; i++)
+            keep[i] = st[i];
+        sha256_compress8(st, block);
+
+        /* lanes without a block k keep their state */
+        __m256i mask = _mm256_load_si256((const __m256i*)live);
+        for (int i = 0; i < 8; i++)
+            st[i] = _mm256_blendv_epi8(keep[i], st[i], mask);
+    }
+
+    alignas(32) uint32_t w[8][8];
+    for (int i = 0; i < 8; i++)
+        _mm256_store_si256((__m256i*)w[i], st[i]);
+    for (int j = 0; j < lanes; j++)
+    {
+        uint32_t s[8];
+        for (int i = 0; i < 8; i++)
+            s[i] = w[i][j];
+        sha_store_digest(out + FATE_SHA256_LEN * j, s);
+    }
+#else
+    for (int j = 0; j < lanes; j++)
+    {
+        uint32_t st[8];
+        memcpy(st, fate_sha256_iv, sizeof(st));
+        for (size_t k = 0; k < l[j].blocks; k++)
+            sha256_compress(st, sha_lane_block(&l[j], k));
+        sha_store_digest(out + FATE_SHA256_LEN * j, st);
+    }
+#endif
+}
+
+/*! Any number of messages, eight at a time */
+void fate_sha256_batch(uint8_t* out, const uint8_t* const* msg, const size_t* len, int num)
+{
+    for (int i = 0; i < num; i += 8)
+        fate_sha256_x8(out + FATE_SHA256_LEN * i, msg + i, len + i, num - i < 8 ? num - i : 8);
+}
+
+/*
+ * MGF1-SHA-256 (RFC 8017 B.2.1), XORed into place: dst[j] ^= MGF1(seed[j], dstLen).
+ * The counter blocks of all messages are hashed eight at a time.
+ */
+static void fate_mgf1_xor_batch(uint8_t* const* dst, size_t dstLen, const uint8_t* const* seed, size_t seedLen, int num)
+{
+    const size_t inLen = seedLen + 4;
+    vector<uint8_t> in(inLen * 8);
+    uint8_t digest[8 * FATE_SHA256_LEN];
+    const uint8_t* msg[8];
+    size_t len[8];
+
+    for (int i = 0; i < num; i += 8)
+    {
+        int lanes = num - i < 8 ? num - i : 8;
+        for (int j = 0; j < lanes; j++)
+        {
+            memcpy(&in[inLen * j], seed[i + j], seedLen);
+            msg[j] = &in[inLen * j];
+            len[j] = inLen;
+        }
+        for (uint32_t c = 0; (size_t)c * FATE_SHA256_LEN < dstLen; c++)
+        {
+            for (int j = 0; j < lanes; j++)
+            {
+                uint8_t* ctr = &in[inLen * j + seedLen];
+                ctr[0] = (uint8_t)(c >> 24);
+                ctr[1] = (uint8_t)(c >> 16);
+                ctr[2] = (uint8_t)(c >> 8);
+                ctr[3] = (uint8_t)c;
+            }
+            fate_sha256_x8(digest, msg, len, lanes);
+
+            size_t off = (size_t)c * FATE_SHA256_LEN;
+            size_t n = dstLen - off < FATE_SHA256_LEN ? dstLen - off : FATE_SHA256_LEN;
+            for (int j = 0; j < lanes; j++)
+                for (size_t k = 0; k < n; k++)
+                    dst[i + j][off + k] ^= digest[FATE_SHA256_LEN * j + k];
+        }
+    }
+}
+
+/*================================================ PKCS#1 ================================================*/
+/*
+ * RSAES-OAEP and RSASSA-PSS (RFC 8017) with SHA-256, MGF1-SHA-256, an empty
+ * OAEP label and 32-byte PSS salts, one key per call. Every step runs over
+ * the whole batch: the hashes and mask generations go through
+ * fate_sha256_x8, the RSA primitive through powm_avx, eight lanes at a time.
+ * Private-key operations run inside a fate_cache_bypass scope.
+ */
+
+#define FATE_OAEP_OVERHEAD (2 * FATE_SHA256_LEN + 2)
+#define FATE_PSS_SALT_LEN FATE_SHA256_LEN
+
+/* SHA-256 of the empty label */
+static const uint8_t fate_oaep_lhash[FATE_SHA256_LEN] = {
+    0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14, 0x9a, 0xfb, 0xf4, 0xc8, 0x99, 0x6f, 0xb9, 0x24,
+    0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b, 0x93, 0x4c, 0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55
+};
+
+/*! Every element failed, for keys too short for the padding */
+static int fate_fail_all(int* status, int num)
+{
+    for (int i = 0; i < num; i++)
+        status[i] = FATE_STS_ERR;
+    return num;
+}
+
+/*! out[i] = OS2IP(in[i])^x mod n as k bytes, through powm_avx_secret when x is secret; elements not below n get FATE_STS_ERR */
+static int fate_rsa_batch(uint8_t* out, const uint8_t* in, int num, size_t k, const mpz_t n, const mpz_t x,
+                          bool secret, int* status)
+{
+    fate_bignum fb[4];
+    for (int j = 0; j < 4; j++)
+    {
+        fb[j].bigint = (mpz_t*)malloc(sizeof(mpz_t) * (num > 0 ? num : 1));
+        fb[j].num = num;
+        fb[j].ismalloc = 1;
+        fb[j].ismont = 0;
+    }
+    vector<char> range(num);
+    for (int i = 0; i < num; i++)
+    {
+        mpz_init(fb[0].bigint[i]);
+        mpz_init(fb[1].bigint[i]);
+        mpz_import(fb[1].bigint[i], k, 1, 1, 0, 0, in + k * i);
+        range[i] = mpz_cmp(fb[1].bigint[i], n) < 0;
+        if (!range[i])
+            mpz_set_ui(fb[1].bigint[i], 0);
+        mpz_init_set(fb[2].bigint[i], x);
+        mpz_init_set(fb[3].bigint[i], n);
+    }
+
+    int failed = secret ? powm_avx_secret(&fb[0], &fb[1], &fb[2], &fb[3], num, status)
+                        : powm_avx(&fb[0], &fb[1], &fb[2], &fb[3], num, status);
+
+    memset(out, 0, k * num);
+    for (int i = 0; i < num; i++)
+    {
+        size_t bytes = (mpz_sizeinbase(fb[0].bigint[i], 2) + 7) / 8;
+        if (mpz_sgn(fb[0].bigint[i]) != 0)
+            mpz_export(out + k * i + k - bytes, NULL, 1, 1, 0, 0, fb[0].bigint[i]);
+        if (!range[i])
+        {
+            failed += status[i] != FATE_STS_ERR;
+            status[i] = FATE_STS_ERR;
+        }
+    }
+
+    for (int j = 0; j < 4; j++)
+    {
+        for (int i = 0; i < num; i++)
+            mpz_clear(fb[j].bigint[i]);
+        free(fb[j].bigint);
+    }
+
+    return failed;
+}
+
+/*! ct + k * i = RSAES-OAEP-ENCRYPT((n, e), msg[i]); messages longer than k - 66 bytes get FATE_STS_ERR */
+int fate_rsa_oaep_encrypt_batch(uint8_t* ct, const uint8_t* const* msg, const size_t* msgLen, int num, const mpz_t n,
+                                const mpz_t e, int* status)
+{
+    vector<int> own;
+    if (status == NULL)
+    {
+        own.resize(num);
+        status = own.data();
+    }
+    const size_t k = (mpz_sizeinbase(n, 2) + 7) / 8;
+    if (k < FATE_OAEP_OVERHEAD)
+        return fate_fail_all(status, num);
+    const size_t dbLen = k - FATE_SHA256_LEN - 1;
+
+    /* EM = 0x00 || maskedSeed || maskedDB, DB = lHash || PS || 0x01 || M */
+    vector<uint8_t> em(k * num);
+    vector<uint8_t*> seed(num), db(num);
+    vector<char> fits(num);
+    for (int i = 0; i < num; i++)
+    {
+        uint8_t* p = &em[k * i];
+        seed[i] = p + 1;
+        db[i] = p + 1 + FATE_SHA256_LEN;
+        fits[i] = msgLen[i] <= k - FATE_OAEP_OVERHEAD;
+        fate_rng_bytes(fate_thread_rng(), seed[i], FATE_SHA256_LEN);
+        memcpy(db[i], fate_oaep_lhash, FATE_SHA256_LEN);
+        if (fits[i])
+        {
+            db[i][dbLen - msgLen[i] - 1] = 0x01;
+            memcpy(db[i] + dbLen - msgLen[i], msg[i], msgLen[i]);
+        }
+    }
+    fate_mgf1_xor_batch(db.data(), dbLen, (const uint8_t* const*)seed.data(), FATE_SHA256_LEN, num);
+    fate_mgf1_xor_batch(seed.data(), FATE_SHA256_LEN, (const uint8_t* const*)db.data(), dbLen, num);
+
+    int failed = fate_rsa_batch(ct, em.data(), num, k, n, e, false, status);
+    for (int i = 0; i < num; i++)
+    {
+        if (!fits[i])
+        {
+            failed += status[i] != FATE_STS_ERR;
+            status[i] = FATE_STS_ERR;
+            memset(ct + k * i, 0, k);
+        }
+    }
+
+    return failed;
+}
+
+/*
+ * msg + k * i = RSAES-OAEP-DECRYPT((n, d), ct + k * i), its length in msgLen[i].
+ * The padding of an element is checked without branching on secret bytes;
+ * a bad one gets FATE_STS_ERR and msgLen[i] = 0.
+ */
+int fate_rsa_oaep_decrypt_batch(uint8_t* msg, size_t* msgLen, const uint8_t* ct, int num, const mpz_t n, const mpz_t d,
+                                int* status)
+{
+    vector<int> own;
+    if (status == NULL)
+    {
+        own.resize(num);
+        status = own.data();
+    }
+    const size_t k = (mpz_sizeinbase(n, 2) + 7) / 8;
+    if (k < FATE_OAEP_OVERHEAD)
+    {
+        memset(msgLen, 0, sizeof(size_t) * num);
+        return fate_fail_all(status, num);
+    }
+    const size_t dbLen = k - FATE_SHA256_LEN - 1;
+
+    vector<uint8_t> em(k * num);
+    int failed = fate_rsa_batch(em.data(), ct, num, k, n, d, true, status);
+
+    vector<uint8_t*> seed(num), db(num);
+    for (int i = 0; i < num; i++)
+    {
+        seed[i] = &em[k * i] + 1;
+        db[i] = &em[k * i] + 1 + FATE_SHA256_LEN;
+    }
+    fate_mgf1_xor_batch(seed.data(), FATE_SHA256_LEN, (const uint8_t* const*)db.data(), dbLen, num);
+    fate_mgf1_xor_batch(db.data(), dbLen, (const uint8_t* const*)seed.data(), FATE_SHA256_LEN, num);
+
+    for (int i = 0; i < num; i++)
+    {
+        const uint8_t* p = db[i];
+        unsigned bad = em[k * i];
+        for (int j = 0; j < FATE_SHA256_LEN; j++)
+            bad |= p[j] ^ fate_oaep_lhash[j];
+
+        /* first 0x01 after the zero padding; any other nonzero byte before it is an error */
+        size_t start = 0;
+        unsigned found = 0;
+        for (size_t j = FATE_SHA256_LEN; j < dbLen; j++)
+        {
+            unsigned isOne = (unsigned)((p[j] ^ 0x01) - 1) >> 31;
+            unsigned isZero = (unsigned)(p[j] - 1) >> 31;
+            unsigned take = isOne & ~found & 1;
+            start |= (size_t)(0 - take) & (j + 1);
+            bad |= ~found & ~isOne & ~isZero & 1;
+            found |= isOne;
+        }
+        bad |= ~found & 1;
+
+        if (bad || status[i] == FATE_STS_ERR)
+        {
+            failed += status[i] != FATE_STS_ERR;
+            status[i] = FATE_STS_ERR;
+            msgLen[i] = 0;
+            continue;
+        }
+        msgLen[i] = dbLen - start;
+        memcpy(msg + k * i, p + start, msgLen[i]);
+    }
+
+    return failed;
+}
+
+/* EM layout of PSS: maskedDB (emLen - 33 bytes) || H || 0xbc, emBits = modBits - 1 */
+static inline void fate_pss_lengths(const mpz_t n, size_t* k, size_t* emLen, int* topBits)
+{
+    size_t modBits = mpz_sizeinbase(n, 2);
+    *k = (modBits + 7) / 8;
+    *emLen = (modBits - 1 + 7) / 8;
+    *topBits = (int)(8 * *emLen - (modBits - 1)); // bits cleared in the first EM byte
+}
+
+/*! M' = 0^8 || mHash || salt hashed for every element */
+static void fate_pss_hash(uint8_t* h, const uint8_t* mHash, const uint8_t* const* salt, int num)
+{
+    const size_t len = 8 + 2 * FATE_SHA256_LEN;
+    vector<uint8_t> mp(len * num, 0);
+    vector<const uint8_t*> ptr(num);
+    vector<size_t> lens(num, len);
+    for (int i = 0; i < num; i++)
+    {
+        memcpy(&mp[len * i + 8], mHash + FATE_SHA256_LEN * i, FATE_SHA256_LEN);
+        memcpy(&mp[len * i + 8 + FATE_SHA256_LEN], salt[i], FATE_PSS_SALT_LEN);
+        ptr[i] = &mp[len * i];
+    }
+    fate_sha256_batch(h, ptr.data(), lens.data(), num);
+}
+
+/*! sig + k * i = RSASSA-PSS-SIGN((n, d), msg[i]) */
+int fate_rsa_pss_sign_batch(uint8_t* sig, const uint8_t* const* msg, const size_t* msgLen, int num, const mpz_t n,
+                            const mpz_t d, int* status)
+{
+    vector<int> own;
+    if (status == NULL)
+    {
+        own.resize(num);
+        status = own.data();
+    }
+    size_t k, emLen;
+    int topBits;
+    fate_pss_lengths(n, &k, &emLen, &topBits);
+    if (emLen < FATE_SHA256_LEN + FATE_PSS_SALT_LEN + 2)
+        return fate_fail_all(status, num);
+    const size_t dbLen = emLen - FATE_SHA256_LEN - 1;
+
+    vector<uint8_t> mHash(FATE_SHA256_LEN * num), h(FATE_SHA256_LEN * num), salt(FATE_PSS_SALT_LEN * num);
+    vector<const uint8_t*> saltp(num), hp(num);
+    fate_sha256_batch(mHash.data(), msg, msgLen, num);
+    fate_rng_bytes(fate_thread_rng(), salt.data(), salt.size());
+    for (int i = 0; i < num; i++)
+        saltp[i] = &salt[FATE_PSS_SALT_LEN * i];
+    fate_pss_hash(h.data(), mHash.data(), saltp.data(), num);
+
+    /* EM is written right-aligned into k bytes, a leading zero byte when emLen < k */
+    vector<uint8_t> em(k * num, 0);
+    vector<uint8_t*> db(num);
+    for (int i = 0; i < num; i++)
+    {
+        db[i] = &em[k * i + k - emLen];
+        db[i][dbLen - FATE_PSS_SALT_LEN - 1] = 0x01;
+        memcpy(db[i] + dbLen - FATE_PSS_SALT_LEN, saltp[i], FATE_PSS_SALT_LEN);
+        memcpy(db[i] + dbLen, &h[FATE_SHA256_LEN * i], FATE_SHA256_LEN);
+        db[i][emLen - 1] = 0xbc;
+        hp[i] = db[i] + dbLen;
+    }
+    fate_mgf1_xor_batch(db.data(), dbLen, hp.data(), FATE_SHA256_LEN, num);
+    for (int i = 0; i < num; i++)
+        db[i][0] &= 0xff >> topBits;
+
+    return fate_rsa_batch(sig, em.data(), num, k, n, d, true, status);
+}
+
+/*! status[i] = FATE_STS_OK when sig + k * i is a valid PSS signature of msg[i] under (n, e), else FATE_STS_ERR */
+int fate_rsa_pss_verify_batch(const uint8_t* sig, const uint8_t* const* msg, const size_t* msgLen, int num,
+                              const mpz_t n, const mpz_t e, int* status)
+{
+    vector<int> own;
+    if (status == NULL)
+    {
+        own.resize(num);
+        status = own.data();
+    }
+    size_t k, emLen;
+    int topBits;
+    fate_pss_lengths(n, &k, &emLen, &topBits);
+    if (emLen < FATE_SHA256_LEN + FATE_PSS_SALT_LEN + 2)
+        return fate_fail_all(status, num);
+    const size_t dbLen = emLen - FATE_SHA256_LEN - 1;
+
+    vector<uint8_t> em(k * num);
+    fate_rsa_batch(em.data(), sig, num, k, n, e, false, status);
+
+    vector<uint8_t*> db(num);
+    vector<const uint8_t*> hp(num), saltp(num);
+    vector<char> bad(num);
+    for (int i = 0; i < num; i++)
+    {
+        db[i] = &em[k * i + k - emLen];
+        hp[i] = db[i] + dbLen;
+        bad[i] = status[i] == FATE_STS_ERR || (k > emLen && em[k * i] != 0) || db[i][emLen - 1] != 0xbc ||
+                 (db[i][0] & ~(0xff >> topBits)) != 0;
+    }
+    fate_mgf1_xor_batch(db.data(), dbLen, hp.data(), FATE_SHA256_LEN, num);
+    for (int i = 0; i < num; i++)
+    {
+        db[i][0] &= 0xff >> topBits;
+        const size_t ps = dbLen - FATE_PSS_SALT_LEN - 1;
+        for (size_t j = 0; j < ps; j++)
+            bad[i] |= db[i][j] != 0;
+        bad[i] |= db[i][ps] != 0x01;
+        saltp[i] = db[i] + ps + 1;
+    }
+
+    vector<uint8_t> mHash(FATE_SHA256_LEN * num), h(FATE_SHA256_LEN * num);
+    fate_sha256_batch(mHash.data(), msg, msgLen, num);
+    fate_pss_hash(h.data(), mHash.data(), saltp.data(), num);
+
+    int failed = 0;
+    for (int i = 0; i < num; i++)
+    {
+        bad[i] |= memcmp(&h[FATE_SHA256_LEN * i], hp[i], FATE_SHA256_LEN) != 0;
+        status[i] = bad[i] ? FATE_STS_ERR : FATE_STS_OK;
+        failed += bad[i];
+    }
+
+    return failed;
+}
+
+/*================================================ KEY GENERATION ================================================*/
+/*
+ * Random primes of an exact bit length, many at a time. Each of a set of
+ * independent searches starts at a random odd number with the two top bits
+ * set (so a product of two such primes has exactly twice their length) and
+ * sieves a window above it by the odd primes below FATE_SIEVE_LIMIT. Every
+ * pass takes the next survivor of each search and runs a base-2
+ * Miller-Rabin round on all of them at once through powm_avx_secret;
+ * candidates passing it are collected until a full batch of the remaining
+ * rounds with random bases can be run. A search restarts at a fresh random
+ * point once it produced a prime, so no two primes come from the same window.
+ * The multi-buffer engine only takes the sizes of g_fate_tune, so batching
+ * starts at 1024-bit primes (2048-bit keys); smaller candidates run their
+ * rounds one by one with mpz_powm_sec.
+ */
+
+#define FATE_SIEVE_LIMIT 16384
+#define FATE_SIEVE_WINDOW 4096 // odd offsets per window
+#define FATE_PRIME_SEARCHES 64 // upper bound of concurrent searches
+
+static const vector<uint32_t>& fate_small_primes()
+{
+    static const vector<uint32_t> primes = [] {
+        vector<uint32_t> p;
+        vector<char> composite(FATE_SIEVE_LIMIT, 0);
+        for (uint32_t i = 3; i < FATE_SIEVE_LIMIT; i += 2)
+        {
+            if (composite[i])
+                continue;
+            p.push_back(i);
+            for (uint32_t j = i * i; j < FATE_SIEVE_LIMIT; j += 2 * i)
+                composite[j] = 1;
+        }
+        return p;
+    }();
+    return primes;
+}
+
+/*! Miller-Rabin rounds for an error probability below 2^-100 on random candidates (FIPS 186-4, C.3) */
+static int fate_mr_rounds(int bits)
+{
+    if (bits >= 1536)
+        return 4;
+    if (bits >= 1024)
+        return 5;
+    if (bits >= 512)
+        return 7;
+    return 40;
+}
+
+struct fate_prime_search
+{
+    mpz_t base;              // window start, odd
+    vector<char> composite;  // composite[j]: base + 2j has a small factor
+    int next;                // next offset to hand out
+};
+
+/*! New random window; avoid > 1 also sieves out candidates c == 1 (mod avoid) */
+static void fate_prime_search_reset(fate_prime_search* s, int bits, unsigned long avoid)
+{
+    vector<uint8_t> raw((bits + 7) / 8);
+    fate_rng_bytes(fate_thread_rng(), raw.data(), raw.size());
+    mpz_import(s->base, raw.size(), 1, 1, 0, 0, raw.data());
+    mpz_fdiv_r_2exp(s->base, s->base, bits);
+    mpz_setbit(s->base, bits - 1);
+    mpz_setbit(s->base, bits - 2);
+    mpz_setbit(s->base, 0);
+
+    /* base + 2j == 0 (mod p) for j == -r / 2 (mod p) */
+    s->composite.assign(FATE_SIEVE_WINDOW, 0);
+    for (uint32_t p : fate_small_primes())
+    {
+        uint32_t r = (uint32_t)mpz_fdiv_ui(s->base, p);
+        uint64_t j = (uint64_t)((p - r) % p) * ((p + 1) / 2) % p;
+        for (; j < FATE_SIEVE_WINDOW; j += p)
+            s->composite[j] = 1;
+    }
+    if (avoid > 1)
+    {
+        uint64_t r = mpz_fdiv_ui(s->base, avoid);
+        uint64_t j = (1 + avoid - r) % avoid * ((avoid + 1) / 2) % avoid;
+        for (; j < FATE_SIEVE_WINDOW; j += avoid)
+            s->composite[j] = 1;
+    }
+    s->next = 0;
+}
+
+/*! Next sieve survivor of the search in c, moving to a new window when this one is used up */
+static void fate_prime_search_next(fate_prime_search* s, mpz_t c, int bits, unsigned long avoid)
+{
+    for (;;)
+    {
+        while (s->next < FATE_SIEVE_WINDOW && s->composite[s->next])
+            s->next++;
+        if (s->next < FATE_SIEVE_WINDOW)
+        {
+            mpz_add_ui(c, s->base, 2 * (unsigned long)s->next++);
+            if ((int)mpz_sizeinbase(c, 2) == bits)
+                return;
+            continue;
+        }
+        fate_prime_search_reset(s, bits, avoid);
+    }
+}
+
+/*! Candidates of `bits` bits have a multi-buffer modulus size */
+static bool fate_mr_batched(int bits)
+{
+    for (int k = 0; k < FATE_TUNE_SIZES; k++)
+        if (g_fate_tune[k].bits == bits)
+            return true;
+    return false;
+}
+
+/*
+ * One Miller-Rabin round for every candidate c[i] (all of one size), base 2
+ * or (random) a random base in [2, c - 2]; the exponentiations a^d mod c run
+ * through powm_avx_secret, or mpz_powm_sec one at a time when `scalar` is
+ * set or the size has no multi-buffer path. pass[i] is cleared for the
+ * candidates found composite.
+ */
+static void fate_miller_rabin_batch(mpz_t* c, int num, bool random, bool* pass, bool scalar = false)
+{
+    if (num == 0)
+        return;
+
+    fate_bignum fb[4];
+    for (int k = 0; k < 4; k++)
+    {
+        fb[k].bigint = (mpz_t*)malloc(sizeof(mpz_t) * num);
+        fb[k].num = num;
+        fb[k].ismalloc = 1;
+        fb[k].ismont = 0;
+        for (int i = 0; i < num; i++)
+            mpz_init(fb[k].bigint[i]);
+    }
+    fate_bignum *x = &fb[0], *a = &fb[1], *d = &fb[2], *m = &fb[3];
+
+    /* bases: a = 2 + uniform [0, c - 3) */
+    const int limbs = (int)((mpz_sizeinbase(c[0], 2) + 63) / 64);
+    vector<uint64_t> bound((size_t)limbs * num, 0), base((size_t)limbs * num);
+    vector<mp_bitcnt_t> s(num);
+    for (int i = 0; i < num; i++)
+    {
+        mpz_set(m->bigint[i], c[i]);
+        mpz_sub_ui(d->bigint[i], c[i], 1);
+        s[i] = mpz_scan1(d->bigint[i], 0);
+        mpz_fdiv_q_2exp(d->bigint[i], d->bigint[i], s[i]);
+        mpz_sub_ui(a->bigint[i], c[i], 3);
+        mpz_export(&bound[(size_t)i * limbs], NULL, -1, sizeof(uint64_t), 0, 0, a->bigint[i]);
+    }
+    if (random)
+        fate_rand_below_limbs(fate_thread_rng(), base.data(), bound.data(), limbs, num, false);
+    for (int i = 0; i < num; i++)
+    {
+        if (random)
+        {
+            mpz_import(a->bigint[i], limbs, -1, sizeof(uint64_t), 0, 0, &base[(size_t)i * limbs]);
+            mpz_add_ui(a->bigint[i], a->bigint[i], 2);
+        }
+        else
+            mpz_set_ui(a->bigint[i], 2);
+    }
+
+    /* the candidates are secret key material */
+    if (scalar || !fate_mr_batched((int)mpz_sizeinbase(c[0], 2)))
+    {
+        for (int i = 0; i < num; i++)
+            mpz_powm_sec(x->bigint[i], a->bigint[i], d->bigint[i], m->bigint[i]);
+    }
+    else
+    {
+        vector<int> status(num);
+        powm_avx_secret(x, a, d, m, num, status.data());
+    }
+
+    mpz_t cm1;
+    mpz_init(cm1);
+    for (int i = 0; i < num; i++)
+    {
+        mpz_sub_ui(cm1, c[i], 1);
+        mpz_t& y = x->bigint[i];
+        bool ok = mpz_cmp_ui(y, 1) == 0 || mpz_cmp(y, cm1) == 0;
+        for (mp_bitcnt_t r = 1; r < s[i] && !ok; r++)
+        {
+            mpz_mul(y, y, y);
+            mpz_mod(y, y, c[i]);
+            if (mpz_cmp_ui(y, 1) == 0)
+                break;
+            ok = mpz_cmp(y, cm1) == 0;
+        }
+        pass[i] = pass[i] && ok;
+    }
+    mpz_clear(cm1);
+
+    for (int k = 0; k < 4; k++)
+    {
+        for (int i = 0; i < num; i++)
+            mpz_clear(fb[k].bigint[i]);
+        free(fb[k].bigint);
+    }
+}
+
+/*! out[0..count) = random primes of exactly `bits` bits (out initialized); avoid > 1: none is 1 mod avoid */
+int fate_prime_batch(mpz_t* out, int count, int bits, unsigned long avoid)
+{
+    if (count < 0 || bits < 64)
+        return -1;
+
+    const int lanes = FATE_MB_LANES;
+    int searches = (count + lanes - 1) / lanes * lanes;
+    searches = searches < lanes ? lanes : searches > FATE_PRIME_SEARCHES ? FATE_PRIME_SEARCHES : searches;
+    const int rounds = fate_mr_rounds(bits);
+
+    vector<fate_prime_search> search(searches);
+    mpz_t* cand = (mpz_t*)malloc(sizeof(mpz_t) * searches);
+    mpz_t* pending = (mpz_t*)malloc(sizeof(mpz_t) * (searches + lanes));
+    for (int j = 0; j < searches; j++)
+    {
+        mpz_init(search[j].base);
+        fate_prime_search_reset(&search[j], bits, avoid);
+        mpz_init(cand[j]);
+    }
+    for (int j = 0; j < searches + lanes; j++)
+        mpz_init(pending[j]);
+    bool* pass = new bool[searches + lanes];
+
+    int found = 0, np = 0;
+    while (found < count)
+    {
+        for (int j = 0; j < searches; j++)
+        {
+            fate_prime_search_next(&search[j], cand[j], bits, avoid);
+            pass[j] = true;
+        }
+        fate_miller_rabin_batch(cand, searches, false, pass);
+        for (int j = 0; j < searches; j++)
+        {
+            if (!pass[j])
+                continue;
+            mpz_swap(pending[np++], cand[j]);
+            fate_prime_search_reset(&search[j], bits, avoid);
+        }
+
+        /* the remaining rounds once a batch is full or enough candidates wait */
+        if (np < lanes && found + np < count)
+            continue;
+        for (int i = 0; i < np; i++)
+            pass[i] = true;
+        for (int r = 1; r < rounds; r++)
+            fate_miller_rabin_batch(pending, np, true, pass);
+        for (int i = 0; i < np && found < count; i++)
+            if (pass[i])
+                mpz_swap(out[found++], pending[i]);
+        np = 0;
+    }
+
+    delete[] pass;
+    for (int j = 0; j < searches + lanes; j++)
+        mpz_clear(pending[j]);
+    for (int j = 0; j < searches; j++)
+    {
+        mpz_clear(search[j].base);
+        mpz_clear(cand[j]);
+    }
+    free(pending);
+    free(cand);
+
+    return 0;
+}
+
+/*
+ * Pairs of primes of `bits` bits for num keys. accept(i, p, q) builds key i
+ * and returns false to reject the pair; the rejected q stays available as a
+ * partner of later keys, p is dropped when no prime of the pool suits it.
+ */
+template <typename Accept>
+static int fate_prime_pairs(int num, int bits, unsigned long avoid, Accept accept)
+{
+    vector<mpz_t*> pool;
+    int failed = 0;
+    for (int i = 0; i < num; i++)
+    {
+        bool done = false;
+        while (!done)
+        {
+            if (pool.size() < 2)
+            {
+                int more = 2 * (num - i);
+                mpz_t* fresh = (mpz_t*)malloc(sizeof(mpz_t) * more);
+                for (int k = 0; k < more; k++)
+                    mpz_init(fresh[k]);
+                if (fate_prime_batch(fresh, more, bits, avoid) != 0)
+                {
+                    for (int k = 0; k < more; k++)
+                        mpz_clear(fresh[k]);
+                    free(fresh);
+                    failed = num - i;
+                    break;
+                }
+                for (int k = 0; k < more; k++)
+                {
+                    mpz_t* p = (mpz_t*)malloc(sizeof(mpz_t));
+                    mpz_init(*p);
+                    mpz_swap(*p, fresh[k]);
+                    mpz_clear(fresh[k]);
+                    pool.push_back(p);
+                }
+                free(fresh);
+            }
+
+            size_t j = 1;
+            while (j < pool.size() && !accept(i, *pool[0], *pool[j]))
+                j++;
+            if (j < pool.size())
+            {
+                mpz_clear(*pool[j]);
+                free(pool[j]);
+                pool.erase(pool.begin() + j);
+                done = true;
+            }
+            mpz_clear(*pool[0]);
+            free(pool[0]);
+            pool.erase(pool.begin());
+        }
+        if (failed)
+            break;
+    }
+    for (mpz_t* p : pool)
+    {
+        mpz_clear(*p);
+        free(p);
+    }
+
+    return failed;
+}
+
+/*! p and q at least 2^(bits - 100) apart (FIPS 186-4, B.3.3) */
+static bool fate_primes_apart(const mpz_t p, const mpz_t q, int bits)
+{
+    mpz_t diff;
+    mpz_init(diff);
+    mpz_sub(diff, p, q);
+    bool ok = (int)mpz_sizeinbase(diff, 2) > bits - 100;
+    mpz_clear(diff);
+
+    return ok;
+}
+
+#define FATE_RSA_E 65537
+
+typedef struct
+{
+    mpz_t n, e, d;
+    mpz_t p, q;
+} fate_rsa_keypair;
+
+void fate_rsa_keypair_clear(fate_rsa_keypair* key)
+{
+    mpz_clears(key->n, key->e, key->d, key->p, key->q, NULL);
+}
+
+/*! num RSA keys with a `bits`-bit modulus, e = 65537 and d = e^-1 mod lcm(p - 1, q - 1); initializes keys[] */
+int fate_rsa_keygen_batch(fate_rsa_keypair* keys, int num, int bits)
+{
+    if (num < 0 || bits < 128 || bits % 2)
+        return -1;
+
+    for (int i = 0; i < num; i++)
+        mpz_inits(keys[i].n, keys[i].e, keys[i].d, keys[i].p, keys[i].q, NULL);
+
+    mpz_t lambda, p1, q1;
+    mpz_inits(lambda, p1, q1, NULL);
+    int failed = fate_prime_pairs(num, bits / 2, FATE_RSA_E, [&](int i, const mpz_t p, const mpz_t q) {
+        fate_rsa_keypair* key = &keys[i];
+        if (!fate_primes_apart(p, q, bits / 2))
+            return false;
+        mpz_sub_ui(p1, p, 1);
+        mpz_sub_ui(q1, q, 1);
+        mpz_lcm(lambda, p1, q1);
+        mpz_set_ui(key->e, FATE_RSA_E);
+        if (mpz_invert(key->d, key->e, lambda) == 0 || (int)mpz_sizeinbase(key->d, 2) <= bits / 2)
+            return false;
+        mpz_mul(key->n, p, q);
+        mpz_set(key->p, p);
+        mpz_set(key->q, q);
+        return true;
+    });
+    mpz_clears(lambda, p1, q1, NULL);
+
+    return failed;
+}
+
+/*
+ * num Paillier key pairs with a `bits`-bit n = pq. Pairs are rejected unless
+ * n^2 has exactly 2 * bits bits, so ciphertexts fill the multi-buffer
+ * modulus size, and gcd(n, (p - 1)(q - 1)) = 1. Initializes pub[], priv[] and,
+ * when not NULL, p[] and q[].
+ */
+int fate_paillier_keygen_batch(fate_paillier_pub* pub, fate_paillier_priv* priv, mpz_t* p, mpz_t* q, int num, int bits)
+{
+    if (num < 0 || bits < 128 || bits % 2)
+        return -1;
+
+    vector<char> made(num, 0);
+    mpz_t n, phi, t;
+    mpz_inits(n, phi, t, NULL);
+    int failed = fate_prime_pairs(num, bits / 2, 0, [&](int i, const mpz_t pi, const mpz_t qi) {
+        if (!fate_primes_apart(pi, qi, bits / 2))
+            return false;
+        mpz_mul(n, pi, qi);
+        mpz_mul(t, n, n);
+        if ((int)mpz_sizeinbase(t, 2) != 2 * bits)
+            return false;
+        mpz_sub_ui(phi, pi, 1);
+        mpz_sub_ui(t, qi, 1);
+        mpz_mul(phi, phi, t);
+        mpz_gcd(t, n, phi);
+        if (mpz_cmp_ui(t, 1) != 0)
+            return false;
+
+        fate_paillier_pub_init(&pub[i], n);
+        if (!fate_paillier_priv_init(&priv[i], &pub[i], pi, qi))
+        {
+            fate_paillier_priv_clear(&priv[i]);
+            fate_paillier_pub_clear(&pub[i]);
+            return false;
+        }
+        if (p)
+            mpz_init_set(p[i], pi);
+        if (q)
+            mpz_init_set(q[i], qi);
+        made[i] = 1;
+        return true;
+    });
+    mpz_clears(n, phi, t, NULL);
+
+    /* keys that were not made are still initialized, as zero */
+    for (int i = 0; i < num; i++)
+    {
+        if (made[i])
+            continue;
+        mpz_t zero;
+        mpz_init(zero);
+        fate_paillier_pub_init(&pub[i], zero);
+        mpz_init(priv[i].lambda);
+        mpz_init(priv[i].mu);
+        if (p)
+            mpz_init(p[i]);
+        if (q)
+            mpz_init(q[i]);
+        mpz_clear(zero);
+    }
+
+    return failed;
+}
+
+/*================================================ WORK STEALING ================================================*/
+/*
+ * Scheduler for mixed jobs: several modulus sizes, sizes or operands the
+ * multi-buffer engine does not take, tails shorter than a batch. Elements are
+ * grouped by modulus size and cut into 8-lane multi-buffer tasks; whatever the
+ * cost model prices cheaper on mpz_powm becomes one task per element. Tasks
+ * are dealt longest first onto per-worker deques. A worker pops the front of
+ * its own deque and, once that is empty, steals from the back of the deque
+ * with the most predicted work left, so the stragglers at the end of a job
+ * spread over every worker instead of trailing on one.
+ */
+
+#define FATE_COST_GMP_1K 400000.0 // ns of a 1024-bit mpz_powm with a full-size exponent, without a profile
+
+enum
+{
+    FATE_TASK_MB,    // one multi-buffer batch
+    FATE_TASK_GMP,   // one element the cost model gives to mpz_powm
+    FATE_TASK_RETRY  // one element the multi-buffer engine cannot take
+};
+
+typedef struct
+{
+    int start;    // first element, in the grouped order
+    int lanes;    // elements, 1 unless kind is FATE_TASK_MB
+    int kind;
+    double cost;  // predicted ns
+} fate_steal_task;
+
+struct fate_steal_deque
+{
+    std::mutex lock;
+    std::deque<int> tasks;
+    atomic<uint64_t> load; // predicted ns still queued
+};
+
+/*! Predicted ns of one mpz_powm, scaled from the profile or from FATE_COST_GMP_1K */
+static double fate_cost_gmp(const fate_tune_entry* tune, size_t mbits, size_t ebits)
+{
+    double base = FATE_COST_GMP_1K, ref = 1024.0;
+    if (tune && tune->bits > 0 && tune->gmp_ns > 0)
+    {
+        base = tune->gmp_ns;
+        ref = tune->bits;
+    }
+    return base * (mbits / ref) * (mbits / ref) * (ebits / ref);
+}
+
+/*! Predicted ns of one multi-buffer call whose longest exponent has ebits bits */
+static double fate_cost_mb(const fate_tune_entry* tune, size_t mbits, size_t ebits)
+{
+    if (tune && tune->mb_ns > 0)
+        return (double)tune->mb_ns * ebits / tune->bits;
+    /* the crossover of the profile: a call costs as much as mb_min_lanes mpz_powm */
+    return (tune ? tune->mb_min_lanes : 1) * fate_cost_gmp(tune, mbits, ebits);
+}
+
+/*! Modulus size the multi-buffer engine takes `m` at, 0: mpz_powm only */
+static int fate_steal_mb_bits(const fate_tune_entry* tune, mpz_t b, mpz_t e, mpz_t m)
+{
+    if (!CheckMbOperands(b, e, m) || (tune && tune->mb_min_lanes > FATE_MB_LANES))
+        return 0;
+    int bits = (int)mpz_sizeinbase(m, 2);
+    for (int k = 0; k < FATE_TUNE_SIZES; k++)
+        if (g_fate_tune[k].bits == bits)
+            return bits;
+    return 0;
+}
+
+/*
+ * Group the elements into tasks. `order` receives the elements in task
+ * order, each task covers order[start, start + lanes).
+ */
+static void fate_steal_plan(fate_bignum* b, fate_bignum* e, fate_bignum* m, int num, vector<int>& order,
+                            vector<fate_steal_task>& tasks)
+{
+    vector<int> mbBits(num);
+    vector<size_t> ebits(num);
+    vector<int> scalar;
+    std::map<int, vector<int>> groups;
+    for (int i = 0; i < num; i++)
+    {
+        mbBits[i] = fate_steal_mb_bits(fate_tune_lookup(m->bigint[i]), b->bigint[i], e->bigint[i], m->bigint[i]);
+        ebits[i] = mpz_sgn(e->bigint[i]) > 0 ? mpz_sizeinbase(e->bigint[i], 2) : 0;
+        if (mbBits[i] > 0)
+            groups[mbBits[i]].push_back(i);
+        else
+            scalar.push_back(i);
+    }
+
+    auto addScalar = [&](int i, int kind) {
+        size_t mbits = mpz_sgn(m->bigint[i]) ? mpz_sizeinbase(m->bigint[i], 2) : 0;
+        tasks.push_back({ (int)order.size(), 1, kind, fate_cost_gmp(fate_tune_lookup(m->bigint[i]), mbits, ebits[i]) });
+        order.push_back(i);
+    };
+
+    for (auto& g : groups)
+    {
+        const int mbits = g.first;
+        vector<int>& idx = g.second;
+        const fate_tune_entry* tune = fate_tune_lookup(m->bigint[idx[0]]);
+
+        /* a call runs as long as its longest exponent, so batch exponents of similar length */
+        std::stable_sort(idx.begin(), idx.end(), [&](int x, int y) { return ebits[x] > ebits[y]; });
+
+        for (size_t i = 0; i < idx.size(); i += FATE_MB_LANES)
+        {
+            int lanes = idx.size() - i < FATE_MB_LANES ? (int)(idx.size() - i) : FATE_MB_LANES;
+            double gmp = 0;
+            for (int j = 0; j < lanes; j++)
+                gmp += fate_cost_gmp(tune, mbits, ebits[idx[i + j]]);
+            double mb = fate_cost_mb(tune, mbits, ebits[idx[i]]);
+            if (mb > gmp)
+            {
+                for (int j = 0; j < lanes; j++)
+                    addScalar(idx[i + j], FATE_TASK_GMP);
+                continue;
+            }
+            tasks.push_back({ (int)order.size(), lanes, FATE_TASK_MB, mb });
+            order.insert(order.end(), idx.begin() + i, idx.begin() + i + lanes);
+        }
+    }
+    for (int i : scalar)
+        addScalar(i, FATE_TASK_RETRY);
+}
+
+static int fate_steal_run_task(const fate_steal_task& t, fate_bignum* fb, int* status, fate_mb_workspace* ws)
+{
+    mpz_t* res = fb[0].bigint + t.start;
+    mpz_t* b = fb[1].bigint + t.start;
+    mpz_t* e = fb[2].bigint + t.start;
+    mpz_t* m = fb[3].bigint + t.start;
+    status += t.start;
+
+    if (t.kind == FATE_TASK_MB)
+    {
+        const fate_tune_entry* tune = fate_tune_lookup(m[0]);
+        if (tune && tune->shared_exp && fate_lanes_share_exponent(e, t.lanes))
+            return powm_shared_batch(res, b, e, m, t.lanes, status);
+        return powm_mb_batch(res, b, e, m, t.lanes, status, ws);
+    }
+
+    status[0] = t.kind == FATE_TASK_GMP ? powm_gmp_direct(res[0], b[0], e[0], m[0])
+                                        : powm_gmp_lane(res[0], b[0], e[0], m[0]);
+    return status[0] == FATE_STS_ERR;
+}
+
+/*
+ * res[i] = b[i]^e[i] mod m[i] for a job that mixes backends, see above.
+ * Same contract as powm_avx_parallel.
+ */
+int powm_avx_steal(fate_bignum* res, fate_bignum* b, fate_bignum* e, fate_bignum* m, int num, int* status,
+                   const fate_parallel_opts* opts)
+{
+    assert(res->ismalloc == 1);
+    assert(b->ismalloc == 1);
+    assert(e->ismalloc == 1);
+    assert(m->ismalloc == 1);
+
+    assert(res->num == b->num);
+    assert(e->num == b->num);
+    assert(m->num == b->num);
+
+    if (fate_cache_active())
+        return fate_cache_run(res, b, e, m, num, status, [opts](fate_bignum* r, fate_bignum* x, fate_bignum* y,
+                                                                fate_bignum* z, int n, int* st) {
+            return powm_avx_steal(r, x, y, z, n, st, opts);
+        });
+
+    g_fate_stats.ops.fetch_add(num, memory_order_relaxed);
+
+    vector<int> order;
+    vector<fate_steal_task> tasks;
+    order.reserve(num);
+    fate_steal_plan(b, e, m, num, order, tasks);
+
+    int nodes = fate_numa_nodes();
+    if (opts && opts->numa_nodes > 0 && opts->numa_nodes < nodes)
+        nodes = opts->numa_nodes;
+    int threads = opts && opts->threads > 0 ? opts->threads : (int)std::thread::hardware_concurrency();
+    if (threads > (int)tasks.size())
+        threads = (int)tasks.size();
+    if (threads < 1)
+        threads = 1;
+
+    /* longest first, each task onto the deque with the least predicted work */
+    vector<int> byCost(tasks.size());
+    for (size_t k = 0; k < tasks.size(); k++)
+        byCost[k] = (int)k;
+    std::stable_sort(byCost.begin(), byCost.end(), [&](int x, int y) { return tasks[x].cost > tasks[y].cost; });
+    vector<fate_steal_deque> deques(threads);
+    for (int t = 0; t < threads; t++)
+        deques[t].load = 0;
+    for (int k : byCost)
+    {
+        int t = 0;
+        for (int u = 1; u < threads; u++)
+            if (deques[u].load < deques[t].load)
+                t = u;
+        deques[t].tasks.push_back(k);
+        deques[t].load += (uint64_t)tasks[k].cost;
+    }
+
+    /* compact the elements into task order by swapping the mpz_t in and out, no copies */
+    fate_bignum fb[4];
+    fate_bignum* orig[4] = { res, b, e, m };
+    for (int a = 0; a < 4; a++)
+    {
+        fb[a].bigint = (mpz_t*)malloc(sizeof(mpz_t) * (num > 0 ? num : 1));
+        fb[a].num = num;
+        fb[a].ismalloc = 1;
+        fb[a].ismont = 0;
+        for (int j = 0; j < num; j++)
+        {
+            mpz_init(fb[a].bigint[j]);
+            mpz_swap(fb[a].bigint[j], orig[a]->bigint[order[j]]);
+        }
+    }
+
+    vector<int> taskStatus(num > 0 ? num : 1);
+    atomic<int> failed(0);
+
+    auto take = [&](int t, int* k) {
+        fate_steal_deque& d = deques[t];
+        std::lock_guard<std::mutex> lk(d.lock);
+        if (d.tasks.empty())
+            return false;
+        *k = d.tasks.front();
+        d.tasks.pop_front();
+        d.load -= (uint64_t)tasks[*k].cost;
+        return true;
+    };
+    auto steal = [&](int self, int* k) {
+        for (;;)
+        {
+            int victim = -1;
+            uint64_t most = 0;
+            for (int u = 0; u < threads; u++)
+            {
+                uint64_t load = deques[u].load.load(memory_order_relaxed);
+                if (u != self && load > most)
+                {
+                    victim = u;
+                    most = load;
+                }
+            }
+            if (victim < 0)
+                return false;
+
+            fate_steal_deque& d = deques[victim];
+            std::lock_guard<std::mutex> lk(d.lock);
+            if (d.tasks.empty())
+                continue;
+            *k = d.tasks.back();
+            d.tasks.pop_back();
+            d.load -= (uint64_t)tasks[*k].cost;
+            g_fate_stats.stolen_tasks.fetch_add(1, memory_order_relaxed);
+            return true;
+        }
+    };
+
+    /* as in powm_avx_parallel: a one-node call on a multi-node host still binds */
+    const bool bind = fate_numa_nodes() > 1;
+    auto worker = [&](int t) {
+        int node = t % nodes;
+        fate_bind_node(bind ? node : -1);
+
+        fate_mb_workspace ws;
+        fate_ws_init(&ws, bind ? node : -1);
+
+        int k;
+        while (take(t, &k) || steal(t, &k))
+            failed += fate_steal_run_task(tasks[k], fb, taskStatus.data(), &ws);
+
+        fate_ws_release(&ws);
+    };
+
+    /* bound workers all run on pool threads, the caller's affinity stays as it was */
+    vector<thread> pool;
+    for (int t = bind ? 0 : 1; t < threads; t++)
+        pool.emplace_back(worker, t);
+    if (!bind)
+        worker(0);
+    for (auto& th : pool)
+        th.join();
+
+    for (int a = 0; a < 4; a++)
+    {
+        for (int j = 0; j < num; j++)
+        {
+            mpz_swap(fb[a].bigint[j], orig[a]->bigint[order[j]]);
+            mpz_clear(fb[a].bigint[j]);
+        }
+        free(fb[a].bigint);
+    }
+    if (status)
+        for (int j = 0; j < num; j++)
+            status[order[j]] = taskStatus[j];
+
+    fate_stats_maybe_dump();
+
+    return failed;
+}
+
+/*! Every element goes to the multi-buffer engine at one size, and only the last batch may be short */
+static bool fate_job_uniform(fate_bignum* b, fate_bignum* e, fate_bignum* m, int num)
+{
+    if (num == 0)
+        return true;
+    const fate_tune_entry* tune = fate_tune_lookup(m->bigint[0]);
+    int bits = fate_steal_mb_bits(tune, b->bigint[0], e->bigint[0], m->bigint[0]);
+    if (bits == 0 || (tune && num % FATE_MB_LANES != 0 && num % FATE_MB_LANES < tune->mb_min_lanes))
+        return false;
+    for (int i = 1; i < num; i++)
+        if (mpz_sizeinbase(m->bigint[i], 2) != (size_t)bits || !CheckMbOperands(b->bigint[i], e->bigint[i], m->bigint[i]))
+            return false;
+    return true;
+}
+
+/*
+ * Parallel powm_avx. The job is cut into 8-lane batches and every batch is
+ * sharded to the NUMA node holding its operands. Workers are pinned to a
+ * node, keep their key contexts and scratch in node-local arenas, drain the
+ * shard of their own node first and only then help with the other shards.
+ * Jobs that mix backends go to the work-stealing scheduler instead.
+ */
+int powm_avx_parallel(fate_bignum* res, fate_bignum* b, fate_bignum* e, fate_bignum* m, int num, int* status,
+                      const fate_parallel_opts* opts)
+{
+    assert(res->ismalloc == 1);
+    assert(b->ismalloc == 1);
+    assert(e->ismalloc == 1);
+    assert(m->ismalloc == 1);
+
+    assert(res->num == b->num);
+    assert(e->num == b->num);
+    assert(m->num == b->num);
+
+    if (fate_cache_active())
+        return fate_cache_run(res, b, e, m, num, status, [opts](fate_bignum* r, fate_bignum* x, fate_bignum* y,
+                                                                fate_bignum* z, int n, int* st) {
+            return powm_avx_parallel(r, x, y, z, n, st, opts);
+        });
+
+    if (!fate_job_uniform(b, e, m, num))
+        return powm_avx_steal(res, b, e, m, num, status, opts);
+
+    const int buf = FATE_MB_LANES;
+
+    int nodes = fate_numa_nodes();
+    if (opts && opts->numa_nodes > 0 && opts->numa_nodes < nodes)
+        nodes = opts->numa_nodes;
+    /* on a multi-node host even a single-node call binds, that is what confines it to one socket */
+    const bool bind = fate_numa_nodes() > 1;
+    int threads = opts && opts->threads > 0 ? opts->threads : (int)std::thread::hardware_concurrency();
+    if (threads < 1)
+        threads = 1;
+
+    int batches = (num + buf - 1) / buf;
+    if (threads > batches)
+        threads = batches > 0 ? batches : 1;
+
+    g_fate_stats.ops.fetch_add(num, memory_order_relaxed);
+
+    /* Shard the batches by the node of their first base operand */
+    vector<vector<int>> shard(nodes);
+    for (int k = 0; k < batches; k++)
+    {
+        int node = fate_node_of(b->bigint[k * buf]->_mp_d);
+        shard[node < 0 ? k % nodes : node % nodes].push_back(k);
+    }
+
+    vector<atomic<int>> next(nodes);
+    for (int n = 0; n < nodes; n++)
+        next[n] = 0;
+
+    int* laneStatus = status ? status : (int*)malloc(sizeof(int) * (num > 0 ? num : 1));
+    atomic<int> failed(0);
+
+    auto worker = [&](int node) {
+        fate_bind_node(bind ? node : -1);
+
+        fate_mb_workspace ws;
+        fate_ws_init(&ws, bind ? node : -1);
+
+        for (int step = 0; step < nodes; step++)
+        {
+            int n = (node + step) % nodes;
+            for (int idx = next[n]++; idx < (int)shard[n].size(); idx = next[n]++)
+            {
+                int i = shard[n][idx] * buf;
+                int lanes = num - i < buf ? num - i : buf;
+                if (step > 0)
+                    g_fate_stats.remote_batches.fetch_add(1, memory_order_relaxed);
+                failed += powm_tuned_batch(res->bigint + i, b->bigint + i, e->bigint + i, m->bigint + i, lanes,
+                                           laneStatus + i, &ws);
+            }
+        }
+
+        fate_ws_release(&ws);
+    };
+
+    /* bound workers all run on pool threads, so the caller's affinity and memory policy stay as they were */
+    vector<thread> pool;
+    for (int t = bind ? 0 : 1; t < threads; t++)
+        pool.emplace_back(worker, t % nodes);
+    if (!bind)
+        worker(0);
+    for (auto& th : pool)
+        th.join();
+
+    if (status == NULL)
+        free(laneStatus);
+
+    fate_stats_maybe_dump();
+
+    return failed;
+}
+
+
+/*================================================ AUTOTUNE ================================================*/
+
+#define FATE_TUNE_PROFILE "fate_powm.tune"
+
+static const char* fate_tune_path(const char* path)
+{
+    if (path && *path)
+        return path;
+    const char* env = getenv("FATE_TUNE_PROFILE");
+    return env && *env ? env : FATE_TUNE_PROFILE;
+}
+
+static void fate_tune_write(FILE* fp, const fate_tune_entry* tune)
+{
+    fprintf(fp, "# fate_powm autotune profile, regenerate with ./example tune\n");
+    for (int k = 0; k < FATE_TUNE_SIZES; k++)
+    {
+        fprintf(fp, "%d.mb_min_lanes=%d\n", tune[k].bits, tune[k].mb_min_lanes);
+        fprintf(fp, "%d.mt_min=%d\n", tune[k].bits, tune[k].mt_min);
+        fprintf(fp, "%d.threads=%d\n", tune[k].bits, tune[k].threads);
+        fprintf(fp, "%d.shared_exp=%d\n", tune[k].bits, tune[k].shared_exp);
+        fprintf(fp, "%d.gmp_ns=%d\n", tune[k].bits, tune[k].gmp_ns);
+        fprintf(fp, "%d.mb_ns=%d\n", tune[k].bits, tune[k].mb_ns);
+    }
+}
+
+static int fate_tune_read(const char* path)
+{
+    FILE* fp = fopen(fate_tune_path(path), "r");
+    if (fp == NULL)
+        return -1;
+
+    fate_tune_entry tune[FATE_TUNE_SIZES];
+    for (int k = 0; k < FATE_TUNE_SIZES; k++)
+        tune[k] = { g_fate_tune[k].bits, 1, 0, 1, 0, 0, 0 };
+
+    char line[128];
+    while (fgets(line, sizeof(line), fp))
+    {
+        int bits, value;
+        char key[32];
+        if (line[0] == '#' || sscanf(line, "%d.%31[a-z_]=%d", &bits, key, &value) != 3)
+            continue;
+        for (int k = 0; k < FATE_TUNE_SIZES; k++)
+        {
+            if (tune[k].bits != bits)
+                continue;
+            if (strcmp(key, "mb_min_lanes") == 0 && value >= 1)
+                tune[k].mb_min_lanes = value;
+            else if (strcmp(key, "mt_min") == 0 && value >= 0)
+                tune[k].mt_min = value;
+            else if (strcmp(key, "threads") == 0 && value >= 1)
+                tune[k].threads = value;
+            else if (strcmp(key, "shared_exp") == 0)
+                tune[k].shared_exp = value != 0;
+            else if (strcmp(key, "gmp_ns") == 0 && value >= 0)
+                tune[k].gmp_ns = value;
+            else if (strcmp(key, "mb_ns") == 0 && value >= 0)
+                tune[k].mb_ns = value;
+        }
+    }
+    fclose(fp);
+
+    memcpy(g_fate_tune, tune, sizeof(tune));
+    g_fate_tune_loaded.store(true, memory_order_release);
+
+    return 0;
+}
+
+template <typename F>
+static uint64_t fate_tune_best(F run, int reps)
+{
+    uint64_t best = UINT64_MAX;
+    for (int r = 0; r < reps; r++)
+    {
+        uint64_t t0 = fate_now_ns();
+        run();
+        uint64_t t = fate_now_ns() - t0;
+        if (t < best)
+            best = t;
+    }
+    return best;
+}
+
+/* odd moduli with the top bit set, full-size exponents, bases below the moduli */
+static void fate_tune_operands(mpz_t* b, mpz_t* e, mpz_t* m, int bits, int num)
+{
+    int limbs = bits / 64;
+    vector<uint64_t> w(limbs);
+    fate_rng* rng = fate_thread_rng();
+    for (int i = 0; i < num; i++)
+    {
+        fate_rng_bytes(rng, w.data(), w.size() * sizeof(uint64_t));
+        w[limbs - 1] |= 1ull << 63;
+        w[0] |= 1;
+        mpz_import(m[i], limbs, -1, sizeof(uint64_t), 0, 0, w.data());
+        fate_rng_bytes(rng, w.data(), w.size() * sizeof(uint64_t));
+        mpz_import(e[i], limbs, -1, sizeof(uint64_t), 0, 0, w.data());
+        fate_rng_bytes(rng, w.data(), w.size() * sizeof(uint64_t));
+        mpz_import(b[i], limbs, -1, sizeof(uint64_t), 0, 0, w.data());
+        mpz_mod(b[i], b[i], m[i]);
+    }
+}
+
+/* num elements in batches through `tune`, spread over `threads` threads */
+static void fate_tune_run(const fate_tune_entry* tune, mpz_t* res, mpz_t* b, mpz_t* e, mpz_t* m, int num, int threads)
+{
+    const int buf = FATE_MB_LANES;
+    auto worker = [&](int t) {
+        int status[buf];
+        for (int i = t * buf; i < num; i += threads * buf)
+        {
+            int lanes = num - i < buf ? num - i : buf;
+            powm_batch_with(tune, res + i, b + i, e + i, m + i, lanes, status);
+        }
+    };
+
+    vector<thread> pool;
+    for (int t = 1; t < threads; t++)
+        pool.emplace_back(worker, t);
+    worker(0);
+    for (auto& th : pool)
+        th.join();
+}
+
+static void fate_tune_measure(fate_tune_entry* tune, int hw)
+{
+    const int buf = FATE_MB_LANES;
+    const int reps = 3;
+    const int maxNum = hw > 1 ? buf * hw * 4 : buf;
+
+    mpz_t* res = (mpz_t*)malloc(sizeof(mpz_t) * maxNum * 4);
+    mpz_t* b = res + maxNum;
+    mpz_t* e = b + maxNum;
+    mpz_t* m = e + maxNum;
+    for (int i = 0; i < maxNum * 4; i++)
+        mpz_init(res[i]);
+    fate_tune_operands(b, e, m, tune->bits, maxNum);
+
+    /* per element cost of mpz_powm */
+    uint64_t gmp = fate_tune_best([&] {
+        for (int j = 0; j < buf; j++)
+            mpz_powm(res[j], b[j], e[j], m[j]);
+    }, reps) / buf;
+    tune->gmp_ns = (int)gmp;
+
+    /* smallest fill from which one multi-buffer call is cheaper than the same lanes through mpz_powm */
+    tune->shared_exp = 0;
+    tune->mb_min_lanes = buf + 1;
+    for (int lanes = 1; lanes <= buf; lanes++)
+    {
+        int status[buf];
+        bool accepted = true;
+        uint64_t mb = fate_tune_best([&] {
+            powm_mb_batch(res, b, e, m, lanes, status);
+        }, reps);
+        for (int j = 0; j < lanes; j++)
+            accepted = accepted && status[j] == FATE_STS_MB;
+        if (!accepted)
+            break;
+        if (mb <= gmp * lanes)
+        {
+            tune->mb_min_lanes = lanes;
+            break;
+        }
+    }
+
+    /* one full call, the work-stealing scheduler prices its batches with it */
+    tune->mb_ns = 0;
+    if (tune->mb_min_lanes <= buf)
+    {
+        int status[buf];
+        tune->mb_ns = (int)fate_tune_best([&] { powm_mb_batch(res, b, e, m, buf, status); }, reps);
+    }
+
+    /* smallest call size from which the threads win by at least 10% */
+    tune->threads = hw;
+    tune->mt_min = 0;
+    for (int num = 2 * buf; hw > 1 && num <= maxNum; num *= 2)
+    {
+        uint64_t single = fate_tune_best([&] { fate_tune_run(tune, res, b, e, m, num, 1); }, reps);
+        uint64_t multi = fate_tune_best([&] { fate_tune_run(tune, res, b, e, m, num, hw); }, reps);
+        if (multi * 10 < single * 9)
+        {
+            tune->mt_min = num;
+            break;
+        }
+    }
+
+    /* one exponent and modulus for a full batch: lockstep kernel against the multi-buffer call */
+    for (int j = 1; j < buf; j++)
+    {
+        mpz_set(e[j], e[0]);
+        mpz_set(m[j], m[0]);
+    }
+    int status[buf];
+    uint64_t general = tune->mb_min_lanes > buf ? gmp * buf
+                                                : fate_tune_best([&] { powm_mb_batch(res, b, e, m, buf, status); }, reps);
+    uint64_t shared = fate_tune_best([&] { powm_shared_batch(res, b, e, m, buf, status); }, reps);
+    tune->shared_exp = shared < general;
+
+    for (int i = 0; i < maxNum * 4; i++)
+        mpz_clear(res[i]);
+    free(res);
+}
+
+static int fate_autotune_locked(const char* path)
+{
+    int hw = (int)std::thread::hardware_concurrency();
+    if (hw < 1)
+        hw = 1;
+
+    g_fate_tuning = true;
+    fate_tune_entry tune[FATE_TUNE_SIZES];
+    for (int k = 0; k < FATE_TUNE_SIZES; k++)
+    {
+        tune[k].bits = g_fate_tune[k].bits;
+        fate_tune_measure(&tune[k], hw);
+    }
+    g_fate_tuning = false;
+
+    memcpy(g_fate_tune, tune, sizeof(tune));
+    g_fate_tune_loaded.store(true, memory_order_release);
+
+    FILE* fp = fopen(fate_tune_path(path), "w");
+    if (fp == NULL)
+        return -1;
+    fate_tune_write(fp, tune);
+    fclose(fp);
+
+    return 0;
+}
+
+/*
+ * First engine call: load the profile ($FATE_TUNE_PROFILE or ./fate_powm.tune),
+ * and tune the host when there is none and FATE_AUTOTUNE=1 is set.
+ */
+static void fate_tune_startup()
+{
+    if (fate_tune_read(NULL) == 0)
+        return;
+    const char* env = getenv("FATE_AUTOTUNE");
+    if (env && atoi(env) > 0)
+        fate_autotune_locked(NULL);
+}
+
+int fate_tune_load(const char* path)
+{
+    std::call_once(g_fate_tune_once, [] {});
+    return fate_tune_read(path);
+}
+
+int fate_autotune(const char* path)
+{
+    std::call_once(g_fate_tune_once, [] {});
+    return fate_autotune_locked(path);
+}
+
+void fate_tune_print(FILE* fp)
+{
+    fate_tune_write(fp, g_fate_tune);
+}
+
+/*================================================ TEXT ================================================*/
+/*
+ * Hex and decimal strings <-> the fixed-width limb arrays of the C API.
+ * With AVX2, hex runs 32 digits (two limbs) per step both ways, and decimal
+ * strings are cut into 16-digit chunks converted with multiply-add
+ * reductions. Longer decimal numbers are converted divide and conquer:
+ * the upper and lower halves are parsed separately and joined as
+ * hi * 10^(16 * 2^j) + lo, and printed by splitting with one division by
+ * such a power down to mpn_get_str-sized pieces, so the cost follows mpn
+ * multiplication instead of growing quadratically with the digit count.
+ */
+
+#define FATE_DEC_CHUNK 16                     // decimal digits per chunk, 10^16 < 2^64
+#define FATE_DEC_CHUNK_BASE 10000000000000000ULL
+#define FATE_DEC_DC_DIGITS 256                // longer strings are split
+#define FATE_DEC_DC_LIMBS 32                  // larger values are split
+
+static const char fate_hex_digits[] = "0123456789abcdef";
+
+static inline int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+/*! 16 hex digits, most significant first, into one limb; false on a bad digit */
+static inline bool hex_limb(const char* s, int n, uint64_t* out)
+{
+    uint64_t v = 0;
+    int bad = 0;
+    for (int k = 0; k < n; k++)
+    {
+        int d = hex_value(s[k]);
+        bad |= d;
+        v = v << 4 | (uint64_t)(d & 15);
+    }
+    *out = v;
+    return bad >= 0;
+}
+
+#ifdef __AVX2__
+/*! 32 hex digits -> limbs hi = digits 0..15, lo = digits 16..31 */
+static inline bool hex_limbs2(const char* s, uint64_t* hi, uint64_t* lo)
+{
+    __m256i c = _mm256_loadu_si256((const __m256i*)s);
+    __m256i dig = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+    __m256i let = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    __m256i isDig = _mm256_cmpeq_epi8(_mm256_min_epu8(dig, _mm256_set1_epi8(9)), dig);
+    __m256i isLet = _mm256_cmpeq_epi8(_mm256_min_epu8(let, _mm256_set1_epi8(5)), let);
+    if (_mm256_movemask_epi8(_mm256_or_si256(isDig, isLet)) != -1)
+        return false;
+    __m256i val = _mm256_blendv_epi8(_mm256_add_epi8(let, _mm256_set1_epi8(10)), dig, isDig);
+
+    /* digit pairs -> bytes, 8 per 128-bit half, in string order */
+    __m256i bytes = _mm256_maddubs_epi16(val, _mm256_set1_epi16(0x0110));
+    bytes = _mm256_packus_epi16(bytes, bytes);
+    *hi = __builtin_bswap64((uint64_t)_mm256_extract_epi64(bytes, 0));
+    *lo = __builtin_bswap64((uint64_t)_mm256_extract_epi64(bytes, 2));
+    return true;
+}
+
+/*! Limbs hi, lo -> 32 hex digits */
+static inline void hex_chars2(char* out, uint64_t hi, uint64_t lo)
+{
+    __m128i be = _mm_set_epi64x((long long)__builtin_bswap64(lo), (long long)__builtin_bswap64(hi));
+    __m256i w = _mm256_cvtepu8_epi16(be);
+    __m256i nib = _mm256_or_si256(_mm256_srli_epi16(w, 4), _mm256_slli_epi16(_mm256_and_si256(w, _mm256_set1_epi16(15)), 8));
+    __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)fate_hex_digits));
+    _mm256_storeu_si256((__m256i*)out, _mm256_shuffle_epi8(table, nib));
+}
+
+/*! 16 decimal digits -> value; false on a bad digit */
+static inline bool dec_chunk16(const char* s, uint64_t* out)
+{
+    __m128i d = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)s), _mm_set1_epi8('0'));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d)) != 0xffff)
+        return false;
+    __m128i t = _mm_maddubs_epi16(d, _mm_set1_epi16(0x010a));              // 2 digits
+    t = _mm_madd_epi16(t, _mm_set1_epi32(0x00010064));                      // 4 digits
+    t = _mm_packus_epi32(t, t);
+    t = _mm_madd_epi16(t, _mm_set1_epi32(0x00012710));                      // 8 digits
+    *out = (uint64_t)(uint32_t)_mm_cvtsi128_si32(t) * 100000000 + (uint32_t)_mm_extract_epi32(t, 1);
+    return true;
+}
+#else
+static inline bool dec_chunk16(const char* s, uint64_t* out)
+{
+    uint64_t v = 0;
+    unsigned bad = 0;
+    for (int k = 0; k < 16; k++)
+    {
+        unsigned d = (unsigned)(s[k] - '0');
+        bad |= d > 9;
+        v = v * 10 + d;
+    }
+    *out = v;
+    return !bad;
+}
+#endif
+
+/*! Leading "0x" and zeros stripped from a hex string, NULL on an empty one */
+static const char* hex_trim(const char* s, size_t* n)
+{
+    if (*n >= 2 && s[0] == '0' && (s[1] | 0x20) == 'x')
+    {
+        s += 2;
+        *n -= 2;
+    }
+    if (*n == 0)
+        return NULL;
+    while (*n > 1 && *s == '0')
+    {
+        s++;
+        (*n)--;
+    }
+    return s;
+}
+
+/*! One hex string into `limbs` limbs */
+static bool hex_parse_one(uint64_t* out, const char* s, size_t n, int limbs)
+{
+    s = hex_trim(s, &n);
+    if (s == NULL || n > (size_t)16 * limbs)
+        return false;
+
+    memset(out, 0, sizeof(uint64_t) * limbs);
+    size_t k = 0; // limbs written
+#ifdef __AVX2__
+    for (; n >= 32; n -= 32, k += 2)
+        if (!hex_limbs2(s + n - 32, &out[k + 1], &out[k]))
+            return false;
+#endif
+    for (; n >= 16; n -= 16, k++)
+        if (!hex_limb(s + n - 16, 16, &out[k]))
+            return false;
+
+    return n == 0 || hex_limb(s, (int)n, &out[k]);
+}
+
+/*! One element as lowercase hex without leading zeros */
+static void hex_format_one(char* out, const uint64_t* in, int limbs)
+{
+    int top = limbs - 1;
+    while (top > 0 && in[top] == 0)
+        top--;
+
+    /* the top limb without leading zeros, then 16 digits per limb */
+    int lead = in[top] ? 16 - __builtin_clzll(in[top]) / 4 : 1;
+    for (int k = lead - 1; k >= 0; k--)
+        *out++ = fate_hex_digits[(in[top] >> (4 * k)) & 15];
+    int k = top - 1;
+#ifdef __AVX2__
+    for (; k >= 1; k -= 2, out += 32)
+        hex_chars2(out, in[k], in[k - 1]);
+#endif
+    for (; k >= 0; k--)
+        for (int j = 15; j >= 0; j--)
+            *out++ = fate_hex_digits[(in[k] >> (4 * j)) & 15];
+    *out = 0;
+}
+
+/*! pow[j] = 10^(16 * 2^j) for the divide and conquer steps up to `digits` digits */
+static void dec_powers(vector<vector<mp_limb_t>>& pow, size_t digits)
+{
+    if (pow.empty())
+        pow.push_back(vector<mp_limb_t>(1, FATE_DEC_CHUNK_BASE));
+    while (((size_t)FATE_DEC_CHUNK << pow.size()) < digits)
+    {
+        const vector<mp_limb_t>& p = pow.back();
+        vector<mp_limb_t> sq(2 * p.size());
+        mpn_sqr(sq.data(), p.data(), p.size());
+        while (sq.back() == 0)
+            sq.pop_back();
+        pow.push_back(sq);
+    }
+}
+
+/*! rp = value of s[0..n), at least n / 19 + 2 limbs of room; returns the normalized size, -1 on a bad digit */
+static mp_size_t dec_parse_dc(mp_limb_t* rp, const char* s, size_t n, const vector<vector<mp_limb_t>>& pow)
+{
+    if (n <= FATE_DEC_DC_DIGITS)
+    {
+        mp_size_t size = 0;
+        size_t head = n % FATE_DEC_CHUNK;
+        uint64_t v = 0;
+        for (size_t k = 0; k < head; k++)
+        {
+            unsigned d = (unsigned)(s[k] - '0');
+            if (d > 9)
+                return -1;
+            v = v * 10 + d;
+        }
+        if (v)
+            rp[size++] = v;
+        for (size_t k = head; k < n; k += FATE_DEC_CHUNK)
+        {
+            if (!dec_chunk16(s + k, &v))
+                return -1;
+            mp_limb_t carry = size ? mpn_mul_1(rp, rp, size, FATE_DEC_CHUNK_BASE) : 0;
+            if (carry)
+                rp[size++] = carry;
+            if (size == 0)
+            {
+                if (v)
+                    rp[size++] = v;
+            }
+            else if (mpn_add_1(rp, rp, size, v))
+                rp[size++] = 1;
+        }
+        return size;
+    }
+
+    int j = 0;
+    while (((size_t)FATE_DEC_CHUNK << (j + 1)) < n)
+        j++;
+    size_t r = (size_t)FATE_DEC_CHUNK << j;
+
+    vector<mp_limb_t> hi((n - r) / 19 + 2), lo(r / 19 + 2);
+    mp_size_t hn = dec_parse_dc(hi.data(), s, n - r, pow);
+    mp_size_t ln = hn < 0 ? -1 : dec_parse_dc(lo.data(), s + n - r, r, pow);
+    if (ln < 0)
+        return -1;
+    if (hn == 0)
+    {
+        mpn_copyi(rp, lo.data(), ln);
+        return ln;
+    }
+
+    const vector<mp_limb_t>& p = pow[j];
+    mp_size_t pn = (mp_size_t)p.size(), size = hn + pn;
+    if (hn >= pn)
+        mpn_mul(rp, hi.data(), hn, p.data(), pn);
+    else
+        mpn_mul(rp, p.data(), pn, hi.data(), hn);
+    if (ln && mpn_add(rp, rp, size, lo.data(), ln))
+        rp[size++] = 1;
+    while (size > 0 && rp[size - 1] == 0)
+        size--;
+    return size;
+}
+
+/*! One decimal string into `limbs` limbs */
+static bool dec_parse_one(uint64_t* out, const char* s, size_t n, int limbs, const vector<vector<mp_limb_t>>& pow)
+{
+    while (n > 1 && *s == '0')
+    {
+        s++;
+        n--;
+    }
+    /* 10^(20 limbs) > 2^(64 limbs), longer strings cannot fit */
+    if (n == 0 || n > (size_t)20 * limbs)
+        return false;
+
+    vector<mp_limb_t> rp(n / 19 + 2);
+    mp_size_t size = dec_parse_dc(rp.data(), s, n, pow);
+    if (size < 0 || size > limbs)
+        return false;
+    memset(out, 0, sizeof(uint64_t) * limbs);
+    mpn_copyi((mp_limb_t*)out, rp.data(), size);
+    return true;
+}
+
+/*
+ * x[0..xn) (destroyed) as decimal at out; width > 0 pads with zeros to
+ * exactly width digits, width 0 prints no leading zeros. Returns the end.
+ */
+static char* dec_format_dc(char* out, mp_limb_t* x, mp_size_t xn, size_t width, const vector<vector<mp_limb_t>>& pow)
+{
+    while (xn > 0 && x[xn - 1] == 0)
+        xn--;
+
+    if (xn <= FATE_DEC_DC_LIMBS)
+    {
+        /* mpn_get_str's base case yields digit values, turned into characters in one pass */
+        unsigned char digit[20 * FATE_DEC_DC_LIMBS + 1];
+        size_t digits = xn ? mpn_get_str(digit, 10, x, xn) : 0;
+        size_t pad = width > digits ? width - digits : (width == 0 && digits == 0 ? 1 : 0);
+        memset(out, '0', pad);
+        out += pad;
+        for (size_t k = 0; k < digits; k++)
+            out[k] = (char)(digit[k] + '0');
+        return out + digits;
+    }
+
+    /* the largest power with at most half the limbs of x */
+    int j = 0;
+    while (j + 1 < (int)pow.size() && (mp_size_t)pow[j + 1].size() * 2 <= xn + 1)
+        j++;
+    const vector<mp_limb_t>& p = pow[j];
+    mp_size_t pn = (mp_size_t)p.size();
+    size_t r = (size_t)FATE_DEC_CHUNK << j;
+
+    vector<mp_limb_t> q(xn - pn + 1), rem(pn);
+    mpn_tdiv_qr(q.data(), rem.data(), 0, x, xn, p.data(), pn);
+    out = dec_format_dc(out, q.data(), xn - pn + 1, width > r ? width - r : 0, pow);
+    return dec_format_dc(out, rem.data(), pn, r, pow);
+}
+
+/*! Parse or format every element, marking failures in status */
+template <typename One>
+static int fate_text_batch(int num, int* status, One one)
+{
+    int failed = 0;
+    for (int i = 0; i < num; i++)
+    {
+        bool ok = one(i);
+        failed += !ok;
+        if (status)
+            status[i] = ok ? FATE_STS_OK : FATE_STS_ERR;
+    }
+    return failed;
+}
+
+int fate_parse_hex(uint64_t* out, const char* const* str, const size_t* len, int limbs, int num, int* status)
+{
+    if (out == NULL || str == NULL || limbs <= 0 || num < 0)
+        return -1;
+
+    return fate_text_batch(num, status, [&](int i) {
+        uint64_t* o = out + (size_t)i * limbs;
+        bool ok = str[i] != NULL && hex_parse_one(o, str[i], len ? len[i] : strlen(str[i]), limbs);
+        if (!ok)
+            memset(o, 0, sizeof(uint64_t) * limbs);
+        return ok;
+    });
+}
+
+int fate_parse_dec(uint64_t* out, const char* const* str, const size_t* len, int limbs, int num, int* status)
+{
+    if (out == NULL || str == NULL || limbs <= 0 || num < 0)
+        return -1;
+
+    vector<vector<mp_limb_t>> pow;
+    dec_powers(pow, (size_t)20 * limbs);
+    return fate_text_batch(num, status, [&](int i) {
+        uint64_t* o = out + (size_t)i * limbs;
+        bool ok = str[i] != NULL && dec_parse_one(o, str[i], len ? len[i] : strlen(str[i]), limbs, pow);
+        if (!ok)
+            memset(o, 0, sizeof(uint64_t) * limbs);
+        return ok;
+    });
+}
+
+int fate_format_hex(char* out, size_t stride, const uint64_t* in, int limbs, int num)
+{
+    if (out == NULL || in == NULL || limbs <= 0 || num < 0 || stride < FATE_HEX_CHARS(limbs))
+        return -1;
+
+    for (int i = 0; i < num; i++)
+        hex_format_one(out + stride * i, in + (size_t)i * limbs, limbs);
+    return 0;
+}
+
+int fate_format_dec(char* out, size_t stride, const uint64_t* in, int limbs, int num)
+{
+    if (out == NULL || in == NULL || limbs <= 0 || num < 0 || stride < FATE_DEC_CHARS(limbs))
+        return -1;
+
+    vector<vector<mp_limb_t>> pow;
+    dec_powers(pow, (size_t)20 * limbs);
+    vector<mp_limb_t> x(limbs);
+    for (int i = 0; i < num; i++)
+    {
+        mpn_copyi(x.data(), (const mp_limb_t*)in + (size_t)i * limbs, limbs);
+        *dec_format_dc(out + stride * i, x.data(), limbs, 0, pow) = 0;
+    }
+    return 0;
+}
+
+/*================================================ C API ================================================*/
+
+struct fate_job
+{
+    fate_ctx* ctx;
+    uint64_t* res;
+    const uint64_t *b, *e, *m;
+    int limbs;
+    int num;
+    int* status;
+    int result;
+    bool done;
+};
+
+struct fate_ctx
+{
+    fate_parallel_opts opts;
+    bool cache;                       // calls may use the result cache
+    std::mutex lock;
+    std::condition_variable wake;     // async worker: new job or stop
+    std::condition_variable finished; // fate_job_wait: a job completed
+    std::deque<fate_job*> queue;
+    bool stop;
+    std::thread worker;
+};
+
+/*! Limb arrays -> mpz_t, powm_avx_parallel, mpz_t -> limb arrays */
+static int fate_powm_limbs(const fate_parallel_opts* opts, bool cache, uint64_t* res, const uint64_t* b, const uint64_t* e,
+                           const uint64_t* m, int limbs, int num, int* status)
+{
+    if (res == NULL || b == NULL || e == NULL || m == NULL || limbs <= 0 || num < 0)
+        return -1;
+    if (num == 0)
+        return 0;
+
+    fate_bignum fb[4];
+    for (int k = 0; k < 4; k++)
+    {
+        fb[k].bigint = (mpz_t*)malloc(sizeof(mpz_t) * num);
+        fb[k].num = num;
+        fb[k].ismalloc = 1;
+        for (int i = 0; i < num; i++)
+            mpz_init2(fb[k].bigint[i], 64 * limbs);
+    }
+
+    uint64_t t0 = fate_now_ns();
+    for (int i = 0; i < num; i++)
+    {
+        size_t off = (size_t)i * limbs;
+        mpz_import(fb[1].bigint[i], limbs, -1, sizeof(uint64_t), 0, 0, b + off);
+        mpz_import(fb[2].bigint[i], limbs, -1, sizeof(uint64_t), 0, 0, e + off);
+        mpz_import(fb[3].bigint[i], limbs, -1, sizeof(uint64_t), 0, 0, m + off);
+    }
+    fate_stats_record(FATE_STAGE_CONVERT, fate_now_ns() - t0);
+
+    int failed;
+    if (cache)
+        failed = powm_avx_parallel(&fb[0], &fb[1], &fb[2], &fb[3], num, status, opts);
+    else
+    {
+        fate_cache_bypass bypass;
+        failed = powm_avx_parallel(&fb[0], &fb[1], &fb[2], &fb[3], num, status, opts);
+    }
+
+    t0 = fate_now_ns();
+    memset(res, 0, sizeof(uint64_t) * limbs * num);
+    for (int i = 0; i < num; i++)
+        mpz_export(res + (size_t)i * limbs, NULL, -1, sizeof(uint64_t), 0, 0, fb[0].bigint[i]);
+    fate_stats_record(FATE_STAGE_CONVERT, fate_now_ns() - t0);
+
+    for (int k = 0; k < 4; k++)
+    {
+        for (int i = 0; i < num; i++)
+            mpz_clear(fb[k].bigint[i]);
+        free(fb[k].bigint);
+    }
+
+    return failed;
+}
+
+/*! Asynchronous jobs of a context run one after another on its worker thread */
+static void fate_ctx_worker(fate_ctx* ctx)
+{
+    unique_lock<mutex> lk(ctx->lock);
+    for (;;)
+    {
+        ctx->wake.wait(lk, [ctx] { return ctx->stop || !ctx->queue.empty(); });
+        if (ctx->queue.empty())
+            return;
+
+        fate_job* job = ctx->queue.front();
+        ctx->queue.pop_front();
+        lk.unlock();
+
+        int result = fate_powm_limbs(&ctx->opts, ctx->cache, job->res, job->b, job->e, job->m, job->limbs, job->num, job->status);
+
+        lk.lock();
+        job->result = result;
+        job->done = true;
+        ctx->finished.notify_all();
+    }
+}
+
+fate_ctx* fate_ctx_create(const fate_ctx_opts* opts)
+{
+    fate_ctx* ctx = new (std::nothrow) fate_ctx;
+    if (ctx == NULL)
+        return NULL;
+
+    ctx->opts.threads = opts ? opts->threads : 0;
+    ctx->opts.numa_nodes = opts ? opts->numa_nodes : 0;
+    ctx->cache = opts && opts->cache;
+    ctx->stop = false;
+    ctx->worker = thread(fate_ctx_worker, ctx);
+
+    return ctx;
+}
+
+void fate_ctx_destroy(fate_ctx* ctx)
+{
+    if (ctx == NULL)
+        return;
+
+    {
+        lock_guard<mutex> lk(ctx->lock);
+        ctx->stop = true;
+    }
+    ctx->wake.notify_all();
+    ctx->worker.join();
+    delete ctx;
+}
+
+int fate_powm(fate_ctx* ctx, uint64_t* res, const uint64_t* b, const uint64_t* e, const uint64_t* m,
+              int limbs, int num, int* status)
+{
+    if (ctx == NULL)
+        return -1;
+
+    return fate_powm_limbs(&ctx->opts, ctx->cache, res, b, e, m, limbs, num, status);
+}
+
+fate_job* fate_powm_submit(fate_ctx* ctx, uint64_t* res, const uint64_t* b, const uint64_t* e, const uint64_t* m,
+                           int limbs, int num, int* status)
+{
+    if (ctx == NULL)
+        return NULL;
+
+    fate_job* job = new (std::nothrow) fate_job;
+    if (job == NULL)
+        return NULL;
+
+    *job = fate_job{ ctx, res, b, e, m, limbs, num, status, 0, false };
+    {
+        lock_guard<mutex> lk(ctx->lock);
+        ctx->queue.push_back(job);
+    }
+    ctx->wake.notify_one();
+
+    return job;
+}
+
+int fate_job_done(fate_job* job)
+{
+    lock_guard<mutex> lk(job->ctx->lock);
+    return job->done ? 1 : 0;
+}
+
+int fate_job_wait(fate_job* job)
+{
+    if (job == NULL)
+        return -1;
+
+    int result;
+    {
+        unique_lock<mutex> lk(job->ctx->lock);
+        job->ctx->finished.wait(lk, [job] { return job->done; });
+        result = job->result;
+    }
+    delete job;
+
+    return result;
+}
+
+/*================================================ INGESTION QUEUE ================================================*/
+/*
+ * Bounded multi-producer/multi-consumer ring (Vyukov) in front of the
+ * batched engine. Every cell carries a sequence number: seq == pos means
+ * free for the producer of position pos, seq == pos + 1 means filled for
+ * the consumer of pos. Producers claim one position with a CAS on tail and
+ * copy their operands into the cell's preallocated limbs; batch formers
+ * claim up to 8 consecutive filled cells with one CAS on head. No mutex on
+ * either side. A former waits up to linger_us for a full batch before it
+ * takes a partial one.
+ */
+
+struct alignas(64) fate_qcell
+{
+    atomic<uint64_t> seq;
+    fate_op* op;
+    uint64_t pushed_ns;    // published at, for FATE_STAGE_BATCH_FILL
+};
+
+struct fate_queue
+{
+    alignas(64) atomic<uint64_t> tail; // next position to fill
+    alignas(64) atomic<uint64_t> head; // next position to consume
+    alignas(64) atomic<uint64_t> push_retries;
+    atomic<uint64_t> pop_retries;
+    atomic<uint64_t> full;
+    atomic<uint64_t> batches;
+    atomic<uint64_t> popped;
+    atomic<bool> stop;
+    uint64_t mask;
+    int limbs;
+    int linger_us;
+    fate_qcell* cells;
+    uint64_t* operands;                // cell i: b, e, m at [3 * limbs * i, 3 * limbs * (i + 1))
+    vector<thread> formers;
+};
+
+static inline void fate_cpu_relax()
+{
+    _mm_pause();
+}
+
+/*! Claim between min and max consecutive filled cells, returns how many with their first position in *first */
+static int fate_queue_claim(fate_queue* q, int min, int max, uint64_t* first)
+{
+    uint64_t pos = q->head.load(memory_order_relaxed);
+    for (;;)
+    {
+        int k = 0;
+        while (k < max && q->cells[(pos + k) & q->mask].seq.load(memory_order_acquire) == pos + k + 1)
+            k++;
+        if (k < min || k == 0)
+        {
+            uint64_t now = q->head.load(memory_order_relaxed);
+            if (now == pos)
+                return 0;
+            pos = now;
+            continue;
+        }
+        /* head unchanged: nobody claimed pos, so the k cells are still filled */
+        if (q->head.compare_exchange_weak(pos, pos + k, memory_order_relaxed))
+        {
+            *first = pos;
+            return k;
+        }
+        q->pop_retries.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+/*! Batch former: claim cells, run them as one batch, complete the producers' records */
+static void fate_queue_former(fate_queue* q)
+{
+    const int buf = FATE_MB_LANES;
+    const int limbs = q->limbs;
+    mpz_t res[buf], b[buf], e[buf], m[buf];
+    for (int j = 0; j < buf; j++)
+    {
+        mpz_init2(res[j], 64 * limbs);
+        mpz_init2(b[j], 64 * limbs);
+        mpz_init2(e[j], 64 * limbs);
+        mpz_init2(m[j], 64 * limbs);
+    }
+    fate_mb_workspace ws;
+    fate_ws_init(&ws, -1);
+
+    fate_op* ops[buf];
+    int status[buf];
+    uint64_t lingerStart = 0;
+    int idle = 0;
+    for (;;)
+    {
+        bool stopping = q->stop.load(memory_order_acquire);
+        uint64_t now = fate_now_ns();
+        bool lingered = lingerStart && now - lingerStart >= (uint64_t)q->linger_us * 1000;
+
+        uint64_t first;
+        int k = fate_queue_claim(q, stopping || lingered ? 1 : buf, buf, &first);
+        if (k == 0)
+        {
+            bool empty = q->tail.load(memory_order_acquire) == q->head.load(memory_order_relaxed);
+            if (empty && stopping)
+                break;
+            if (empty)
+            {
+                lingerStart = 0;
+                if (++idle > 64)
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                else
+                    std::this_thread::yield();
+            }
+            else
+            {
+                if (lingerStart == 0)
+                    lingerStart = now;
+                fate_cpu_relax();
+            }
+            continue;
+        }
+        lingerStart = 0;
+        idle = 0;
+
+        uint64_t t0 = fate_now_ns();
+        uint64_t oldest = q->cells[first & q->mask].pushed_ns; // cells are claimed in publishing order
+        for (int j = 0; j < k; j++)
+        {
+            uint64_t pos = first + j;
+            fate_qcell* cell = &q->cells[pos & q->mask];
+            const uint64_t* src = q->operands + (size_t)3 * limbs * (pos & q->mask);
+            mpz_import(b[j], limbs, -1, sizeof(uint64_t), 0, 0, src);
+            mpz_import(e[j], limbs, -1, sizeof(uint64_t), 0, 0, src + limbs);
+            mpz_import(m[j], limbs, -1, sizeof(uint64_t), 0, 0, src + 2 * limbs);
+            ops[j] = cell->op;
+            cell->seq.store(pos + q->mask + 1, memory_order_release);
+        }
+        fate_stats_record(FATE_STAGE_CONVERT, fate_now_ns() - t0);
+        fate_stats_record(FATE_STAGE_BATCH_FILL, fate_now_ns() - oldest);
+
+        g_fate_stats.ops.fetch_add(k, memory_order_relaxed);
+        powm_tuned_batch(res, b, e, m, k, status, &ws);
+
+        for (int j = 0; j < k; j++)
+        {
+            memset(ops[j]->res, 0, sizeof(uint64_t) * limbs);
+            if (status[j] != FATE_STS_ERR)
+                mpz_export(ops[j]->res, NULL, -1, sizeof(uint64_t), 0, 0, res[j]);
+            ops[j]->status = status[j];
+            void (*complete)(fate_op*) = ops[j]->complete;
+            __atomic_store_n(&ops[j]->done, 1, __ATOMIC_RELEASE);
+            if (complete)
+                complete(ops[j]);
+        }
+        q->batches.fetch_add(1, memory_order_relaxed);
+        q->popped.fetch_add(k, memory_order_relaxed);
+    }
+
+    fate_ws_release(&ws);
+    for (int j = 0; j < buf; j++)
+    {
+        mpz_clear(res[j]);
+        mpz_clear(b[j]);
+        mpz_clear(e[j]);
+        mpz_clear(m[j]);
+    }
+}
+
+fate_queue* fate_queue_create(const fate_queue_opts* opts)
+{
+    if (opts == NULL || opts->limbs <= 0)
+        return NULL;
+
+    uint64_t capacity = 1024;
+    while (capacity < (uint64_t)opts->capacity)
+        capacity <<= 1;
+    int formers = opts->formers > 0 ? opts->formers : 1;
+
+    fate_queue* q = new (std::nothrow) fate_queue;
+    if (q == NULL)
+        return NULL;
+    q->cells = new (std::nothrow) fate_qcell[capacity];
+    q->operands = (uint64_t*)malloc(sizeof(uint64_t) * 3 * opts->limbs * capacity);
+    if (q->cells == NULL || q->operands == NULL)
+    {
+        delete[] q->cells;
+        free(q->operands);
+        delete q;
+        return NULL;
+    }
+
+    for (uint64_t i = 0; i < capacity; i++)
+        q->cells[i].seq.store(i, memory_order_relaxed);
+    q->tail = 0;
+    q->head = 0;
+    q->push_retries = 0;
+    q->pop_retries = 0;
+    q->full = 0;
+    q->batches = 0;
+    q->popped = 0;
+    q->stop = false;
+    q->mask = capacity - 1;
+    q->limbs = opts->limbs;
+    q->linger_us = opts->linger_us > 0 ? opts->linger_us : 50;
+    for (int t = 0; t < formers; t++)
+        q->formers.emplace_back(fate_queue_former, q);
+
+    return q;
+}
+
+void fate_queue_destroy(fate_queue* q)
+{
+    if (q == NULL)
+        return;
+
+    q->stop.store(true, memory_order_release);
+    for (auto& th : q->formers)
+        th.join();
+    delete[] q->cells;
+    free(q->operands);
+    delete q;
+}
+
+int fate_queue_push(fate_queue* q, fate_op* op, const uint64_t* b, const uint64_t* e, const uint64_t* m)
+{
+    if (q == NULL || op == NULL || op->res == NULL || b == NULL || e == NULL || m == NULL)
+        return -1;
+
+    uint64_t pos = q->tail.load(memory_order_relaxed);
+    fate_qcell* cell;
+    for (;;)
+    {
+        cell = &q->cells[pos & q->mask];
+        uint64_t seq = cell->seq.load(memory_order_acquire);
+        int64_t diff = (int64_t)(seq - pos);
+        if (diff == 0)
+        {
+            if (q->tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                break;
+            q->push_retries.fetch_add(1, memory_order_relaxed);
+        }
+        else if (diff < 0)
+        {
+            q->full.fetch_add(1, memory_order_relaxed);
+            return -1;
+        }
+        else
+            pos = q->tail.load(memory_order_relaxed);
+    }
+
+    const size_t limbs = q->limbs;
+    uint64_t* dst = q->operands + 3 * limbs * (pos & q->mask);
+    memcpy(dst, b, sizeof(uint64_t) * limbs);
+    memcpy(dst + limbs, e, sizeof(uint64_t) * limbs);
+    memcpy(dst + 2 * limbs, m, sizeof(uint64_t) * limbs);
+    op->done = 0;
+    cell->op = op;
+    cell->pushed_ns = fate_now_ns();
+    cell->seq.store(pos + 1, memory_order_release);
+
+    return 0;
+}
+
+int fate_op_done(const fate_op* op)
+{
+    return __atomic_load_n(&op->done, __ATOMIC_ACQUIRE);
+}
+
+int fate_op_wait(fate_op* op)
+{
+    for (int spins = 0; !__atomic_load_n(&op->done, __ATOMIC_ACQUIRE); spins++)
+    {
+        if (spins < 1024)
+            fate_cpu_relax();
+        else
+            std::this_thread::yield();
+    }
+    return op->status;
+}
+
+void fate_queue_get_stats(const fate_queue* q, fate_queue_stats* out)
+{
+    uint64_t head = q->head.load(memory_order_relaxed);
+    uint64_t tail = q->tail.load(memory_order_relaxed);
+    out->depth = tail > head ? tail - head : 0;
+    out->capacity = q->mask + 1;
+    out->pushed = tail;
+    out->popped = q->popped.load(memory_order_relaxed);
+    out->batches = q->batches.load(memory_order_relaxed);
+    out->push_retries = q->push_retries.load(memory_order_relaxed);
+    out->pop_retries = q->pop_retries.load(memory_order_relaxed);
+    out->full = q->full.load(memory_order_relaxed);
+}
+
+/*================================================ SHARED-MEMORY SERVICE ================================================*/
+/*
+ * One engine process serves many local client processes through a POSIX
+ * shared-memory region. Every attached client owns one slot: a ring of
+ * cells only it fills, so a client that dies halfway through writing a
+ * cell leaves a gap in its own ring and nowhere else. A cell carries its
+ * operands and result in place: the client writes b, e, m straight into the
+ * cell, the server's batch formers claim up to 8 filled cells across all
+ * slots at once and write res and the status back into the same cells.
+ * Nothing is serialized or copied through the kernel; notification is
+ * futex based. Idle formers sleep on the header's doorbell word, which
+ * every publish bumps. A client sleeping on a cell's done word is woken
+ * only when it announced itself by setting the word to 2.
+ *
+ * Idle formers check the slot owners every FATE_SHM_REAP_MS and reset the
+ * slots of dead clients, unserved and half-written cells included. Clients
+ * likewise give up on their operations once the server process is gone.
+ * The server keeps its own copy of the geometry and never sizes or indexes
+ * its mapping from the header, which every client can write.
+ */
+
+#define FATE_SHM_MAGIC 0x66617465u // "fate"
+#define FATE_SHM_VERSION 3
+#define FATE_SHM_REAP_MS 100
+
+struct fate_shm_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t limbs;
+    uint32_t slots;                    // client slots
+    uint32_t capacity;                 // cells per slot, a power of two
+    int32_t server_pid;
+    uint64_t size;                     // bytes of the whole region
+    alignas(64) atomic<uint32_t> doorbell;
+    atomic<uint32_t> sleepers;         // formers waiting on doorbell
+    atomic<uint32_t> formers;          // formers still running, 0: nobody will serve
+    atomic<uint32_t> stop;
+};
+
+struct alignas(64) fate_shm_slot
+{
+    atomic<int32_t> owner;             // client pid, 0: free, -1: being reset
+    atomic<uint32_t> busy;             // cells of the slot a former has claimed and not answered yet
+    alignas(64) atomic<uint64_t> tail; // next position the client fills
+    alignas(64) atomic<uint64_t> head; // next position to serve
+};
+
+struct alignas(64) fate_shm_cell
+{
+    atomic<uint64_t> seq;  // pos: free, pos + 1: filled, pos + capacity: released for the next lap
+    atomic<uint32_t> done; // 0: pending, 1: result written, 2: pending with a client asleep
+    int32_t status;
+    uint64_t pushed_ns;    // client's steady clock at publishing, CLOCK_MONOTONIC is system-wide
+};
+
+struct fate_shm_server
+{
+    fate_shm_header* hdr;
+    fate_shm_slot* slots;
+    fate_shm_cell* cells;              // slot s, position p: cells[s * capacity + (p & (capacity - 1))]
+    uint64_t* data;                    // cell i: b, e, m, res at [4 * limbs * i, 4 * limbs * (i + 1))
+    int limbs;
+    int nslots;
+    uint64_t capacity;
+    size_t size;
+    int linger_us;
+    char name[256];
+    atomic<uint32_t> next;             // slot the next claim starts from
+    atomic<uint64_t> reap_ns;          // time of the next dead-client check
+    atomic<uint64_t> batches, served, reaped;
+    vector<thread> formers;
+};
+
+struct fate_shm_client
+{
+    fate_shm_header* hdr;
+    fate_shm_slot* slots;
+    fate_shm_cell* cells;
+    uint64_t* data;
+    int limbs;
+    uint64_t capacity;
+    size_t size;
+    int slot;
+    pid_t pid;                         // the process that connected, the only one that may use the handle
+    pid_t server;
+    std::mutex lock;                   // one call at a time on the slot
+};
+
+static long fate_futex(atomic<uint32_t>* word, int op, uint32_t val, const struct timespec* timeout)
+{
+    static_assert(sizeof(atomic<uint32_t>) == sizeof(uint32_t), "futex word");
+    return syscall(SYS_futex, (uint32_t*)word, op, val, timeout, NULL, 0);
+}
+
+/*! False only when pid certainly no longer exists */
+static bool fate_pid_alive(pid_t pid)
+{
+    return pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+static size_t fate_shm_size(uint32_t limbs, uint32_t slots, uint32_t capacity)
+{
+    size_t cells = (size_t)slots * capacity;
+    return (sizeof(fate_shm_header) + 63) / 64 * 64 + sizeof(fate_shm_slot) * slots + sizeof(fate_shm_cell) * cells +
+           sizeof(uint64_t) * 4 * limbs * cells;
+}
+
+/*! Slots, cells and operand area of a mapped region with `slots` slots of `capacity` cells */
+template <typename T>
+static void fate_shm_layout(T* end, void* base, uint32_t slots, uint32_t capacity)
+{
+    end->hdr = (fate_shm_header*)base;
+    end->slots = (fate_shm_slot*)((char*)base + (sizeof(fate_shm_header) + 63) / 64 * 64);
+    end->cells = (fate_shm_cell*)(end->slots + slots);
+    end->data = (uint64_t*)(end->cells + (size_t)slots * capacity);
+}
+
+static inline fate_shm_cell* fate_shm_cell_at(fate_shm_cell* cells, uint64_t capacity, int slot, uint64_t pos)
+{
+    return &cells[slot * capacity + (pos & (capacity - 1))];
+}
+
+typedef struct
+{
+    int slot;
+    uint64_t pos;
+} fate_shm_lane;
+
+/*! Filled cells waiting at the heads of the live slots, counting stops at max */
+static int fate_shm_ready(fate_shm_server* s, int max)
+{
+    int ready = 0;
+    for (int sl = 0; sl < s->nslots && ready < max; sl++)
+    {
+        if (s->slots[sl].owner.load(memory_order_relaxed) <= 0)
+            continue;
+        uint64_t pos = s->slots[sl].head.load(memory_order_relaxed);
+        while (ready < max &&
+               fate_shm_cell_at(s->cells, s->capacity, sl, pos)->seq.load(memory_order_acquire) == pos + 1)
+        {
+            ready++;
+            pos++;
+        }
+    }
+    return ready;
+}
+
+/*
+ * Claim up to max filled cells, taking runs from the slots in turn, once at
+ * least min are waiting. Every claimed cell holds a reference on its slot's
+ * busy count until its result is written, which is what a slot reset waits for.
+ */
+static int fate_shm_claim(fate_shm_server* s, int min, int max, fate_shm_lane* lane)
+{
+    int ready = fate_shm_ready(s, max);
+    if (ready < min || ready == 0)
+        return 0;
+
+    int k = 0;
+    uint32_t start = s->next.fetch_add(1, memory_order_relaxed);
+    for (int t = 0; t < s->nslots && k < max; t++)
+    {
+        int sl = (int)((start + t) % s->nslots);
+        fate_shm_slot* slot = &s->slots[sl];
+        if (slot->owner.load(memory_order_relaxed) <= 0)
+            continue;
+        slot->busy.fetch_add(1);
+        if (slot->owner.load() <= 0)
+        {
+            slot->busy.fetch_sub(1);
+            continue;
+        }
+
+        uint64_t pos = slot->head.load(memory_order_relaxed);
+        for (;;)
+        {
+            int n = 0;
+            while (k + n < max &&
+                   fate_shm_cell_at(s->cells, s->capacity, sl, pos + n)->seq.load(memory_order_acquire) == pos + n + 1)
+                n++;
+            if (n == 0)
+                break;
+            if (slot->head.compare_exchange_weak(pos, pos + n, memory_order_relaxed))
+            {
+                slot->busy.fetch_add(n);
+                for (int j = 0; j < n; j++)
+                    lane[k++] = { sl, pos + j };
+                break;
+            }
+        }
+        slot->busy.fetch_sub(1);
+    }
+    return k;
+}
+
+/*! Reset the slots whose client process died, at most every FATE_SHM_REAP_MS across all formers */
+static void fate_shm_reap(fate_shm_server* s, uint64_t now)
+{
+    uint64_t due = s->reap_ns.load(memory_order_relaxed);
+    if (now < due || !s->reap_ns.compare_exchange_strong(due, now + FATE_SHM_REAP_MS * 1000000ull))
+        return;
+
+    for (int sl = 0; sl < s->nslots; sl++)
+    {
+        fate_shm_slot* slot = &s->slots[sl];
+        int32_t pid = slot->owner.load();
+        if (pid <= 0 || fate_pid_alive(pid) || !slot->owner.compare_exchange_strong(pid, -1))
+            continue;
+
+        /* formers answering cells of the slot finish first, no new claims start */
+        while (slot->busy.load() != 0)
+            fate_cpu_relax();
+        for (uint64_t i = 0; i < s->capacity; i++)
+        {
+            fate_shm_cell* cell = &s->cells[sl * s->capacity + i];
+            cell->seq.store(i, memory_order_relaxed);
+            cell->done.store(0, memory_order_relaxed);
+        }
+        slot->head.store(0, memory_order_relaxed);
+        slot->tail.store(0, memory_order_relaxed);
+        slot->owner.store(0, memory_order_release);
+        s->reaped.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+static void fate_shm_former(fate_shm_server* s)
+{
+    const int buf = FATE_MB_LANES;
+    fate_shm_header* h = s->hdr;
+    const int limbs = s->limbs;
+    mpz_t res[buf], b[buf], e[buf], m[buf];
+    for (int j = 0; j < buf; j++)
+    {
+        mpz_init2(res[j], 64 * limbs);
+        mpz_init2(b[j], 64 * limbs);
+        mpz_init2(e[j], 64 * limbs);
+        mpz_init2(m[j], 64 * limbs);
+    }
+    fate_mb_workspace ws;
+    fate_ws_init(&ws, -1);
+
+    int status[buf];
+    fate_shm_lane lane[buf];
+    uint64_t lingerStart = 0;
+    int idle = 0;
+    for (;;)
+    {
+        bool stopping = h->stop.load(memory_order_acquire) != 0;
+        uint64_t now = fate_now_ns();
+        bool lingered = lingerStart && now - lingerStart >= (uint64_t)s->linger_us * 1000;
+
+        int k = fate_shm_claim(s, stopping || lingered ? 1 : buf, buf, lane);
+        if (k == 0)
+        {
+            uint32_t bell = h->doorbell.load();
+            fate_shm_reap(s, now);
+            bool empty = fate_shm_ready(s, 1) == 0;
+            if (empty && stopping)
+                break;
+            if (!empty)
+            {
+                /* a partial batch lingering */
+                if (lingerStart == 0)
+                    lingerStart = now;
+                fate_cpu_relax();
+                continue;
+            }
+            lingerStart = 0;
+            if (++idle <= 64)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            /* a client bumps the doorbell after publishing and wakes us if it sees a sleeper */
+            struct timespec timeout = { 0, FATE_SHM_REAP_MS * 1000 * 1000 };
+            h->sleepers.fetch_add(1);
+            if (fate_shm_ready(s, 1) == 0 && !h->stop.load())
+                fate_futex(&h->doorbell, FUTEX_WAIT, bell, &timeout);
+            h->sleepers.fetch_sub(1);
+            continue;
+        }
+        lingerStart = 0;
+        idle = 0;
+
+        uint64_t t0 = fate_now_ns();
+        uint64_t oldest = t0;
+        for (int j = 0; j < k; j++)
+        {
+            size_t idx = lane[j].slot * s->capacity + (lane[j].pos & (s->capacity - 1));
+            const uint64_t* src = s->data + (size_t)4 * limbs * idx;
+            mpz_import(b[j], limbs, -1, sizeof(uint64_t), 0, 0, src);
+            mpz_import(e[j], limbs, -1, sizeof(uint64_t), 0, 0, src + limbs);
+            mpz_import(m[j], limbs, -1, sizeof(uint64_t), 0, 0, src + 2 * limbs);
+            /* client-written, a bogus value only skews the statistics */
+            uint64_t pushed = s->cells[idx].pushed_ns;
+            oldest = pushed < oldest ? pushed : oldest;
+        }
+        fate_stats_record(FATE_STAGE_CONVERT, fate_now_ns() - t0);
+        fate_stats_record(FATE_STAGE_BATCH_FILL, fate_now_ns() - oldest);
+
+        g_fate_stats.ops.fetch_add(k, memory_order_relaxed);
+        powm_tuned_batch(res, b, e, m, k, status, &ws);
+        s->batches.fetch_add(1, memory_order_relaxed);
+        s->served.fetch_add(k, memory_order_relaxed);
+
+        for (int j = 0; j < k; j++)
+        {
+            size_t idx = lane[j].slot * s->capacity + (lane[j].pos & (s->capacity - 1));
+            uint64_t* dst = s->data + (size_t)4 * limbs * idx + 3 * limbs;
+            memset(dst, 0, sizeof(uint64_t) * limbs);
+            if (status[j] != FATE_STS_ERR)
+                mpz_export(dst, NULL, -1, sizeof(uint64_t), 0, 0, res[j]);
+            fate_shm_cell* cell = &s->cells[idx];
+            cell->status = status[j];
+            if (cell->done.exchange(1, memory_order_acq_rel) == 2)
+                fate_futex(&cell->done, FUTEX_WAKE, INT_MAX, NULL);
+            s->slots[lane[j].slot].busy.fetch_sub(1);
+        }
+    }
+
+    h->formers.fetch_sub(1, memory_order_acq_rel);
+    fate_ws_release(&ws);
+    for (int j = 0; j < buf; j++)
+    {
+        mpz_clear(res[j]);
+        mpz_clear(b[j]);
+        mpz_clear(e[j]);
+        mpz_clear(m[j]);
+    }
+}
+
+fate_shm_server* fate_shm_serve(const fate_shm_opts* opts)
+{
+    if (opts == NULL || opts->name == NULL || opts->limbs <= 0 || opts->clients < 0 || opts->clients > 4096 ||
+        opts->capacity < 0 || opts->capacity > (1 << 20) || strlen(opts->name) >= 255)
+        return NULL;
+
+    uint32_t slots = opts->clients > 0 ? opts->clients : 64;
+    uint32_t capacity = 16;
+    while (capacity < (uint32_t)(opts->capacity > 0 ? opts->capacity : 256))
+        capacity <<= 1;
+    const size_t size = fate_shm_size(opts->limbs, slots, capacity);
+
+    int fd = shm_open(opts->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+        return NULL;
+    void* base = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0)
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        shm_unlink(opts->name);
+        return NULL;
+    }
+
+    fate_shm_header* h = new (base) fate_shm_header;
+    h->limbs = opts->limbs;
+    h->slots = slots;
+    h->capacity = capacity;
+    h->server_pid = (int32_t)getpid();
+    h->size = size;
+    h->doorbell = 0;
+    h->sleepers = 0;
+    h->stop = 0;
+
+    fate_shm_server* s = new fate_shm_server;
+    fate_shm_layout(s, base, slots, capacity);
+    s->limbs = opts->limbs;
+    s->nslots = (int)slots;
+    s->capacity = capacity;
+    s->size = size;
+    for (uint32_t sl = 0; sl < slots; sl++)
+    {
+        fate_shm_slot* slot = new (&s->slots[sl]) fate_shm_slot;
+        slot->owner.store(0, memory_order_relaxed);
+        slot->busy.store(0, memory_order_relaxed);
+        slot->tail.store(0, memory_order_relaxed);
+        slot->head.store(0, memory_order_relaxed);
+    }
+    for (size_t i = 0; i < (size_t)slots * capacity; i++)
+    {
+        fate_shm_cell* cell = new (&s->cells[i]) fate_shm_cell;
+        cell->seq.store(i & (capacity - 1), memory_order_relaxed);
+        cell->done.store(0, memory_order_relaxed);
+    }
+    s->linger_us = opts->linger_us > 0 ? opts->linger_us : 50;
+    strcpy(s->name, opts->name);
+    s->next = 0;
+    s->reap_ns = 0;
+    s->batches = 0;
+    s->served = 0;
+    s->reaped = 0;
+
+    int formers = opts->formers > 0 ? opts->formers : 1;
+    h->formers = formers;
+    h->version = FATE_SHM_VERSION;
+    __atomic_store_n(&h->magic, FATE_SHM_MAGIC, __ATOMIC_RELEASE); // clients may attach from here on
+    for (int t = 0; t < formers; t++)
+        s->formers.emplace_back(fate_shm_former, s);
+
+    return s;
+}
+
+void fate_shm_shutdown(fate_shm_server* s)
+{
+    if (s == NULL)
+        return;
+
+    s->hdr->stop.store(1, memory_order_release);
+    s->hdr->doorbell.fetch_add(1, memory_order_acq_rel);
+    fate_futex(&s->hdr->doorbell, FUTEX_WAKE, INT_MAX, NULL);
+    for (auto& th : s->formers)
+        th.join();
+    shm_unlink(s->name);
+    munmap(s->hdr, s->size);
+    delete s;
+}
+
+void fate_shm_get_stats(const fate_shm_server* s, uint64_t* served, uint64_t* batches)
+{
+    *served = s->served.load(memory_order_relaxed);
+    *batches = s->batches.load(memory_order_relaxed);
+}
+
+int fate_shm_reaped(const fate_shm_server* s)
+{
+    return s ? (int)s->reaped.load(memory_order_relaxed) : -1;
+}
+
+fate_shm_client* fate_shm_connect(const char* name)
+{
+    if (name == NULL)
+        return NULL;
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    void* base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(fate_shm_header))
+        base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    fate_shm_header* h = (fate_shm_header*)base;
+    uint32_t limbs = h->limbs, slots = h->slots, capacity = h->capacity;
+    if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != FATE_SHM_MAGIC || h->version != FATE_SHM_VERSION ||
+        limbs == 0 || slots == 0 || capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        h->size != (uint64_t)st.st_size || h->size != fate_shm_size(limbs, slots, capacity))
+    {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+
+    fate_shm_client* c = new fate_shm_client;
+    fate_shm_layout(c, base, slots, capacity);
+    c->limbs = (int)limbs;
+    c->capacity = capacity;
+    c->size = st.st_size;
+    c->pid = getpid();
+    c->server = h->server_pid;
+
+    /* take a free slot, none left: the service is full */
+    c->slot = -1;
+    for (uint32_t sl = 0; sl < slots && c->slot < 0; sl++)
+    {
+        int32_t expect = 0;
+        if (c->slots[sl].owner.compare_exchange_strong(expect, (int32_t)c->pid, memory_order_acquire))
+            c->slot = (int)sl;
+    }
+    if (c->slot < 0)
+    {
+        munmap(base, c->size);
+        delete c;
+        return NULL;
+    }
+    return c;
+}
+
+void fate_shm_disconnect(fate_shm_client* c)
+{
+    if (c == NULL)
+        return;
+    /* every operation of the slot was collected, the next owner continues at its tail */
+    if (getpid() == c->pid)
+        c->slots[c->slot].owner.store(0, memory_order_release);
+    munmap(c->hdr, c->size);
+    delete c;
+}
+
+int fate_shm_limbs(const fate_shm_client* c)
+{
+    return c ? c->limbs : -1;
+}
+
+/*! Wait for the result of position pos, copy it out and release the cell. False when the server is gone */
+static bool fate_shm_collect(fate_shm_client* c, uint64_t pos, uint64_t* res, int* status)
+{
+    fate_shm_header* h = c->hdr;
+    const int limbs = c->limbs;
+    fate_shm_cell* cell = fate_shm_cell_at(c->cells, c->capacity, c->slot, pos);
+
+    for (int spins = 0; cell->done.load(memory_order_acquire) != 1; spins++)
+    {
+        if (spins < 1024)
+        {
+            fate_cpu_relax();
+            continue;
+        }
+        if ((h->formers.load(memory_order_acquire) == 0 || !fate_pid_alive(c->server)) &&
+            cell->done.load(memory_order_acquire) != 1)
+            return false;
+        uint32_t expect = 0;
+        if (cell->done.compare_exchange_strong(expect, 2, memory_order_acq_rel) || expect == 2)
+        {
+            struct timespec timeout = { 0, 10 * 1000 * 1000 };
+            fate_futex(&cell->done, FUTEX_WAIT, 2, &timeout);
+        }
+    }
+
+    size_t idx = c->slot * c->capacity + (pos & (c->capacity - 1));
+    memcpy(res, c->data + (size_t)4 * limbs * idx + 3 * limbs, sizeof(uint64_t) * limbs);
+    *status = cell->status;
+    cell->done.store(0, memory_order_relaxed);
+    cell->seq.store(pos + c->capacity, memory_order_release);
+    return true;
+}
+
+int fate_shm_powm(fate_shm_client* c, uint64_t* res, const uint64_t* b, const uint64_t* e, const uint64_t* m, int num,
+                  int* status)
+{
+    if (c == NULL || res == NULL || b == NULL || e == NULL || m == NULL || num < 0 || getpid() != c->pid)
+        return -1;
+
+    std::lock_guard<std::mutex> lk(c->lock);
+    fate_shm_header* h = c->hdr;
+    fate_shm_slot* slot = &c->slots[c->slot];
+    const size_t limbs = c->limbs;
+    vector<uint64_t> pos(num);
+    int failed = 0, pushed = 0, collected = 0;
+    bool lost = !fate_pid_alive(c->server);
+
+    /* collect the oldest own operation whenever the slot is full */
+    auto collect = [&]() {
+        int st;
+        int i = collected++;
+        if (lost || !fate_shm_collect(c, pos[i], res + limbs * i, &st))
+        {
+            lost = true;
+            st = FATE_STS_ERR;
+            memset(res + limbs * i, 0, sizeof(uint64_t) * limbs);
+        }
+        failed += st == FATE_STS_ERR;
+        if (status)
+            status[i] = st;
+    };
+
+    while (pushed < num && !lost)
+    {
+        if (h->stop.load(memory_order_acquire))
+        {
+            lost = true;
+            break;
+        }
+        uint64_t p = slot->tail.load(memory_order_relaxed);
+        fate_shm_cell* cell = fate_shm_cell_at(c->cells, c->capacity, c->slot, p);
+        if (cell->seq.load(memory_order_acquire) == p)
+        {
+            uint64_t* dst = c->data + 4 * limbs * (c->slot * c->capacity + (p & (c->capacity - 1)));
+            memcpy(dst, b + limbs * pushed, sizeof(uint64_t) * limbs);
+            memcpy(dst + limbs, e + limbs * pushed, sizeof(uint64_t) * limbs);
+            memcpy(dst + 2 * limbs, m + limbs * pushed, sizeof(uint64_t) * limbs);
+            pos[pushed++] = p;
+            slot->tail.store(p + 1, memory_order_relaxed);
+            cell->pushed_ns = fate_now_ns();
+            cell->seq.store(p + 1, memory_order_release);
+
+            h->doorbell.fetch_add(1);
+            if (h->sleepers.load())
+                fate_futex(&h->doorbell, FUTEX_WAKE, 1, NULL);
+        }
+        else if (collected < pushed)
+            collect();
+        else
+            lost = true; // cells still held by an earlier call the server never answered
+    }
+    while (collected < pushed)
+        collect();
+    for (int i = pushed; i < num; i++)
+    {
+        memset(res + limbs * i, 0, sizeof(uint64_t) * limbs);
+        if (status)
+            status[i] = FATE_STS_ERR;
+        failed++;
+    }
+
+    return failed;
+}
+
+int fate_random_below(uint64_t* out, const uint64_t* m, int limbs, int num, int shared_modulus)
+{
+    if (out == NULL || m == NULL || limbs <= 0 || num < 0)
+        return -1;
+
+    return fate_rand_below_limbs(fate_thread_rng(), out, m, limbs, num, shared_modulus != 0);
+}
+
+/*! Limb-array wrapper of fate_paillier_encrypt_f64/f32 for the C API */
+static int fate_encrypt_limbs(uint64_t* c, int* exponent, const double* x, int num, const uint64_t* n, int limbs,
+                              int fixed_exponent, int* status)
+{
+    if (c == NULL || x == NULL || n == NULL || limbs <= 0 || num < 0)
+        return -1;
+    if (exponent == NULL && fixed_exponent == FATE_FXP_AUTO_EXPONENT)
+        return -1;
+
+    mpz_t nz;
+    mpz_init(nz);
+    mpz_import(nz, limbs, -1, sizeof(uint64_t), 0, 0, n);
+    if (mpz_sgn(nz) == 0)
+    {
+        mpz_clear(nz);
+        return -1;
+    }
+
+    fate_paillier_pub pub;
+    fate_paillier_pub_init(&pub, nz);
+
+    fate_bignum fc;
+    fc.bigint = (mpz_t*)malloc(sizeof(mpz_t) * (num > 0 ? num : 1));
+    fc.num = num;
+    fc.ismalloc = 1;
+    for (int i = 0; i < num; i++)
+        mpz_init(fc.bigint[i]);
+
+    int failed = fate_paillier_encrypt_f64(&fc, exponent, x, num, &pub, fixed_exponent, status);
+
+    memset(c, 0, sizeof(uint64_t) * 2 * limbs * num);
+    for (int i = 0; i < num; i++)
+    {
+        mpz_export(c + (size_t)i * 2 * limbs, NULL, -1, sizeof(uint64_t), 0, 0, fc.bigint[i]);
+        mpz_clear(fc.bigint[i]);
+    }
+    free(fc.bigint);
+    fate_paillier_pub_clear(&pub);
+    mpz_clear(nz);
+
+    return failed;
+}
+
+int fate_encrypt_f64(uint64_t* c, int* exponent, const double* x, int num, const uint64_t* n, int limbs,
+                     int fixed_exponent, int* status)
+{
+    return fate_encrypt_limbs(c, exponent, x, num, n, limbs, fixed_exponent, status);
+}
+
+int fate_encrypt_f32(uint64_t* c, int* exponent, const float* x, int num, const uint64_t* n, int limbs,
+                     int fixed_exponent, int* status)
+{
+    if (x == NULL || num < 0)
+        return -1;
+
+    vector<double> wide(x, x + num);
+    return fate_encrypt_limbs(c, exponent, wide.data(), num, n, limbs, fixed_exponent, status);
+}
+
+/*! n and the exponent x from limb arrays; false on bad arguments or a zero modulus */
+static bool fate_rsa_key_limbs(mpz_t nz, mpz_t xz, const uint64_t* n, const uint64_t* x, int limbs, int num)
+{
+    if (n == NULL || x == NULL || limbs <= 0 || num < 0)
+        return false;
+    mpz_import(nz, limbs, -1, sizeof(uint64_t), 0, 0, n);
+    mpz_import(xz, limbs, -1, sizeof(uint64_t), 0, 0, x);
+    return mpz_sgn(nz) != 0;
+}
+
+int fate_rsa_oaep_encrypt(uint8_t* ct, const uint8_t* const* msg, const size_t* msg_len, int num, const uint64_t* n,
+                          const uint64_t* e, int limbs, int* status)
+{
+    mpz_t nz, ez;
+    mpz_inits(nz, ez, NULL);
+    int failed = -1;
+    if (ct != NULL && msg != NULL && msg_len != NULL && fate_rsa_key_limbs(nz, ez, n, e, limbs, num))
+        failed = fate_rsa_oaep_encrypt_batch(ct, msg, msg_len, num, nz, ez, status);
+    mpz_clears(nz, ez, NULL);
+
+    return failed;
+}
+
+int fate_rsa_oaep_decrypt(uint8_t* msg, size_t* msg_len, const uint8_t* ct, int num, const uint64_t* n,
+                          const uint64_t* d, int limbs, int* status)
+{
+    mpz_t nz, dz;
+    mpz_inits(nz, dz, NULL);
+    int failed = -1;
+    if (msg != NULL && msg_len != NULL && ct != NULL && fate_rsa_key_limbs(nz, dz, n, d, limbs, num))
+        failed = fate_rsa_oaep_decrypt_batch(msg, msg_len, ct, num, nz, dz, status);
+    mpz_clears(nz, dz, NULL);
+
+    return failed;
+}
+
+int fate_rsa_pss_sign(uint8_t* sig, const uint8_t* const* msg, const size_t* msg_len, int num, const uint64_t* n,
+                      const uint64_t* d, int limbs, int* status)
+{
+    mpz_t nz, dz;
+    mpz_inits(nz, dz, NULL);
+    int failed = -1;
+    if (sig != NULL && msg != NULL && msg_len != NULL && fate_rsa_key_limbs(nz, dz, n, d, limbs, num))
+        failed = fate_rsa_pss_sign_batch(sig, msg, msg_len, num, nz, dz, status);
+    mpz_clears(nz, dz, NULL);
+
+    return failed;
+}
+
+int fate_rsa_pss_verify(const uint8_t* sig, const uint8_t* const* msg, const size_t* msg_len, int num,
+                        const uint64_t* n, const uint64_t* e, int limbs, int* status)
+{
+    mpz_t nz, ez;
+    mpz_inits(nz, ez, NULL);
+    int failed = -1;
+    if (sig != NULL && msg != NULL && msg_len != NULL && fate_rsa_key_limbs(nz, ez, n, e, limbs, num))
+        failed = fate_rsa_pss_verify_batch(sig, msg, msg_len, num, nz, ez, status);
+    mpz_clears(nz, ez, NULL);
+
+    return failed;
+}
+
+int fate_rsa_keygen(uint64_t* n, uint64_t* d, int bits, int num)
+{
+    if (n == NULL || d == NULL || num < 0 || bits % 128)
+        return -1;
+
+    const int limbs = bits / 64;
+    fate_rsa_keypair* keys = (fate_rsa_keypair*)malloc(sizeof(fate_rsa_keypair) * (num > 0 ? num : 1));
+    int failed = fate_rsa_keygen_batch(keys, num, bits);
+    if (failed < 0)
+    {
+        free(keys);
+        return -1;
+    }
+    memset(n, 0, sizeof(uint64_t) * limbs * num);
+    memset(d, 0, sizeof(uint64_t) * limbs * num);
+    for (int i = 0; i < num; i++)
+    {
+        mpz_export(n + (size_t)i * limbs, NULL, -1, sizeof(uint64_t), 0, 0, keys[i].n);
+        mpz_export(d + (size_t)i * limbs, NULL, -1, sizeof(uint64_t), 0, 0, keys[i].d);
+        fate_rsa_keypair_clear(&keys[i]);
+    }
+    free(keys);
+
+    return failed;
+}
+
+int fate_paillier_keygen(uint64_t* n, uint64_t* p, uint64_t* q, int bits, int num)
+{
+    if (n == NULL || p == NULL || q == NULL || num < 0 || bits % 128)
+        return -1;
+
+    const int limbs = bits / 64;
+    const int half = limbs / 2;
+    int cnt = num > 0 ? num : 1;
+    fate_paillier_pub* pub = (fate_paillier_pub*)malloc(sizeof(fate_paillier_pub) * cnt);
+    fate_paillier_priv* priv = (fate_paillier_priv*)malloc(sizeof(fate_paillier_priv) * cnt);
+    mpz_t* pz = (mpz_t*)malloc(sizeof(mpz_t) * cnt);
+    mpz_t* qz = (mpz_t*)malloc(sizeof(mpz_t) * cnt);
+    int failed = fate_paillier_keygen_batch(pub, priv, pz, qz, num, bits);
+    if (failed >= 0)
+    {
+        memset(n, 0, sizeof(uint64_t) * limbs * num);
+        memset(p, 0, sizeof(uint64_t) * half * num);
+        memset(q, 0, sizeof(uint64_t) * half * num);
+        for (int i = 0; i < num; i++)
+        {
+            mpz_export(n + (size_t)i * limbs, NULL, -1, sizeof(uint64_t), 0, 0, pub[i].n);
+            mpz_export(p + (size_t)i * half, NULL, -1, sizeof(uint64_t), 0, 0, pz[i]);
+            mpz_export(q + (size_t)i * half, NULL, -1, sizeof(uint64_t), 0, 0, qz[i]);
+            fate_paillier_pub_clear(&pub[i]);
+            fate_paillier_priv_clear(&priv[i]);
+            mpz_clear(pz[i]);
+            mpz_clear(qz[i]);
+        }
+    }
+    free(pub);
+    free(priv);
+    free(pz);
+    free(qz);
+
+    return failed;
+}
+
+/*
+ * NUMA scaling benchmark: the operands of each node's shard are initialized
+ * by a thread bound to that node (first touch), then the same job is run on
+ * one socket and on all of them.
+ */
+int fate_bench_numa(int num, int threads)
+{
+    int nodes = fate_numa_nodes();
+
+    fate_bignum* fb[4];
+    for (int k = 0; k < 4; k++)
+    {
+        fb[k] = (fate_bignum*)malloc(sizeof(fate_bignum));
+        fb[k]->bigint = (mpz_t*)malloc(sizeof(mpz_t) * num);
+        fb[k]->num = num;
+        fb[k]->ismalloc = 1;
+    }
+    fate_bignum *res = fb[0], *b = fb[1], *e = fb[2], *m = fb[3];
+
+    mpz_t n, d;
+    mpz_init(n);
+    mpz_init(d);
+    num2gmp(_N1, n);
+    num2gmp(_D1, d);
+
+    /* Node-local operand shards, one contiguous slice per node */
+    vector<thread> init;
+    for (int node = 0; node < nodes; node++)
+    {
+        init.emplace_back([&, node]() {
+            fate_bind_node(nodes > 1 ? node : -1);
+            int lo = (int)((long long)num * node / nodes), hi = (int)((long long)num * (node + 1) / nodes);
+            for (int i = lo; i < hi; i++)
+            {
+                mpz_init2(res->bigint[i], 1024);
+                mpz_init2(b->bigint[i], 1024);
+                mpz_init_set(e->bigint[i], d);
+                mpz_init_set(m->bigint[i], n);
+            }
+            fate_bignum slice;
+            slice.bigint = b->bigint + lo;
+            slice.num = hi - lo;
+            slice.ismalloc = 1;
+            fate_rand_below(&slice, n, hi - lo);
+        });
+    }
+    for (auto& th : init)
+        th.join();
+
+    printf("numa bench: %d elements, %d threads, %d node(s)\n", num, threads, nodes);
+    for (int useNodes = 1; useNodes <= nodes; useNodes = useNodes < nodes ? nodes : nodes + 1)
+    {
+        fate_parallel_opts opts = { threads, useNodes };
+        fate_stats_reset();
+        uint64_t t0 = fate_now_ns();
+        int failed = powm_avx_parallel(res, b, e, m, num, NULL, &opts);
+        double sec = (fate_now_ns() - t0) / 1e9;
+
+        fate_stats st;
+        fate_stats_get(&st);
+        printf("  nodes = %d: %.3lf ms, %.1lf ops/s, remote batches = %llu, failed = %d\n", useNodes, sec * 1e3,
+               num / sec, (unsigned long long)st.remote_batches, failed);
+    }
+
+    for (int i = 0; i < num; i++)
+        for (int k = 0; k < 4; k++)
+            mpz_clear(fb[k]->bigint[i]);
+    for (int k = 0; k < 4; k++)
+    {
+        free(fb[k]->bigint);
+        free(fb[k]);
+    }
+    mpz_clear(n);
+    mpz_clear(d);
+
+    return 0;
+}
+
+
+/*================================================ SELF-TEST ================================================*/
+/*
+ * Reference checks shared by ./example test and the libFuzzer harness: every
+ * element must match mpz_powm, or carry FATE_STS_ERR when it has no result
+ * (zero modulus or negative exponent).
+ */
+
+#if !defined(FATE_POWM_NO_MAIN) || defined(FATE_POWM_FUZZ)
+
+/*! Test hook: run a scope under the profile `tune` (NULL: none), the previous one is back afterwards */
+struct fate_tune_scope
+{
+    fate_tune_entry saved[FATE_TUNE_SIZES];
+    bool loaded;
+
+    explicit fate_tune_scope(const fate_tune_entry* tune)
+    {
+        std::call_once(g_fate_tune_once, fate_tune_startup);
+        memcpy(saved, g_fate_tune, sizeof(saved));
+        loaded = g_fate_tune_loaded.load();
+        if (tune)
+            memcpy(g_fate_tune, tune, sizeof(saved));
+        g_fate_tune_loaded = tune != NULL;
+    }
+    ~fate_tune_scope()
+    {
+        memcpy(g_fate_tune, saved, sizeof(saved));
+        g_fate_tune_loaded = loaded;
+    }
+};
+
+static fate_bignum* fate_test_alloc(int num)
+{
+    fate_bignum* x = (fate_bignum*)malloc(sizeof(fate_bignum));
+    x->bigint = (mpz_t*)malloc(sizeof(mpz_t) * (num > 0 ? num : 1));
+    x->num = num;
+    x->ismalloc = 1;
+    x->ismont = 0;
+    for (int i = 0; i < num; i++)
+        mpz_init(x->bigint[i]);
+    return x;
+}
+
+static void fate_test_free(fate_bignum* x)
+{
+    for (int i = 0; i < x->num; i++)
+        mpz_clear(x->bigint[i]);
+    free(x->bigint);
+    free(x);
+}
+
+/*! Number of elements disagreeing with mpz_powm, the first few are printed */
+static int fate_check(const char* what, fate_bignum* res, fate_bignum* b, fate_bignum* e, fate_bignum* m, int num,
+                      const int* status)
+{
+    int errors = 0;
+    mpz_t r;
+    mpz_init(r);
+    for (int i = 0; i < num; i++)
+    {
+        bool ok;
+        if (mpz_sgn(m->bigint[i]) == 0 || mpz_sgn(e->bigint[i]) < 0)
+            ok = status == NULL || status[i] == FATE_STS_ERR;
+        else
+        {
+            mpz_powm(r, b->bigint[i], e->bigint[i], m->bigint[i]);
+            ok = mpz_cmp(r, res->bigint[i]) == 0 && (status == NULL || status[i] != FATE_STS_ERR);
+        }
+        if (!ok && errors++ < 3)
+            printf("%s: mismatch, %d-bit, batch %d, element %d, status %d\n", what,
+                   (int)mpz_sizeinbase(m->bigint[i], 2), num, i, status ? status[i] : 0);
+    }
+    mpz_clear(r);
+
+    return errors;
+}
+
+#endif
+
+#ifdef FATE_POWM_FUZZ
+/*
+ * libFuzzer entry point:
+ *   clang++ -g -O1 -fsanitize=fuzzer,address -DFATE_POWM_NO_MAIN -DFATE_POWM_FUZZ <example>.cpp -lippcp -lgmp -lpthread
+ * data[0]: lanes, data[1]: operand bytes, data[2]: flags (bit 0: full-size odd
+ * moduli so the multi-buffer engine takes them, bit 1: one exponent for all
+ * lanes, bit 2: result cache on); the operands are cut from the rest.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if (size < 3)
+        return 0;
+
+    int lanes = 1 + data[0] % 17;
+    int bytes = 1 + data[1] % 128;
+    int flags = data[2];
+    data += 3;
+    size -= 3;
+
+    fate_bignum* fb[4];
+    for (int k = 0; k < 4; k++)
+        fb[k] = fate_test_alloc(lanes);
+
+    vector<uint8_t> buf(bytes);
+    size_t pos = 0;
+    for (int i = 0; i < lanes; i++)
+    {
+        for (int k = 1; k < 4; k++)
+        {
+            for (int j = 0; j < bytes; j++)
+                buf[j] = size ? data[pos++ % size] : 0;
+            mpz_import(fb[k]->bigint[i], bytes, 1, 1, 0, 0, buf.data());
+        }
+        if (flags & 1)
+        {
+            mpz_setbit(fb[3]->bigint[i], 8 * bytes - 1);
+            mpz_setbit(fb[3]->bigint[i], 0);
+        }
+        if ((flags & 2) && i > 0)
+            mpz_set(fb[2]->bigint[i], fb[2]->bigint[0]);
+    }
+
+    if (flags & 4)
+        fate_cache_configure(16);
+    vector<int> status(lanes);
+    powm_avx(fb[0], fb[1], fb[2], fb[3], lanes, status.data());
+    if (fate_check("fuzz", fb[0], fb[1], fb[2], fb[3], lanes, status.data()))
+        abort();
+    if (flags & 4)
+        fate_cache_configure(0);
+
+    for (int k = 0; k < 4; k++)
+        fate_test_free(fb[k]);
+
+    return 0;
+}
+#endif /* FATE_POWM_FUZZ */
+
+#ifndef FATE_POWM_NO_MAIN
+
+/*! Random full-width operands for the C API: m odd with the top bit set, b < m */
+static void fate_fill_limbs(gmp_randstate_t state, uint64_t* b, uint64_t* e, uint64_t* m, int limbs, int num, bool sharedModulus)
+{
+    mpz_t tb, te, tm;
+    mpz_inits(tb, te, tm, NULL);
+    for (int i = 0; i < num; i++)
+    {
+        size_t off = (size_t)i * limbs;
+        if (i == 0 || !sharedModulus)
+        {
+            mpz_urandomb(tm, state, 64 * limbs);
+            mpz_setbit(tm, 64 * limbs - 1);
+            mpz_setbit(tm, 0);
+        }
+        mpz_urandomm(tb, state, tm);
+        mpz_urandomb(te, state, 64 * limbs);
+        memset(b + off, 0, sizeof(uint64_t) * limbs);
+        memset(e + off, 0, sizeof(uint64_t) * limbs);
+        memset(m + off, 0, sizeof(uint64_t) * limbs);
+        mpz_export(b + off, NULL, -1, sizeof(uint64_t), 0, 0, tb);
+        mpz_export(e + off, NULL, -1, sizeof(uint64_t), 0, 0, te);
+        mpz_export(m + off, NULL, -1, sizeof(uint64_t), 0, 0, tm);
+    }
+    mpz_clears(tb, te, tm, NULL);
+}
+
+/*! ./example bench [num] [threads]: C API throughput against an mpz_powm loop */
+static int fate_bench(int num, int threads)
+{
+    const int limbs = 16;
+    uint64_t* buf = (uint64_t*)malloc(sizeof(uint64_t) * limbs * num * 4);
+    uint64_t *res = buf, *b = buf + limbs * num, *e = buf + 2 * limbs * num, *m = buf + 3 * limbs * num;
+
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+    gmp_randseed_ui(state, 1228);
+    fate_fill_limbs(state, b, e, m, limbs, num, false);
+
+    fate_ctx_opts opts = { threads, 0, 0 };
+    fate_ctx* ctx = fate_ctx_create(&opts);
+
+    fate_stats_reset();
+    uint64_t t0 = fate_now_ns();
+    int failed = fate_powm(ctx, res, b, e, m, limbs, num, NULL);
+    double avx = (fate_now_ns() - t0) / 1e9;
+
+    mpz_t r, tb, te, tm;
+    mpz_inits(r, tb, te, tm, NULL);
+    t0 = fate_now_ns();
+    for (int i = 0; i < num; i++)
+    {
+        size_t off = (size_t)i * limbs;
+        mpz_import(tb, limbs, -1, sizeof(uint64_t), 0, 0, b + off);
+        mpz_import(te, limbs, -1, sizeof(uint64_t), 0, 0, e + off);
+        mpz_import(tm, limbs, -1, sizeof(uint64_t), 0, 0, m + off);
+        mpz_powm(r, tb, te, tm);
+    }
+    double gmp = (fate_now_ns() - t0) / 1e9;
+
+    printf("bench %d x %d-bit: avx %.3lf ms (%.1lf ops/s, failed = %d), gmp %.3lf ms (%.1lf ops/s)\n", num, 64 * limbs,
+           avx * 1e3, num / avx, failed, gmp * 1e3, num / gmp);
+    fate_stats_print(stdout);
+
+    mpz_clears(r, tb, te, tm, NULL);
+    fate_ctx_destroy(ctx);
+    gmp_randclear(state);
+    free(buf);
+
+    return 0;
+}
+
+/*! ./example shared [num] [bits]: one exponent and modulus for the whole call, lockstep kernel against the general path */
+static int fate_bench_shared(int num, int bits)
+{
+    fate_bignum fb[4];
+    for (int k = 0; k < 4; k++)
+    {
+        fb[k].bigint = (mpz_t*)malloc(sizeof(mpz_t) * num);
+        fb[k].num = num;
+        fb[k].ismalloc = 1;
+        fb[k].ismont = 0;
+        for (int i = 0; i < num; i++)
+            mpz_init(fb[k].bigint[i]);
+    }
+    fate_bignum *b = &fb[0], *e = &fb[1], *m = &fb[2], *res = &fb[3];
+    fate_tune_operands(b->bigint, e->bigint, m->bigint, bits, num);
+    for (int i = 1; i < num; i++)
+    {
+        mpz_set(e->bigint[i], e->bigint[0]);
+        mpz_set(m->bigint[i], m->bigint[0]);
+        mpz_mod(b->bigint[i], b->bigint[i], m->bigint[0]);
+    }
+
+    mpz_t* ref = (mpz_t*)malloc(sizeof(mpz_t) * num);
+    uint64_t t0 = fate_now_ns();
+    for (int i = 0; i < num; i++)
+    {
+        mpz_init(ref[i]);
+        mpz_powm(ref[i], b->bigint[i], e->bigint[0], m->bigint[0]);
+    }
+    double gmp = (fate_now_ns() - t0) / 1e9;
+
+    /* the general path without the profile: every lane scans its own exponent */
+    g_fate_tuning = true;
+    t0 = fate_now_ns();
+    int failed = powm_avx(res, b, e, m, num, NULL);
+    double general = (fate_now_ns() - t0) / 1e9;
+    g_fate_tuning = false;
+    int mismatch = 0;
+    for (int i = 0; i < num; i++)
+        mismatch += mpz_cmp(res->bigint[i], ref[i]) != 0;
+
+    t0 = fate_now_ns();
+    failed += powm_shared_exp(res, b, e->bigint[0], m, num, NULL);
+    double shared = (fate_now_ns() - t0) / 1e9;
+    for (int i = 0; i < num; i++)
+        mismatch += mpz_cmp(res->bigint[i], ref[i]) != 0;
+
+    printf("shared exponent %d x %d-bit: general %.3lf ms (%.1lf ops/s), shared %.3lf ms (%.1lf ops/s), "
+           "gmp %.3lf ms (%.1lf ops/s), failed = %d, mismatches = %d\n",
+           num, bits, general * 1e3, num / general, shared * 1e3, num / shared, gmp * 1e3, num / gmp, failed,
+           mismatch);
+
+    for (int i = 0; i < num; i++)
+        mpz_clear(ref[i]);
+    free(ref);
+    for (int k = 0; k < 4; k++)
+    {
+        for (int i = 0; i < num; i++)
+            mpz_clear(fb[k].bigint[i]);
+        free(fb[k].bigint);
+    }
+
+    return mismatch ? 1 : 0;
+}
+
+static void fate_test_operands(gmp_randstate_t state, fate_bignum* b, fate_bignum* e, fate_bignum* m, int bits,
+                               int num, bool edge, bool sharedExp);
+
+/*
+ * A mixed job: `bits[k]` sized moduli in turn, edge operands when `edge` is
+ * set, shuffled so no batch by position is uniform.
+ */
+static void fate_mixed_operands(gmp_randstate_t state, fate_bignum* b, fate_bignum* e, fate_bignum* m, const int* bits,
+                                int sizes, int num, bool edge)
+{
+    fate_bignum *tb = fate_test_alloc(1), *te = fate_test_alloc(1), *tm = fate_test_alloc(1);
+    for (int i = 0; i < num; i++)
+    {
+        fate_test_operands(state, tb, te, tm, bits[i % sizes], 1, edge && i % 5 == 0, false);
+        mpz_swap(b->bigint[i], tb->bigint[0]);
+        mpz_swap(e->bigint[i], te->bigint[0]);
+        mpz_swap(m->bigint[i], tm->bigint[0]);
+    }
+    fate_test_free(tb);
+    fate_test_free(te);
+    fate_test_free(tm);
+
+    for (int i = num - 1; i > 0; i--)
+    {
+        int j = (int)gmp_urandomm_ui(state, i + 1);
+        mpz_swap(b->bigint[i], b->bigint[j]);
+        mpz_swap(e->bigint[i], e->bigint[j]);
+        mpz_swap(m->bigint[i], m->bigint[j]);
+    }
+}
+
+/*! ./example mixed [num] [threads]: 1024/2048/1536-bit moduli in one job, batches by position against work stealing */
+static int fate_bench_mixed(int num, int threads)
+{
+    const int bits[] = { 1024, 2048, 1024, 1536, 1024 };
+    if (threads <= 0)
+        threads = (int)std::thread::hardware_concurrency();
+    if (threads < 1)
+        threads = 1;
+
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+    gmp_randseed_ui(state, 45);
+    fate_bignum *res = fate_test_alloc(num), *b = fate_test_alloc(num), *e = fate_test_alloc(num),
+                *m = fate_test_alloc(num);
+    fate_mixed_operands(state, b, e, m, bits, (int)(sizeof(bits) / sizeof(bits[0])), num, false);
+
+    /* what powm_avx_parallel did before: 8 elements by position per batch, batches shared by the threads */
+    atomic<int> next(0);
+    atomic<int> failed(0);
+    auto byPosition = [&] {
+        int status[FATE_MB_LANES];
+        for (int i = next.fetch_add(FATE_MB_LANES); i < num; i = next.fetch_add(FATE_MB_LANES))
+        {
+            int lanes = num - i < FATE_MB_LANES ? num - i : FATE_MB_LANES;
+            failed += powm_tuned_batch(res->bigint + i, b->bigint + i, e->bigint + i, m->bigint + i, lanes, status);
+        }
+    };
+    fate_stats_reset();
+    uint64_t t0 = fate_now_ns();
+    vector<thread> pool;
+    for (int t = 1; t < threads; t++)
+        pool.emplace_back(byPosition);
+    byPosition();
+    for (auto& th : pool)
+        th.join();
+    double position = (fate_now_ns() - t0) / 1e9;
+    fate_stats st;
+    fate_stats_get(&st);
+    double positionLanes = st.mb_calls ? (double)st.lanes_used / st.mb_calls : 0.0;
+    int mismatch = fate_check("by position", res, b, e, m, num, NULL);
+
+    fate_parallel_opts opts = { threads, 0 };
+    fate_stats_reset();
+    t0 = fate_now_ns();
+    failed += powm_avx_steal(res, b, e, m, num, NULL, &opts);
+    double steal = (fate_now_ns() - t0) / 1e9;
+    fate_stats_get(&st);
+    mismatch += fate_check("powm_avx_steal", res, b, e, m, num, NULL);
+
+    printf("mixed %d elements, %d threads: by position %.3lf ms (%.1lf ops/s, %.2f lanes/call), "
+           "work stealing %.3lf ms (%.1lf ops/s, %.2f lanes/call, %llu stolen), failed = %d, mismatches = %d\n",
+           num, threads, position * 1e3, num / position, positionLanes, steal * 1e3, num / steal,
+           st.mb_calls ? (double)st.lanes_used / st.mb_calls : 0.0, (unsigned long long)st.stolen_tasks,
+           (int)failed, mismatch);
+
+    fate_test_free(res);
+    fate_test_free(b);
+    fate_test_free(e);
+    fate_test_free(m);
+    gmp_randclear(state);
+
+    return mismatch ? 1 : 0;
+}
+
+/*! fate_prime_batch one candidate at a time: same sieve and rounds, every exponentiation with mpz_powm_sec */
+static void fate_prime_scalar(mpz_t out, int bits, unsigned long avoid)
+{
+    const int rounds = fate_mr_rounds(bits);
+    fate_prime_search search;
+    mpz_t cand[1];
+    mpz_inits(search.base, cand[0], NULL);
+    fate_prime_search_reset(&search, bits, avoid);
+    for (;;)
+    {
+        bool pass = true;
+        fate_prime_search_next(&search, cand[0], bits, avoid);
+        fate_miller_rabin_batch(cand, 1, false, &pass, true);
+        if (!pass)
+            continue;
+        for (int r = 1; r < rounds && pass; r++)
+            fate_miller_rabin_batch(cand, 1, true, &pass, true);
+        if (pass)
+            break;
+        fate_prime_search_reset(&search, bits, avoid);
+    }
+    mpz_swap(out, cand[0]);
+    mpz_clears(search.base, cand[0], NULL);
+}
+
+/*! ./example keygen [keys] [bits]: batched Paillier key generation against the same search one candidate at a time */
+static int fate_bench_keygen(int num, int bits)
+{
+    fate_paillier_pub* pub = (fate_paillier_pub*)malloc(sizeof(fate_paillier_pub) * num);
+    fate_paillier_priv* priv = (fate_paillier_priv*)malloc(sizeof(fate_paillier_priv) * num);
+    uint64_t t0 = fate_now_ns();
+    int failed = fate_paillier_keygen_batch(pub, priv, NULL, NULL, num, bits);
+    double batched = (fate_now_ns() - t0) / 1e9;
+
+    /* the same primes, rounds and pair checks one candidate at a time */
+    mpz_t p, q, n, phi, t;
+    mpz_inits(p, q, n, phi, t, NULL);
+    t0 = fate_now_ns();
+    for (int i = 0; i < num; i++)
+    {
+        bool ok = false;
+        while (!ok)
+        {
+            fate_prime_scalar(p, bits / 2, 0);
+            fate_prime_scalar(q, bits / 2, 0);
+            if (!fate_primes_apart(p, q, bits / 2))
+                continue;
+            mpz_mul(n, p, q);
+            mpz_mul(t, n, n);
+            if ((int)mpz_sizeinbase(t, 2) != 2 * bits)
+                continue;
+            mpz_sub_ui(phi, p, 1);
+            mpz_sub_ui(t, q, 1);
+            mpz_mul(phi, phi, t);
+            mpz_gcd(t, n, phi);
+            ok = mpz_cmp_ui(t, 1) == 0;
+        }
+    }
+    double gmp = (fate_now_ns() - t0) / 1e9;
+    mpz_clears(p, q, n, phi, t, NULL);
+
+    printf("paillier keygen %d x %d-bit: batched %.3lf s (%.2lf keys/s), scalar %.3lf s (%.2lf keys/s), failed = %d\n",
+           num, bits, batched, num / batched, gmp, num / gmp, failed);
+
+    for (int i = 0; i < num; i++)
+    {
+        fate_paillier_pub_clear(&pub[i]);
+        fate_paillier_priv_clear(&priv[i]);
+    }
+    free(pub);
+    free(priv);
+
+    return failed ? 1 : 0;
+}
+
+/*! ./example text [num] [limbs]: batched hex/decimal conversion against mpz_set_str/mpz_get_str */
+static int fate_bench_text(int num, int limbs)
+{
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+    gmp_randseed_ui(state, 1228);
+    vector<uint64_t> in((size_t)limbs * num), out(in.size()), e(in.size()), m(in.size());
+    fate_fill_limbs(state, e.data(), in.data(), m.data(), limbs, num, false);
+    gmp_randclear(state);
+
+    const size_t stride[2] = { FATE_HEX_CHARS(limbs), FATE_DEC_CHARS(limbs) };
+    const char* name[2] = { "hex", "dec" };
+    int mismatch = 0;
+    for (int t = 0; t < 2; t++)
+    {
+        vector<char> text(stride[t] * num);
+        vector<const char*> str(num);
+        for (int i = 0; i < num; i++)
+            str[i] = &text[stride[t] * i];
+
+        uint64_t t0 = fate_now_ns();
+        if (t == 0)
+            fate_format_hex(text.data(), stride[t], in.data(), limbs, num);
+        else
+            fate_format_dec(text.data(), stride[t], in.data(), limbs, num);
+        double format = (fate_now_ns() - t0) / 1e9;
+        t0 = fate_now_ns();
+        if (t == 0)
+            fate_parse_hex(out.data(), str.data(), NULL, limbs, num, NULL);
+        else
+            fate_parse_dec(out.data(), str.data(), NULL, limbs, num, NULL);
+        double parse = (fate_now_ns() - t0) / 1e9;
+        mismatch += out != in;
+
+        mpz_t x;
+        mpz_init(x);
+        t0 = fate_now_ns();
+        for (int i = 0; i < num; i++)
+        {
+            mpz_import(x, limbs, -1, sizeof(uint64_t), 0, 0, &in[(size_t)i * limbs]);
+            mpz_get_str(&text[stride[t] * i], t == 0 ? 16 : 10, x);
+        }
+        double gmpFormat = (fate_now_ns() - t0) / 1e9;
+        t0 = fate_now_ns();
+        for (int i = 0; i < num; i++)
+        {
+            mpz_set_str(x, str[i], t == 0 ? 16 : 10);
+            mpz_export(&out[(size_t)i * limbs], NULL, -1, sizeof(uint64_t), 0, 0, x);
+        }
+        double gmpParse = (fate_now_ns() - t0) / 1e9;
+        mpz_clear(x);
+
+        printf("%s %d x %d-bit: format %.1lf ns/op (gmp %.1lf), parse %.1lf ns/op (gmp %.1lf)\n", name[t], num,
+               64 * limbs, format * 1e9 / num, gmpFormat * 1e9 / num, parse * 1e9 / num, gmpParse * 1e9 / num);
+    }
+    printf("mismatches = %d\n", mismatch);
+
+    return mismatch ? 1 : 0;
+}
+
+/*! ./example queue [producers] [ops] [limbs]: producers push single operations through the ingestion queue */
+static int fate_bench_queue(int producers, int ops, int limbs)
+{
+    vector<uint64_t> b((size_t)limbs * ops), e((size_t)limbs * ops), m((size_t)limbs * ops), res((size_t)limbs * ops);
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+    gmp_randseed_ui(state, 1228);
+    fate_fill_limbs(state, b.data(), e.data(), m.data(), limbs, ops, false);
+    gmp_randclear(state);
+
+    fate_queue_opts qo = { 4096, limbs, 1, 0 };
+    fate_queue* q = fate_queue_create(&qo);
+    vector<fate_op> op(ops);
+    atomic<uint64_t> pushNs(0);
+
+    uint64_t t0 = fate_now_ns();
+    vector<thread> pool;
+    for (int p = 0; p < producers; p++)
+        pool.emplace_back([&, p] {
+            uint64_t spent = 0;
+            for (int i = p; i < ops; i += producers)
             {
-                cout << "Step 1" << endl;
-                for (int i = 0; i < leave; i++)
-                    delete[](Ipp8u*) pPubKey[i];
-                cout << "Step 2" << endl;
+                size_t off = (size_t)i * limbs;
+                op[i].res = &res[off];
+                uint64_t s = fate_now_ns();
+                while (fate_queue_push(q, &op[i], &b[off], &e[off], &m[off]) != 0)
+                    std::this_thread::yield();
+                spent += fate_now_ns() - s;
+            }
+            pushNs += spent;
+        });
+    for (auto& th : pool)
+        th.join();
+    int failed = 0;
+    for (int i = 0; i < ops; i++)
+        failed += fate_op_wait(&op[i]) == FATE_STS_ERR;
+    double total = (fate_now_ns() - t0) / 1e9;
+
+    fate_queue_stats qs;
+    fate_queue_get_stats(q, &qs);
+    fate_queue_destroy(q);
+
+    mpz_t r, tb, te, tm, got;
+    mpz_inits(r, tb, te, tm, got, NULL);
+    int mismatch = 0;
+    for (int i = 0; i < ops; i++)
+    {
+        size_t off = (size_t)i * limbs;
+        mpz_import(tb, limbs, -1, sizeof(uint64_t), 0, 0, &b[off]);
+        mpz_import(te, limbs, -1, sizeof(uint64_t), 0, 0, &e[off]);
+        mpz_import(tm, limbs, -1, sizeof(uint64_t), 0, 0, &m[off]);
+        mpz_import(got, limbs, -1, sizeof(uint64_t), 0, 0, &res[off]);
+        mpz_powm(r, tb, te, tm);
+        mismatch += mpz_cmp(r, got) != 0;
+    }
+    mpz_clears(r, tb, te, tm, got, NULL);
+
+    printf("queue %d producers x %d ops, %d-bit: %.3lf ms (%.1lf ops/s), push %.1lf ns/op, failed = %d, mismatches = %d\n",
+           producers, ops, 64 * limbs, total * 1e3, ops / total, (double)pushNs / ops, failed, mismatch);
+    printf("  batches = %llu (%.2lf lanes/batch) push_retries = %llu pop_retries = %llu full = %llu\n",
+           (unsigned long long)qs.batches, qs.batches ? (double)qs.popped / qs.batches : 0.0,
+           (unsigned long long)qs.push_retries, (unsigned long long)qs.pop_retries, (unsigned long long)qs.full);
+
+    return mismatch ? 1 : 0;
+}
+
+/*! Child process of the shm benchmark/test: `calls` calls of `ops` operations each, checked against mpz_powm */
+static int fate_shm_child(const char* name, int seed, int calls, int ops)
+{
+    fate_shm_client* c = fate_shm_connect(name);
+    if (c == NULL)
+        return 1;
+    const int limbs = fate_shm_limbs(c);
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+    gmp_randseed_ui(state, seed);
+    vector<uint64_t> b((size_t)limbs * ops), e(b.size()), m(b.size()), res(b.size());
+    vector<int> status(ops);
+    mpz_t r, tb, te, tm, got;
+    mpz_inits(r, tb, te, tm, got, NULL);
+
+    int errors = 0;
+    for (int k = 0; k < calls; k++)
+    {
+        fate_fill_limbs(state, b.data(), e.data(), m.data(), limbs, ops, false);
+        errors += fate_shm_powm(c, res.data(), b.data(), e.data(), m.data(), ops, status.data()) != 0;
+        for (int i = 0; i < ops; i++)
+        {
+            size_t off = (size_t)i * limbs;
+            mpz_import(tb, limbs, -1, sizeof(uint64_t), 0, 0, &b[off]);
+            mpz_import(te, limbs, -1, sizeof(uint64_t), 0, 0, &e[off]);
+            mpz_import(tm, limbs, -1, sizeof(uint64_t), 0, 0, &m[off]);
+            mpz_import(got, limbs, -1, sizeof(uint64_t), 0, 0, &res[off]);
+            mpz_powm(r, tb, te, tm);
+            errors += mpz_cmp(r, got) != 0;
+        }
+    }
+
+    mpz_clears(r, tb, te, tm, got, NULL);
+    gmp_randclear(state);
+    fate_shm_disconnect(c);
+    return errors;
+}
+
+/*! Fork `clients` processes running fate_shm_child; the number of failed children */
+static int fate_shm_fork_clients(const char* name, int clients, int calls, int ops)
+{
+    vector<pid_t> pid(clients);
+    for (int k = 0; k < clients; k++)
+    {
+        pid[k] = fork();
+        if (pid[k] == 0)
+            _exit(fate_shm_child(name, 1228 + k, calls, ops) ? 1 : 0);
+    }
+    int failed = 0;
+    for (int k = 0; k < clients; k++)
+    {
+        int ws = 0;
+        failed += pid[k] < 0 || waitpid(pid[k], &ws, 0) != pid[k] || !WIFEXITED(ws) || WEXITSTATUS(ws) != 0;
+    }
+    return failed;
+}
+
+/*! ./example shm [clients] [calls] [ops] [limbs]: client processes sending small batches to one engine */
+static int fate_bench_shm(int clients, int calls, int ops, int limbs)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/fate_bench_%d", (int)getpid());
+    fate_shm_opts so = { name, limbs, 0, 0, 1, 0 };
+    fate_shm_server* s = fate_shm_serve(&so);
+    if (s == NULL)
+    {
+        printf("shm: cannot create %s\n", name);
+        return 1;
+    }
+
+    uint64_t t0 = fate_now_ns();
+    int failed = fate_shm_fork_clients(name, clients, calls, ops);
+    double total = (fate_now_ns() - t0) / 1e9;
+    uint64_t served, batches;
+    fate_shm_get_stats(s, &served, &batches);
+    fate_shm_shutdown(s);
+
+    printf("shm %d clients x %d calls x %d ops, %d-bit: %.3lf ms (%.1lf ops/s), batches = %llu (%.2lf lanes/batch), "
+           "failed clients = %d\n",
+           clients, calls, ops, 64 * limbs, total * 1e3, served / total, (unsigned long long)batches,
+           batches ? (double)served / batches : 0.0, failed);
+
+    return failed ? 1 : 0;
+}
+
+static volatile sig_atomic_t g_fate_serve_stop = 0;
+
+static void fate_serve_signal(int)
+{
+    g_fate_serve_stop = 1;
+}
+
+/*! ./example serve [name] [limbs] [formers]: run the shared-memory service until SIGINT/SIGTERM */
+static int fate_serve(const char* name, int limbs, int formers)
+{
+    fate_shm_opts so = { name, limbs, 0, 0, formers, 0 };
+    fate_shm_server* s = fate_shm_serve(&so);
+    if (s == NULL)
+    {
+        printf("serve: cannot create %s\n", name);
+        return 1;
+    }
+    signal(SIGINT, fate_serve_signal);
+    signal(SIGTERM, fate_serve_signal);
+    printf("serving %s, %d-bit operands\n", name, 64 * limbs);
+    while (!g_fate_serve_stop)
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    uint64_t served, batches;
+    fate_shm_get_stats(s, &served, &batches);
+    fate_shm_shutdown(s);
+    printf("served %llu operations in %llu batches\n", (unsigned long long)served, (unsigned long long)batches);
+    return 0;
+}
+
+#ifdef __cpp_impl_coroutine
+/* fire-and-forget coroutine for the demo */
+struct fate_detached
+{
+    struct promise_type
+    {
+        fate_detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+static fate_detached fate_coro_client(fate_engine* engine, uint64_t* res, const uint64_t* b, const uint64_t* e,
+                                      const uint64_t* m, int limbs, int first, int count, int stride,
+                                      atomic<int>* failed, atomic<int>* left)
+{
+    for (int k = 0; k < count; k++)
+    {
+        size_t off = (size_t)(first + k * stride) * limbs;
+        if (co_await engine->powm(res + off, b + off, e + off, m + off) == FATE_STS_ERR)
+            (*failed)++;
+    }
+    (*left)--;
+}
+
+/*! ./example coro [coroutines] [ops] [limbs]: coroutines sharing the engine, resumed on one executor thread */
+static int fate_bench_coro(int coroutines, int ops, int limbs)
+{
+    if (coroutines > ops)
+        coroutines = ops;
+    vector<uint64_t> b((size_t)limbs * ops), e((size_t)limbs * ops), m((size_t)limbs * ops), res((size_t)limbs * ops);
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+    gmp_randseed_ui(state, 1228);
+    fate_fill_limbs(state, b.data(), e.data(), m.data(), limbs, ops, false);
+    gmp_randclear(state);
+
+    atomic<int> failed(0), left(coroutines);
+    uint64_t t0;
+    double total;
+    {
+        fate_engine engine(limbs);
+        t0 = fate_now_ns();
+        for (int c = 0; c < coroutines; c++)
+        {
+            int count = (ops - c + coroutines - 1) / coroutines;
+            fate_coro_client(&engine, res.data(), b.data(), e.data(), m.data(), limbs, c, count, coroutines, &failed,
+                             &left);
+        }
+        while (left > 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        total = (fate_now_ns() - t0) / 1e9;
+    }
+
+    mpz_t r, tb, te, tm, got;
+    mpz_inits(r, tb, te, tm, got, NULL);
+    int mismatch = 0;
+    for (int i = 0; i < ops; i++)
+    {
+        size_t off = (size_t)i * limbs;
+        mpz_import(tb, limbs, -1, sizeof(uint64_t), 0, 0, &b[off]);
+        mpz_import(te, limbs, -1, sizeof(uint64_t), 0, 0, &e[off]);
+        mpz_import(tm, limbs, -1, sizeof(uint64_t), 0, 0, &m[off]);
+        mpz_import(got, limbs, -1, sizeof(uint64_t), 0, 0, &res[off]);
+        mpz_powm(r, tb, te, tm);
+        mismatch += mpz_cmp(r, got) != 0;
+    }
+    mpz_clears(r, tb, te, tm, got, NULL);
+
+    printf("coro %d coroutines x %d ops, %d-bit: %.3lf ms (%.1lf ops/s), failed = %d, mismatches = %d\n", coroutines,
+           ops, 64 * limbs, total * 1e3, ops / total, (int)failed, mismatch);
+
+    return mismatch ? 1 : 0;
+}
+#endif
+
+/*
+ * Random operands of `bits` bits; with `edge` most elements get one of the
+ * edge cases below, with sharedExp all elements use the exponent of element 0.
+ */
+static void fate_test_operands(gmp_randstate_t state, fate_bignum* b, fate_bignum* e, fate_bignum* m, int bits,
+                               int num, bool edge, bool sharedExp)
+{
+    for (int i = 0; i < num; i++)
+    {
+        mpz_ptr bi = b->bigint[i], ei = e->bigint[i], mi = m->bigint[i];
+        mpz_urandomb(mi, state, bits);
+        mpz_setbit(mi, bits - 1);
+        mpz_setbit(mi, 0);
+        mpz_urandomm(bi, state, mi);
+        mpz_urandomb(ei, state, bits);
+
+        switch (edge ? i % 13 : -1)
+        {
+        case 0: mpz_set_ui(bi, 0); break;
+        case 1: mpz_set_ui(bi, 1); break;
+        case 2: mpz_sub_ui(bi, mi, 1); break;
+        case 3: mpz_set(bi, mi); break;           // base not reduced
+        case 4: mpz_add_ui(bi, mi, 5); break;
+        case 5: mpz_set_ui(ei, 0); break;
+        case 6: mpz_set_ui(ei, 1); break;
+        case 7: mpz_set_si(ei, -1); break;        // no result
+        case 8: mpz_clrbit(mi, 0); break;         // even modulus
+        case 9: mpz_set_ui(mi, 0); break;         // no result
+        case 10: mpz_set_ui(mi, 1); break;
+        case 11: mpz_neg(bi, bi); break;
+        default: break;
+        }
+        if (sharedExp && i > 0)
+            mpz_set(ei, e->bigint[0]);
+    }
+}
+
+/*! b^e mod m through every entry point, a full batch plus a tail of the same triple, against a known answer */
+static int fate_test_kat(const char* name, const mpz_t b, const mpz_t e, const mpz_t m, const char* expectHex)
+{
+    const int num = 9;
+    fate_bignum *res = fate_test_alloc(num), *fb = fate_test_alloc(num), *fe = fate_test_alloc(num),
+                *fm = fate_test_alloc(num);
+    for (int i = 0; i < num; i++)
+    {
+        mpz_set(fb->bigint[i], b);
+        mpz_set(fe->bigint[i], e);
+        mpz_set(fm->bigint[i], m);
+    }
+    mpz_t expect;
+    mpz_init_set_str(expect, expectHex, 16);
+
+    int errors = 0;
+    for (int path = 0; path < 3; path++)
+    {
+        for (int i = 0; i < num; i++)
+            mpz_set_ui(res->bigint[i], 0);
+        if (path == 0)
+            powm_avx(res, fb, fe, fm, num, NULL);
+        else if (path == 1)
+            powm_avx_parallel(res, fb, fe, fm, num, NULL, NULL);
+        else
+            powm_shared_exp(res, fb, e, fm, num, NULL);
+        for (int i = 0; i < num; i++)
+        {
+            if (mpz_cmp(res->bigint[i], expect) != 0)
+            {
+                printf("kat %s: path %d element %d wrong\n", name, path, i);
+                errors++;
                 break;
             }
+        }
+    }
 
-            /* Handling the ippStsMbWarning status when the number of requests in the queue is not a multiple of eight */
-            if (leave != buf && status == ippStsMbWarning)
+    mpz_clear(expect);
+    fate_test_free(res);
+    fate_test_free(fb);
+    fate_test_free(fe);
+    fate_test_free(fm);
+
+    return errors;
+}
+
+static int fate_test_kats()
+{
+    int errors = 0;
+    mpz_t b, e, m, r;
+    mpz_inits(b, e, m, r, NULL);
+
+    /* 4^13 mod 497 */
+    mpz_set_ui(b, 4);
+    mpz_set_ui(e, 13);
+    mpz_set_ui(m, 497);
+    errors += fate_test_kat("small", b, e, m, "1BD");
+
+    /* the example's RSA-1024 vector: DD^D mod N, and back with E */
+    num2gmp(_DD, b);
+    num2gmp(_D1, e);
+    num2gmp(_N1, m);
+    const char* sig = "79125146E35FF28B41714EE2670B5244C08FA939A7B45BC8DE65B7D85758166156ABEA45F6BFF67EEA9FFB78161E1E3A"
+                      "E6DBB3F791A1E923F4113E9E9DA4267A4007057A917E7CF5D7838AAE9142076F036ACB9EEFB8E5F7988938D7C13587D2"
+                      "81FF6EE02EC15816112C345361D7F2758A9B2C0B4A7955B45196A823759AE588";
+    errors += fate_test_kat("rsa1024 decrypt", b, e, m, sig);
+    mpz_set_str(b, sig, 16);
+    num2mpz(_E, e);
+    num2gmp(_DD, r);
+    char* ddHex = mpz_get_str(NULL, 16, r);
+    errors += fate_test_kat("rsa1024 encrypt", b, e, m, ddHex);
+    free(ddHex);
+
+    /* m = 2^2048 - 1, b = 2^2047 + 12345, e = 2^2048 - 3 */
+    mpz_set_ui(m, 0);
+    mpz_setbit(m, 2048);
+    mpz_sub_ui(m, m, 1);
+    mpz_set_ui(b, 12345);
+    mpz_setbit(b, 2047);
+    mpz_sub_ui(e, m, 2);
+    errors += fate_test_kat("2048", b, e, m,
+                            "22BFD2879F397BBFF19CF9419CAC2868675D76DF5AB8BE11976B638A42190FEA90B01B020EE2A057FD6BDE37398BFC17"
+                            "C83F06EF4D2D6BA8C80C9EAD56C593CDE8194F3215AA401D97D7326446A1D28F0ED7D4733FDCCE71CC28BDA6018EDC55"
+                            "704361021C8DD3CA5943ABDB9EB48C0FE62A07910AADDAAFEEFAC2A3CE7B57E4284A46F9DC556A6569EC9FB395AC7DF0"
+                            "807C151AFD9FC9013C005C56717B89704905B5895167BE31B94E0B92B20C1E9301E5BD942D141574B174C9D739D4208E"
+                            "43FB7671585FAA8E5697B2C2BB81AFAE110385652C4A0072FE87548DDD92AF5BA6BFB90A2821B15CBBECE8E7E776090F"
+                            "028EEBFA65AD832BFBC3C7A1F973A0F8");
+
+    /* m = 2^3072 - 2^1536 - 1, b = 2^1000 + 7, e = 65537 */
+    mpz_set_ui(m, 0);
+    mpz_setbit(m, 3072);
+    mpz_set_ui(r, 0);
+    mpz_setbit(r, 1536);
+    mpz_sub(m, m, r);
+    mpz_sub_ui(m, m, 1);
+    mpz_set_ui(b, 7);
+    mpz_setbit(b, 1000);
+    mpz_set_ui(e, 65537);
+    errors += fate_test_kat("3072", b, e, m,
+                            "ED786FBB6557F05873AF2DCD03D59B6CF1E9EC1074B4E30860D1EC97A523A4E666A0A35278731239BD459A2F267E71F4"
+                            "6366F9DD3549A6A602055F61B09F6E7253E7AE8D0CDB9A4C3ADA5A8454B9C1280C073C35E13961F7704F79C236767C39"
+                            "D31AB900DD2AA7F9C8E6C68FD1E0A3460D76A2BC69030139006D344DF57A515A634F73810B02FBCE4A782800F67702AE"
+                            "48910FA20D97E4E8BDF84EE198298A55F49D2AE8F20C47BCDE5193CAA2AB0D528E78E14C7C7CE9919D0434636508EC8B"
+                            "D6B69EE1A2F7CEE0E5DB06312E8F6B7FD785824746B5740E8AAF9BA7710ED127E37265168CC1188E05194950688AB607"
+                            "CF928EEE1482DDC4730B45947839D28A82EEE143716DA65781BF88C0805B4B795DF50880B4824E30702471DAD00CBF0D"
+                            "BF0977DFF074FC43236442FA23C9719A6368D3BE0EF63FA81113D3B80EB09B6C329DDBFB847146FC562BBE07CFC9BEE7"
+                            "C97EB9437AD1826BDAE3F8DD88D693187B3C6083F18B7DC473F7075C1AF617B0822550E378FCCDEA7D6F10A1024DC646");
+
+    mpz_clears(b, e, m, r, NULL);
+
+    return errors;
+}
+
+/*! Randomized differential tests of the engine entry points over sizes, batch shapes and edge values */
+static int fate_test_engine(gmp_randstate_t state)
+{
+    const int sizes[] = { 64, 1000, 1024, 2048, 3072, 4096 };
+    const int shapes[] = { 1, 7, 8, 9, 15, 16, 17, 23 };
+    const int bigShapes[] = { 1, 9 };
+    int errors = 0;
+
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+    {
+        int bits = sizes[s];
+        bool big = bits > 2048;
+        const int* shape = big ? bigShapes : shapes;
+        int nshapes = big ? 2 : (int)(sizeof(shapes) / sizeof(shapes[0]));
+        for (int k = 0; k < nshapes; k++)
+        {
+            for (int edge = 0; edge < 2; edge++)
             {
-                /* If ippStsNullPtrErr status is in the initially unspecified buffers, then we consider that the status of the operation is ippStsNoErr */
-                status = ippStsNoErr;
-                for (int j = 0; j < leave; j++)
-                    if (statusesArray[j] != ippStsNoErr)
-                        status = ippStsMbWarning;
-                for (int j = leave; j < buf; j++)
-                    if (statusesArray[j] != ippStsNullPtrErr)
-                        status = ippStsMbWarning;
+                int num = shape[k];
+                fate_bignum *res = fate_test_alloc(num), *b = fate_test_alloc(num), *e = fate_test_alloc(num),
+                            *m = fate_test_alloc(num);
+                vector<int> status(num);
+                fate_parallel_opts opts = { 2, 0 };
+
+                fate_test_operands(state, b, e, m, bits, num, edge, false);
+                powm_avx(res, b, e, m, num, status.data());
+                errors += fate_check("powm_avx", res, b, e, m, num, status.data());
+                powm_avx_parallel(res, b, e, m, num, status.data(), &opts);
+                errors += fate_check("powm_avx_parallel", res, b, e, m, num, status.data());
+
+                fate_cache_configure(4);
+                for (int rep = 0; rep < 2; rep++)
+                {
+                    powm_avx(res, b, e, m, num, status.data());
+                    errors += fate_check("cached powm_avx", res, b, e, m, num, status.data());
+                }
+                /* res == b on an empty cache: computed lanes, then hits on what they inserted */
+                fate_cache_configure(0);
+                fate_cache_configure(4);
+                for (int rep = 0; rep < 2; rep++)
+                {
+                    for (int i = 0; i < num; i++)
+                        mpz_set(res->bigint[i], b->bigint[i]);
+                    powm_avx(res, res, e, m, num, status.data());
+                    errors += fate_check("cached powm_avx, res == b", res, b, e, m, num, status.data());
+                }
+                fate_cache_configure(0);
+
+                fate_test_operands(state, b, e, m, bits, num, edge, true);
+                powm_shared_exp(res, b, e->bigint[0], m, num, status.data());
+                errors += fate_check("powm_shared_exp", res, b, e, m, num, status.data());
+
+                fate_test_free(res);
+                fate_test_free(b);
+                fate_test_free(e);
+                fate_test_free(m);
+            }
+        }
+    }
+
+    return errors;
+}
+
+/*! powm_avx_mont on both of its paths, operands kept in the Montgomery domain and left untouched */
+static int fate_test_mont(gmp_randstate_t state)
+{
+    int errors = 0;
+    const int sizes[] = { 64, 1024, 2048 };
+    const int shapes[] = { 5, 9 };
+    for (int s = 0; s < 3; s++)
+    {
+        for (int k = 0; k < 2; k++)
+        {
+            int num = shapes[k];
+            fate_bignum *res = fate_test_alloc(num), *b = fate_test_alloc(num), *e = fate_test_alloc(num),
+                        *m = fate_test_alloc(num), *bm = fate_test_alloc(num);
+            fate_test_operands(state, b, e, m, sizes[s], num, false, false);
+            for (int i = 0; i < num; i++)
+            {
+                mpz_set(m->bigint[i], m->bigint[0]);
+                mpz_mod(b->bigint[i], b->bigint[i], m->bigint[0]);
+                mpz_set(bm->bigint[i], b->bigint[i]);
             }
 
-            // cout <<"Step 4" << endl;
-            for (int j = 0; j < leave; j++)
-                delete[](Ipp8u*) pPubKey[j];
-            //  cout <<"Step 5" << endl;
-            bufId = 0;
+            fate_mont_ctx ctx;
+            fate_mont_init(&ctx, m->bigint[0]);
+            fate_to_mont(bm, &ctx, num);
+            vector<int> status(num);
+            powm_avx_mont(res, bm, e, &ctx, num, status.data(), false);
+            errors += fate_check("powm_avx_mont", res, b, e, m, num, status.data());
+            errors += !bm->ismont;
+            fate_from_mont(bm, &ctx, num);
+            for (int i = 0; i < num; i++)
+                errors += mpz_cmp(bm->bigint[i], b->bigint[i]) != 0;
+            fate_mont_clear(&ctx);
+
+            fate_test_free(res);
+            fate_test_free(b);
+            fate_test_free(e);
+            fate_test_free(m);
+            fate_test_free(bm);
+        }
+    }
+    return errors;
+}
 
-            if (!checkStatus("ippsRSA_MB_Encrypt", ippStsNoErr, status))
-                break;
+/*! Mixed sizes, unsupported sizes and edge operands through the work-stealing scheduler */
+static int fate_test_steal(gmp_randstate_t state)
+{
+    const int bits[] = { 1024, 2048, 1000, 1024, 64 };
+    const int shapes[] = { 1, 9, 61 };
+    int errors = 0;
+
+    for (int k = 0; k < (int)(sizeof(shapes) / sizeof(shapes[0])); k++)
+    {
+        int num = shapes[k];
+        fate_bignum *res = fate_test_alloc(num), *b = fate_test_alloc(num), *e = fate_test_alloc(num),
+                    *m = fate_test_alloc(num);
+        vector<int> status(num);
+        fate_mixed_operands(state, b, e, m, bits, (int)(sizeof(bits) / sizeof(bits[0])), num, true);
+
+        for (int threads = 1; threads <= 3; threads += 2)
+        {
+            fate_parallel_opts opts = { threads, 0 };
+            powm_avx_steal(res, b, e, m, num, status.data(), &opts);
+            errors += fate_check("powm_avx_steal", res, b, e, m, num, status.data());
         }
+        fate_parallel_opts opts = { 2, 0 };
+        powm_avx_parallel(res, b, e, m, num, status.data(), &opts);
+        errors += fate_check("mixed powm_avx_parallel", res, b, e, m, num, status.data());
+
+        fate_cache_configure(4);
+        powm_avx_steal(res, b, e, m, num, status.data(), &opts);
+        errors += fate_check("cached powm_avx_steal", res, b, e, m, num, status.data());
+        fate_cache_configure(0);
+
+        fate_test_free(res);
+        fate_test_free(b);
+        fate_test_free(e);
+        fate_test_free(m);
     }
 
-    /*======================================================= DEC============================================*/
-    bufId = 0;
-    clock_t str_avx = clock();
-    clock_t str_avx_l, end_avx_l;
-    double ttime = 0.f;
+    /* a 1024-bit tail below the crossover of the profile goes to mpz_powm, one task per element */
+    fate_tune_entry tune[FATE_TUNE_SIZES];
+    memcpy(tune, g_fate_tune, sizeof(tune));
+    tune[0].mb_min_lanes = 4;
+    {
+        fate_tune_scope scope(tune);
+        const int num = 11;
+        fate_bignum *b = fate_test_alloc(num), *e = fate_test_alloc(num), *m = fate_test_alloc(num);
+        fate_test_operands(state, b, e, m, 1024, num, false, false);
+        for (int i = 0; i < num; i++)
+            mpz_setbit(e->bigint[i], 1023);
+        vector<int> order;
+        vector<fate_steal_task> tasks;
+        fate_steal_plan(b, e, m, num, order, tasks);
+        int mb = 0, gmp = 0;
+        for (auto& t : tasks)
+            (t.kind == FATE_TASK_MB ? mb : gmp) += t.lanes;
+        if (mb != 8 || gmp != 3 || (int)order.size() != num)
+        {
+            printf("fate_steal_plan: %d multi-buffer and %d mpz_powm lanes, expected 8 and 3\n", mb, gmp);
+            errors++;
+        }
+        fate_test_free(b);
+        fate_test_free(e);
+        fate_test_free(m);
+    }
 
-    for (int i = 0; i < num; i++)
+    return errors;
+}
+
+/*! Ingestion queue, every result checked */
+static int fate_test_queue(gmp_randstate_t state)
+{
+    const int limbs = 16, ops = 37;
+    vector<uint64_t> b(limbs * ops), e(limbs * ops), m(limbs * ops), res(limbs * ops);
+    fate_fill_limbs(state, b.data(), e.data(), m.data(), limbs, ops, false);
+
+    fate_queue_opts qo = { 0, limbs, 2, 0 };
+    fate_queue* q = fate_queue_create(&qo);
+    vector<fate_op> op(ops);
+    for (int i = 0; i < ops; i++)
     {
-        /* Don't process request that did not pass the compatibility check at the encryption stage */
-        if (!req[i]->IsCompatible())
-            continue;
+        op[i].res = &res[(size_t)i * limbs];
+        fate_queue_push(q, &op[i], &b[(size_t)i * limbs], &e[(size_t)i * limbs], &m[(size_t)i * limbs]);
+    }
+    int errors = 0;
+    mpz_t r, tb, te, tm, got;
+    mpz_inits(r, tb, te, tm, got, NULL);
+    for (int i = 0; i < ops; i++)
+    {
+        size_t off = (size_t)i * limbs;
+        int st = fate_op_wait(&op[i]);
+        mpz_import(tb, limbs, -1, sizeof(uint64_t), 0, 0, &b[off]);
+        mpz_import(te, limbs, -1, sizeof(uint64_t), 0, 0, &e[off]);
+        mpz_import(tm, limbs, -1, sizeof(uint64_t), 0, 0, &m[off]);
+        mpz_import(got, limbs, -1, sizeof(uint64_t), 0, 0, &res[off]);
+        mpz_powm(r, tb, te, tm);
+        if (st == FATE_STS_ERR || mpz_cmp(r, got) != 0)
+        {
+            printf("queue: mismatch, element %d, status %d\n", i, st);
+            errors++;
+        }
+    }
+    mpz_clears(r, tb, te, tm, got, NULL);
+    fate_queue_destroy(q);
 
-        bitSizeD = req[i]->GetBitSizeD();
-        bitSizeN = req[i]->GetBitSizeN();
+    return errors;
+}
 
-        //// priv key
-        int keySize = 0;
-        ippsRSA_GetSizePrivateKeyType1(bitSizeN, bitSizeD, &keySize);
-        pPrivKey[bufId] = (IppsRSAPrivateKeyState*)(new Ipp8u[keySize * 2]);
+#ifdef __cpp_impl_coroutine
+/*
+ * Coroutines resumed inline on the only batch former, more of them than the
+ * queue holds, each awaiting twice: their second push runs on the former
+ * while the queue is full, so it has to park rather than wait for space.
+ */
+static int fate_test_coro(gmp_randstate_t state)
+{
+    const int limbs = 1, coroutines = 20000, ops = 2 * coroutines;
+    vector<uint64_t> b(limbs * ops), e(limbs * ops), m(limbs * ops), res(limbs * ops);
+    fate_fill_limbs(state, b.data(), e.data(), m.data(), limbs, ops, false);
 
-        ///* Prepare key to operation */
-        ippsRSA_InitPrivateKeyType1(bitSizeN, bitSizeD, pPrivKey[bufId], keySize);
+    atomic<int> failed(0), left(coroutines);
+    {
+        fate_inline_executor exec;
+        fate_engine engine(limbs, &exec, 1, 1024);
+        for (int c = 0; c < coroutines; c++)
+            fate_coro_client(&engine, res.data(), b.data(), e.data(), m.data(), limbs, c, 2, coroutines, &failed,
+                             &left);
+        for (int spins = 0; left > 0 && spins < 100000; spins++)
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
 
-        //RSA: c ^ d % n
-        ippsRSA_SetPrivateKeyType1(req[i]->GetValueN(), req[i]->GetValueD(), pPrivKey[bufId]);
+    int errors = left > 0 || failed > 0;
+    mpz_t r, tb, te, tm;
+    mpz_inits(r, tb, te, tm, NULL);
+    for (int i = 0; i < ops && !errors; i++)
+    {
+        mpz_import(tb, limbs, -1, sizeof(uint64_t), 0, 0, &b[i]);
+        mpz_import(te, limbs, -1, sizeof(uint64_t), 0, 0, &e[i]);
+        mpz_import(tm, limbs, -1, sizeof(uint64_t), 0, 0, &m[i]);
+        mpz_powm(r, tb, te, tm);
+        errors += mpz_cmp_ui(r, res[i]) != 0;
+    }
+    mpz_clears(r, tb, te, tm, NULL);
+    if (errors)
+        printf("coro: %d coroutines left, %d failed, %d mismatches\n", (int)left, (int)failed, errors);
 
-        /* Check decryption requests and pPrivKey types compatibility of each eight buffers, if the request is incompatible, mark it as not processed and take another request */
-        if (bufId > 0 && (!CheckDecRequestsCompatibility(req[i - 1], req[i]) || !CheckPrivateKeyCompatibility(pPrivKey[bufId - 1], pPrivKey[bufId])))
+    return errors;
+}
+#endif
+
+/*! SHA-256 known answers, 8-lane against scalar hashing, OAEP/PSS round trips and tampering with the RSA-1024 key */
+static int fate_test_pkcs1(gmp_randstate_t state)
+{
+    int errors = 0;
+    const char* abc[2] = { "abc", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq" };
+    const uint8_t abcHash[2][FATE_SHA256_LEN] = {
+        { 0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+          0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad },
+        { 0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8, 0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+          0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67, 0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1 }
+    };
+    uint8_t digest[FATE_SHA256_LEN];
+    for (int t = 0; t < 2; t++)
+    {
+        fate_sha256(digest, (const uint8_t*)abc[t], strlen(abc[t]));
+        errors += memcmp(digest, abcHash[t], FATE_SHA256_LEN) != 0;
+    }
+    fate_sha256(digest, NULL, 0);
+    errors += memcmp(digest, fate_oaep_lhash, FATE_SHA256_LEN) != 0;
+
+    /* ragged batches: lanes end at different blocks */
+    const int hashes = 27;
+    vector<uint8_t> data(300 * hashes), out(FATE_SHA256_LEN * hashes);
+    vector<const uint8_t*> ptr(hashes);
+    vector<size_t> len(hashes);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (uint8_t)gmp_urandomm_ui(state, 256);
+    for (int i = 0; i < hashes; i++)
+    {
+        ptr[i] = &data[300 * i];
+        len[i] = (size_t)(i * 37) % 300;
+    }
+    fate_sha256_batch(out.data(), ptr.data(), len.data(), hashes);
+    for (int i = 0; i < hashes; i++)
+    {
+        fate_sha256(digest, ptr[i], len[i]);
+        errors += memcmp(digest, &out[FATE_SHA256_LEN * i], FATE_SHA256_LEN) != 0;
+    }
+    if (errors)
+        printf("pkcs1: SHA-256 mismatch\n");
+
+    const int limbs = 16, num = 11;
+    vector<uint64_t> n(limbs, 0), e(limbs, 0), d(limbs, 0);
+    mpz_t z;
+    mpz_init(z);
+    num2mpz(_N1, z);
+    mpz_export(n.data(), NULL, -1, sizeof(uint64_t), 0, 0, z);
+    const size_t k = (mpz_sizeinbase(z, 2) + 7) / 8;
+    num2mpz(_E, z);
+    mpz_export(e.data(), NULL, -1, sizeof(uint64_t), 0, 0, z);
+    num2mpz(_D1, z);
+    mpz_export(d.data(), NULL, -1, sizeof(uint64_t), 0, 0, z);
+    mpz_clear(z);
+
+    vector<const uint8_t*> msg(num);
+    vector<size_t> msgLen(num), gotLen(num);
+    for (int i = 0; i < num; i++)
+    {
+        msg[i] = &data[300 * i];
+        msgLen[i] = (size_t)(i * 7) % (k - FATE_OAEP_OVERHEAD + 1);
+    }
+    msgLen[num - 1] = k - FATE_OAEP_OVERHEAD;
+
+    vector<uint8_t> ct(k * num), plain(k * num);
+    vector<int> status(num);
+    int failed = fate_rsa_oaep_encrypt(ct.data(), msg.data(), msgLen.data(), num, n.data(), e.data(), limbs, status.data());
+    ct[k * 3 + k / 2] ^= 0x10;
+    int bad = fate_rsa_oaep_decrypt(plain.data(), gotLen.data(), ct.data(), num, n.data(), d.data(), limbs, status.data());
+    for (int i = 0; i < num; i++)
+    {
+        bool ok = i == 3 ? status[i] == FATE_STS_ERR
+                         : status[i] != FATE_STS_ERR && gotLen[i] == msgLen[i] &&
+                               memcmp(&plain[k * i], msg[i], msgLen[i]) == 0;
+        if (!ok)
         {
-            //cout <<"Step 6:" << i << endl;
-            req[i]->SetCompatibilityStatus(false);
-            delete[](Ipp8u*) pPrivKey[bufId];
-            // cout <<"Step 7:" << i << endl;
-            continue;
+            printf("pkcs1: OAEP element %d wrong, status %d\n", i, status[i]);
+            errors++;
         }
+    }
+    errors += failed != 0 || bad != 1;
 
-        ///* Forming the array of cipher and decipher texts */
-        mbDecipherTextArray[bufId] = req[i]->GetDecipherText();
-        mbCipherTextArray[bufId] = req[i]->GetCipherText();
-
-        bufId++;
+    msgLen[0] = k - FATE_OAEP_OVERHEAD + 1;
+    failed = fate_rsa_oaep_encrypt(ct.data(), msg.data(), msgLen.data(), 1, n.data(), e.data(), limbs, status.data());
+    errors += failed != 1 || status[0] != FATE_STS_ERR;
 
-        ///* Handling the case when the number of requests in the queue is not a multiple of eight, initializing insufficient data with zeros */
-        int leave = buf;
-        if (num % buf != 0 && i == num - 1)
+    vector<uint8_t> sig(k * num);
+    failed = fate_rsa_pss_sign(sig.data(), msg.data(), msgLen.data(), num, n.data(), d.data(), limbs, status.data());
+    sig[k * 5 + 7] ^= 0x01;
+    msgLen[8] = msgLen[8] ? msgLen[8] - 1 : 1;
+    bad = fate_rsa_pss_verify(sig.data(), msg.data(), msgLen.data(), num, n.data(), e.data(), limbs, status.data());
+    for (int i = 0; i < num; i++)
+    {
+        if ((status[i] == FATE_STS_ERR) != (i == 5 || i == 8))
         {
-            leave = num % buf;
-            while (bufId != buf)
-            {
-                pPrivKey[bufId] = NULL;
-                mbCipherTextArray[bufId] = NULL;
-                mbDecipherTextArray[bufId] = NULL;
-                bufId++;
-            }
+            printf("pkcs1: PSS element %d wrong, status %d\n", i, status[i]);
+            errors++;
+        }
+    }
+    errors += failed != 0 || bad != 2;
+
+    /* a key too short for the padding fails every element and says so */
+    mpz_t shortN, shortE;
+    mpz_init_set_ui(shortN, 0xfffffffbu);
+    mpz_init_set_ui(shortE, 3);
+    std::fill(status.begin(), status.end(), 123);
+    failed = fate_rsa_oaep_encrypt_batch(ct.data(), msg.data(), msgLen.data(), num, shortN, shortE, status.data());
+    errors += failed != num || std::count(status.begin(), status.end(), FATE_STS_ERR) != num;
+    std::fill(status.begin(), status.end(), 123);
+    failed = fate_rsa_pss_sign_batch(sig.data(), msg.data(), msgLen.data(), num, shortN, shortE, status.data());
+    errors += failed != num || std::count(status.begin(), status.end(), FATE_STS_ERR) != num;
+    mpz_clears(shortN, shortE, NULL);
+
+    /*
+     * Private exponents stay on the multi-buffer engine even when the profile
+     * prefers mpz_powm for short batches and the shared-exponent kernel for
+     * lanes with one exponent.
+     */
+    fate_tune_entry tune[FATE_TUNE_SIZES];
+    for (int t = 0; t < FATE_TUNE_SIZES; t++)
+        tune[t] = { g_fate_tune[t].bits, FATE_MB_LANES + 1, 0, 1, 1, 0, 0 };
+    {
+        fate_tune_scope scope(tune);
+        const int lanes = 3;
+        fate_bignum *fr = fate_test_alloc(lanes), *fb = fate_test_alloc(lanes), *fe = fate_test_alloc(lanes),
+                    *fm = fate_test_alloc(lanes);
+        for (int i = 0; i < lanes; i++)
+        {
+            num2mpz(_N1, fm->bigint[i]);
+            num2mpz(_D1, fe->bigint[i]);
+            mpz_urandomm(fb->bigint[i], state, fm->bigint[i]);
+        }
+        fate_stats before, after;
+        fate_stats_get(&before);
+        powm_avx_secret(fr, fb, fe, fm, lanes, status.data());
+        fate_stats_get(&after);
+        errors += fate_check("powm_avx_secret", fr, fb, fe, fm, lanes, status.data());
+        if (after.mb_calls - before.mb_calls != 1 || after.lanes_retried != before.lanes_retried)
+        {
+            printf("pkcs1: private exponent left the multi-buffer engine\n");
+            errors++;
         }
+        fate_test_free(fr);
+        fate_test_free(fb);
+        fate_test_free(fe);
+        fate_test_free(fm);
+    }
 
-        ////decrypt
-        leave = 0;
+    return errors;
+}
 
-        if (bufId == buf)
+/*! Generated primes, RSA and Paillier keys: sizes, primality and round trips */
+static int fate_test_keygen(gmp_randstate_t state)
+{
+    int errors = 0;
+    const int primes = 11, bits = 512;
+    mpz_t* p = (mpz_t*)malloc(sizeof(mpz_t) * primes);
+    for (int i = 0; i < primes; i++)
+        mpz_init(p[i]);
+    errors += fate_prime_batch(p, primes, bits, FATE_RSA_E) != 0;
+    for (int i = 0; i < primes; i++)
+    {
+        errors += (int)mpz_sizeinbase(p[i], 2) != bits || !mpz_probab_prime_p(p[i], 30) ||
+                  mpz_fdiv_ui(p[i], FATE_RSA_E) == 1 || (i > 0 && mpz_cmp(p[i], p[i - 1]) == 0);
+        mpz_clear(p[i]);
+    }
+    free(p);
+
+    const int keys = 3;
+    fate_rsa_keypair rsa[keys];
+    errors += fate_rsa_keygen_batch(rsa, keys, 1024) != 0;
+    mpz_t msg, c, r;
+    mpz_inits(msg, c, r, NULL);
+    for (int i = 0; i < keys; i++)
+    {
+        mpz_urandomm(msg, state, rsa[i].n);
+        mpz_powm(c, msg, rsa[i].e, rsa[i].n);
+        mpz_powm(r, c, rsa[i].d, rsa[i].n);
+        errors += mpz_sizeinbase(rsa[i].n, 2) != 1024 || mpz_cmp(r, msg) != 0;
+        fate_rsa_keypair_clear(&rsa[i]);
+    }
+
+    fate_paillier_pub pub[keys];
+    fate_paillier_priv priv[keys];
+    errors += fate_paillier_keygen_batch(pub, priv, NULL, NULL, keys, 1024) != 0;
+    for (int i = 0; i < keys; i++)
+    {
+        errors += mpz_sizeinbase(pub[i].n, 2) != 1024 || mpz_sizeinbase(pub[i].nsquare, 2) != 2048;
+
+        /* c = (1 + n)^m r^n mod n^2, then decrypt through the batched path */
+        fate_bignum *fm = fate_test_alloc(1), *fc = fate_test_alloc(1);
+        mpz_urandomm(msg, state, pub[i].n);
+        mpz_urandomm(r, state, pub[i].n);
+        mpz_powm(r, r, pub[i].n, pub[i].nsquare);
+        mpz_mul(c, msg, pub[i].n);
+        mpz_add_ui(c, c, 1);
+        mpz_mul(c, c, r);
+        mpz_mod(fc->bigint[0], c, pub[i].nsquare);
+        int st;
+        fate_paillier_decrypt_batch(fm, fc, 1, &pub[i], &priv[i], &st);
+        errors += mpz_cmp(fm->bigint[0], msg) != 0;
+        fate_test_free(fm);
+        fate_test_free(fc);
+        fate_paillier_pub_clear(&pub[i]);
+        fate_paillier_priv_clear(&priv[i]);
+    }
+    mpz_clears(msg, c, r, NULL);
+
+    if (errors)
+        printf("keygen: %d errors\n", errors);
+    return errors;
+}
+
+/*! Hex/decimal parsing and formatting against mpz_get_str/mpz_set_str, including malformed input */
+static int fate_test_text(gmp_randstate_t state)
+{
+    int errors = 0;
+    const int sizes[] = { 1, 3, 16, 33, 128 };
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+    {
+        const int limbs = sizes[s], num = 13;
+        vector<uint64_t> in((size_t)limbs * num, 0), hexOut(in.size()), decOut(in.size());
+        vector<char> hex((size_t)FATE_HEX_CHARS(limbs) * num), dec((size_t)FATE_DEC_CHARS(limbs) * num);
+        mpz_t x;
+        mpz_init(x);
+        for (int i = 0; i < num; i++)
         {
-            /* Calculate temporary buffer size */
-            int privBufSize = 0;
-            status = ippsRSA_MB_GetBufferSizePrivateKey(&privBufSize, pPrivKey);
-            if (!checkStatus("ippsRSA_MB_GetBufferSizePrivateKey", ippStsNoErr, status))
+            /* zero, all ones and values of every length */
+            if (i == 1)
+                mpz_set_ui(x, 0);
+            else if (i == 2)
             {
-                cout << "Step 8" << endl;
-                printf("ippsRSA_MB_GetBufferSizePrivateKey quit");
-                for (int j = 0; j < leave; j++)
-                    delete[](Ipp8u*) pPrivKey[j];
-                cout << "Step 9: " << privBufSize << endl;
-                break;
+                mpz_set_ui(x, 0);
+                mpz_setbit(x, 64 * limbs);
+                mpz_sub_ui(x, x, 1);
             }
+            else
+                mpz_urandomb(x, state, 1 + gmp_urandomm_ui(state, 64 * limbs));
+            mpz_export(&in[(size_t)i * limbs], NULL, -1, sizeof(uint64_t), 0, 0, x);
+        }
+        errors += fate_format_hex(hex.data(), FATE_HEX_CHARS(limbs), in.data(), limbs, num) != 0;
+        errors += fate_format_dec(dec.data(), FATE_DEC_CHARS(limbs), in.data(), limbs, num) != 0;
 
-            if (ENABLE_GMP)
-            {
-                int k = i;
+        vector<const char*> hp(num), dp(num);
+        for (int i = 0; i < num; i++)
+        {
+            hp[i] = &hex[(size_t)FATE_HEX_CHARS(limbs) * i];
+            dp[i] = &dec[(size_t)FATE_DEC_CHARS(limbs) * i];
+            mpz_import(x, limbs, -1, sizeof(uint64_t), 0, 0, &in[(size_t)i * limbs]);
+            char* ref = mpz_get_str(NULL, 16, x);
+            errors += strcmp(ref, hp[i]) != 0;
+            free(ref);
+            ref = mpz_get_str(NULL, 10, x);
+            errors += strcmp(ref, dp[i]) != 0;
+            free(ref);
+        }
+        errors += fate_parse_hex(hexOut.data(), hp.data(), NULL, limbs, num, NULL) != 0 || hexOut != in;
+        errors += fate_parse_dec(decOut.data(), dp.data(), NULL, limbs, num, NULL) != 0 || decOut != in;
+        mpz_clear(x);
+        if (errors)
+        {
+            printf("text: %d-limb round trip failed\n", limbs);
+            return errors;
+        }
+    }
 
-                BigNumber _p = req[k]->GetPlainText();
-                BigNumber _c = req[k]->GetCipherText();
-                BigNumber _d = req[k]->GetDecipherText();
-                vector<Ipp32u> _vp;
-                vector<Ipp32u> _vc;
-                vector<Ipp32u> _vd;
-                _p.num2vec(_vp);
-                _c.num2vec(_vc);
-                _d.num2vec(_vd);
+    /* prefixes, leading zeros, explicit lengths and rejects */
+    const char* str[] = { "0x00ABCdef", "0000000000000000000000000000000000000000001f", "12g4", "", "0x",
+                          "10000000000000000", "ffffffffffffffff", "-1" };
+    const size_t len[] = { 10, 44, 4, 0, 2, 17, 16, 2 };
+    const uint64_t hexWant[] = { 0xabcdef, 0x1f, 0, 0, 0, 0, 0xffffffffffffffffULL, 0 };
+    const int hexOk[] = { 1, 1, 0, 0, 0, 0, 1, 0 };
+    const uint64_t decWant[] = { 0, 0, 0, 0, 0, 10000000000000000ULL, 0, 0 };
+    const int decOk[] = { 0, 0, 0, 0, 0, 1, 0, 0 };
+    const int n = (int)(sizeof(len) / sizeof(len[0]));
+    uint64_t out[n];
+    int st[n];
+    fate_parse_hex(out, str, len, 1, n, st);
+    for (int i = 0; i < n; i++)
+        errors += (st[i] == FATE_STS_OK) != hexOk[i] || out[i] != hexWant[i];
+    fate_parse_dec(out, str, len, 1, n, st);
+    for (int i = 0; i < n; i++)
+        errors += (st[i] == FATE_STS_OK) != decOk[i] || out[i] != decWant[i];
+    const char* big[] = { "18446744073709551616", "18446744073709551615" };
+    errors += fate_parse_dec(out, big, NULL, 1, 2, st) != 1 || st[0] != FATE_STS_ERR || out[1] != ~0ULL;
+
+    if (errors)
+        printf("text: %d errors\n", errors);
+    return errors;
+}
 
-                for (int j = 0; j < 8; j++)
-                {
-                    printf("222222222222 req = %d: p = %d c = %d d = %d\n", k, _vp[j], _vc[j], _vd[j]);
-                }
-            }
+/*! Fork a process that connects and dies, with one operation published (`publish`) or half written */
+static pid_t fate_shm_fork_crash(const char* name, bool publish)
+{
+    pid_t pid = fork();
+    if (pid != 0)
+        return pid;
+    fate_shm_client* c = fate_shm_connect(name);
+    if (c == NULL)
+        _exit(1);
+    fate_shm_slot* slot = &c->slots[c->slot];
+    uint64_t p = slot->tail.load();
+    uint64_t* dst = c->data + (size_t)4 * c->limbs * (c->slot * c->capacity + (p & (c->capacity - 1)));
+    for (int j = 0; j < 3 * c->limbs; j++)
+        dst[j] = 3;
+    if (publish)
+    {
+        slot->tail.store(p + 1);
+        fate_shm_cell_at(c->cells, c->capacity, c->slot, p)->seq.store(p + 1, memory_order_release);
+        c->hdr->doorbell.fetch_add(1);
+        fate_futex(&c->hdr->doorbell, FUTEX_WAKE, 1, NULL);
+    }
+    _exit(0);
+}
 
-            printf("XXXXXXXXXXXXXXXXXXX\n");
+/*! A client waiting on a server that gets SIGKILLed must give up instead of waiting forever */
+static int fate_test_shm_dead_server(int limbs)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/fate_test_dead_%d", (int)getpid());
+    int fds[2];
+    if (pipe(fds) != 0)
+        return 1;
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        fate_shm_opts so = { name, limbs, 0, 0, 1, 0 };
+        char ok = fate_shm_serve(&so) != NULL;
+        ssize_t w = write(fds[1], &ok, 1);
+        (void)w;
+        for (;;)
+            pause();
+    }
+    char ok = 0;
+    ssize_t got = read(fds[0], &ok, 1);
+    close(fds[0]);
+    close(fds[1]);
+    fate_shm_client* c = got == 1 && ok ? fate_shm_connect(name) : NULL;
+
+    int errors = c == NULL;
+    if (c)
+    {
+        /* stop the server so the operation stays pending, then kill it while the client waits */
+        kill(pid, SIGSTOP);
+        waitpid(pid, NULL, WUNTRACED);
+        thread killer([pid] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+        });
+        vector<uint64_t> b(limbs, 2), e(limbs, 3), m(limbs, 7), res(limbs);
+        int status = 0;
+        errors += fate_shm_powm(c, res.data(), b.data(), e.data(), m.data(), 1, &status) != 1 ||
+                  status != FATE_STS_ERR;
+        killer.join();
+        fate_shm_disconnect(c);
+    }
+    else
+    {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+    }
+    shm_unlink(name);
+    return errors;
+}
 
-            Ipp8u* pScratchBuffer = new Ipp8u[privBufSize * privBufSize];
-            //    cout <<"Step 10" << endl;
-            /* Decrypt message */ //����
-            str_avx_l = clock();
-            status = ippsRSA_MB_Decrypt(mbCipherTextArray, mbDecipherTextArray,
-                pPrivKey, statusesArray,
-                pScratchBuffer);
-            end_avx_l = clock();
-            ttime += (double)(end_avx_l - str_avx_l);
+/*! Shared-memory service: forked and in-process clients, clients dying mid-operation, a full service, a dead server */
+static int fate_test_shm()
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/fate_test_%d", (int)getpid());
+    const int limbs = 16, clients = 3, calls = 12, ops = 3;
+    int errors = fate_test_shm_dead_server(limbs);
+
+    fate_shm_opts so = { name, limbs, 8, 256, 2, 0 };
+    fate_shm_server* s = fate_shm_serve(&so);
+    if (s == NULL)
+    {
+        printf("shm: cannot create %s\n", name);
+        return 1;
+    }
 
-            printf("XXXXXXXXXXXXXXXXXXX\n");
-            //printf("call avx decrypt\n");
+    errors += fate_shm_serve(&so) != NULL; // the name is taken
+    errors += fate_shm_fork_clients(name, clients, calls, ops);
+    errors += fate_shm_child(name, 1, 2, 1500); // more than a slot holds at once
 
-            if (ENABLE_GMP)
-            {
-                int k = i;
+    /* clients dying after publishing and halfway through a cell hold up nobody, and their slots come back */
+    pid_t crashed[2] = { fate_shm_fork_crash(name, true), fate_shm_fork_crash(name, false) };
+    for (pid_t pid : crashed)
+    {
+        int ws = 0;
+        errors += pid < 0 || waitpid(pid, &ws, 0) != pid || !WIFEXITED(ws) || WEXITSTATUS(ws) != 0;
+    }
+    errors += fate_shm_fork_clients(name, clients, 2, ops);
+    for (int t = 0; t < 100 && fate_shm_reaped(s) < 2; t++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    errors += fate_shm_reaped(s) != 2;
+
+    /* every slot taken: the next client is refused */
+    vector<fate_shm_client*> held;
+    for (fate_shm_client* c; (c = fate_shm_connect(name)) != NULL && held.size() <= 8;)
+        held.push_back(c);
+    errors += held.size() != 8;
+    for (fate_shm_client* c : held)
+        fate_shm_disconnect(c);
+    errors += fate_shm_child(name, 2, 1, ops);
+
+    uint64_t served, batches;
+    fate_shm_get_stats(s, &served, &batches);
+    errors += served < (uint64_t)clients * (calls + 2) * ops + 3000 + ops;
+    fate_shm_shutdown(s);
+    errors += fate_shm_connect(name) != NULL;
+
+    if (errors)
+        printf("shm: %d errors\n", errors);
+    return errors;
+}
 
-                BigNumber _p = req[k]->GetPlainText();
-                BigNumber _c = req[k]->GetCipherText();
-                BigNumber _d = req[k]->GetDecipherText();
-                vector<Ipp32u> _vp;
-                vector<Ipp32u> _vc;
-                vector<Ipp32u> _vd;
-                _p.num2vec(_vp);
-                _c.num2vec(_vc);
-                _d.num2vec(_vd);
+/*! ChaCha20 against the RFC 7539 block vector, the 8-block path against single blocks across a counter carry, reseeding after fork */
+static int fate_test_rng()
+{
+    static const char* rfc = "10f1e7e4d13b5915500fdd1fa32071c4c7d1f4c733c068030422aa9ac3d46c4e"
+                             "d2826446079faa0914c2d705d98b02a2b5129cd1de164eb9cbd083e8a2503c4e";
+    int errors = 0;
 
-                for (int j = 0; j < 8; j++)
-                {
-                    printf("333333333333333 k = %d: p = %d c = %d d = %d\n", k, _vp[j], _vc[j], _vd[j]);
-                }
-            }
-     
-            if (leave != buf && status == ippStsMbWarning)
-            {
-                /* If ippStsNullPtrErr status is in the initially unspecified buffers, then we consider that the status of the operation is ippStsNoErr */
-                status = ippStsNoErr;
-                for (int j = 0; j < leave; j++)
-                    if (statusesArray[j] != ippStsNoErr)
-                        status = ippStsMbWarning;
-                for (int j = leave; j < buf; j++)
-                    if (statusesArray[j] != ippStsNullPtrErr)
-                        status = ippStsMbWarning;
-            }
-            for (int j = 0; j < leave; j++)
-                delete[](Ipp8u*) pPrivKey[j];
-            bufId = 0;
+    uint8_t key[32];
+    for (int i = 0; i < 32; i++)
+        key[i] = (uint8_t)i;
+    fate_rng rng;
+    /* RFC nonce 00:00:00:09:00:00:00:4a:00:00:00:00, its first word is the high half of our counter */
+    fate_rng_seed(&rng, key, 0x4a000000);
+    rng.counter = 1 | (0x09000000ull << 32);
+    uint8_t block[FATE_RNG_BLOCK];
+    fate_rng_bytes(&rng, block, sizeof(block));
+    char hex[2 * FATE_RNG_BLOCK + 1];
+    for (int i = 0; i < FATE_RNG_BLOCK; i++)
+        snprintf(hex + 2 * i, 3, "%02x", block[i]);
+    if (strcmp(hex, rfc) != 0)
+    {
+        printf("chacha20: RFC 7539 block mismatch\n");
+        errors++;
+    }
 
-            if (!checkStatus("ippsRSA_MB_Decrypt", ippStsNoErr, status))
-                break;
+    fate_rng_seed(&rng, key, 7);
+    rng.counter = 0xfffffffcull;
+    uint8_t wide[FATE_RNG_BLOCK * FATE_RNG_WIDE], one[FATE_RNG_BLOCK];
+    fate_rng_bytes(&rng, wide, sizeof(wide));
+    for (int j = 0; j < FATE_RNG_WIDE; j++)
+    {
+        chacha_block(&rng, 0xfffffffcull + j, one);
+        if (memcmp(one, wide + j * FATE_RNG_BLOCK, FATE_RNG_BLOCK) != 0)
+        {
+            printf("chacha20: block %d of the wide path differs across the counter carry\n", j);
+            errors++;
         }
     }
 
-    clock_t end_avx = clock();
-    double tt = (double)(end_avx - str_avx) / CLOCKS_PER_SEC;
-    printf("decrypt avx cost time %lf ms \n", tt * 1000.f);
-    printf("decrypt avx func cost time %lf ms \n", (ttime / (CLOCKS_PER_SEC)) * 1000.f);
-   
-    return 0;
+    uint8_t parent[32], child[32];
+    fate_rng_bytes(fate_thread_rng(), parent, sizeof(parent));
+    int fds[2];
+    if (pipe(fds) == 0)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            /* the parent's next bytes and the child's must differ */
+            fate_rng_bytes(fate_thread_rng(), child, sizeof(child));
+            ssize_t w = write(fds[1], child, sizeof(child));
+            _exit(w == (ssize_t)sizeof(child) ? 0 : 1);
+        }
+        fate_rng_bytes(fate_thread_rng(), parent, sizeof(parent));
+        ssize_t got = read(fds[0], child, sizeof(child));
+        waitpid(pid, NULL, 0);
+        close(fds[0]);
+        close(fds[1]);
+        if (got != (ssize_t)sizeof(child) || memcmp(parent, child, sizeof(child)) == 0)
+        {
+            printf("fate_thread_rng: forked child replays the parent's keystream\n");
+            errors++;
+        }
+    }
+
+    return errors;
 }
 
+/*! ./example test: known answers, differential tests of every entry point and of the C API against mpz_powm */
+static int fate_test()
+{
+    int errors = 0;
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+    gmp_randseed_ui(state, 1228);
+
+    fate_ctx* ctx = fate_ctx_create(NULL);
+    const int shapes[] = { 1, 7, 8, 9, 16, 23 };
+    for (int limbs = 16; limbs <= 32; limbs += 16)
+    {
+        for (int s = 0; s < (int)(sizeof(shapes) / sizeof(shapes[0])); s++)
+        {
+            int num = shapes[s];
+            vector<uint64_t> res(limbs * num), res2(limbs * num), b(limbs * num), e(limbs * num), m(limbs * num);
+            vector<int> status(num);
+            fate_fill_limbs(state, b.data(), e.data(), m.data(), limbs, num, true);
+
+            fate_job* job = fate_powm_submit(ctx, res2.data(), b.data(), e.data(), m.data(), limbs, num, NULL);
+            int failed = fate_powm(ctx, res.data(), b.data(), e.data(), m.data(), limbs, num, status.data());
+            int failed2 = fate_job_wait(job);
+            if (failed != 0 || failed2 != 0 || res != res2)
+                errors++;
+
+            mpz_t r, tb, te, tm, got;
+            mpz_inits(r, tb, te, tm, got, NULL);
+            for (int i = 0; i < num; i++)
+            {
+                size_t off = (size_t)i * limbs;
+                mpz_import(tb, limbs, -1, sizeof(uint64_t), 0, 0, &b[off]);
+                mpz_import(te, limbs, -1, sizeof(uint64_t), 0, 0, &e[off]);
+                mpz_import(tm, limbs, -1, sizeof(uint64_t), 0, 0, &m[off]);
+                mpz_import(got, limbs, -1, sizeof(uint64_t), 0, 0, &res[off]);
+                mpz_powm(r, tb, te, tm);
+                if (mpz_cmp(r, got) != 0)
+                {
+                    printf("mismatch: %d-bit, batch %d, element %d, status %d\n", 64 * limbs, num, i, status[i]);
+                    errors++;
+                }
+            }
+            mpz_clears(r, tb, te, tm, got, NULL);
+        }
+    }
+    fate_ctx_destroy(ctx);
+
+    errors += fate_test_rng();
+    errors += fate_test_kats();
+    errors += fate_test_engine(state);
+    errors += fate_test_mont(state);
+    errors += fate_test_queue(state);
+#ifdef __cpp_impl_coroutine
+    errors += fate_test_coro(state);
+#endif
+    errors += fate_test_steal(state);
+    errors += fate_test_pkcs1(state);
+    errors += fate_test_keygen(state);
+    errors += fate_test_text(state);
+    errors += fate_test_shm();
+    gmp_randclear(state);
+
+    printf("fate test: %s (%d errors)\n", errors ? "FAILED" : "PASSED", errors);
+    return errors ? 1 : 0;
+}
 
-int main()
+int main(int argc, char** argv)
 {
+    /* ./example numa [num] [threads]: one socket versus all sockets */
+    if (argc > 1 && strcmp(argv[1], "numa") == 0)
+        return fate_bench_numa(argc > 2 ? atoi(argv[2]) : 4096, argc > 3 ? atoi(argv[3]) : 0);
+    /* ./example bench [num] [threads] */
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+        return fate_bench(argc > 2 ? atoi(argv[2]) : 1024, argc > 3 ? atoi(argv[3]) : 0);
+    /* ./example queue [producers] [ops] [limbs] */
+    if (argc > 1 && strcmp(argv[1], "queue") == 0)
+        return fate_bench_queue(argc > 2 ? atoi(argv[2]) : 4, argc > 3 ? atoi(argv[3]) : 4096, argc > 4 ? atoi(argv[4]) : 16);
+#ifdef __cpp_impl_coroutine
+    /* ./example coro [coroutines] [ops] [limbs] */
+    if (argc > 1 && strcmp(argv[1], "coro") == 0)
+        return fate_bench_coro(argc > 2 ? atoi(argv[2]) : 1000, argc > 3 ? atoi(argv[3]) : 4096, argc > 4 ? atoi(argv[4]) : 16);
+#endif
+    /* ./example shared [num] [bits] */
+    if (argc > 1 && strcmp(argv[1], "shared") == 0)
+        return fate_bench_shared(argc > 2 ? atoi(argv[2]) : 1024, argc > 3 ? atoi(argv[3]) : 1024);
+    /* ./example mixed [num] [threads] */
+    if (argc > 1 && strcmp(argv[1], "mixed") == 0)
+        return fate_bench_mixed(argc > 2 ? atoi(argv[2]) : 1024, argc > 3 ? atoi(argv[3]) : 0);
+    /* ./example keygen [keys] [bits] */
+    if (argc > 1 && strcmp(argv[1], "keygen") == 0)
+        return fate_bench_keygen(argc > 2 ? atoi(argv[2]) : 16, argc > 3 ? atoi(argv[3]) : 1024);
+    /* ./example text [num] [limbs] */
+    if (argc > 1 && strcmp(argv[1], "text") == 0)
+        return fate_bench_text(argc > 2 ? atoi(argv[2]) : 100000, argc > 3 ? atoi(argv[3]) : 16);
+    /* ./example shm [clients] [calls] [ops] [limbs] */
+    if (argc > 1 && strcmp(argv[1], "shm") == 0)
+        return fate_bench_shm(argc > 2 ? atoi(argv[2]) : 8, argc > 3 ? atoi(argv[3]) : 256, argc > 4 ? atoi(argv[4]) : 2,
+                              argc > 5 ? atoi(argv[5]) : 16);
+    /* ./example serve [name] [limbs] [formers] */
+    if (argc > 1 && strcmp(argv[1], "serve") == 0)
+        return fate_serve(argc > 2 ? argv[2] : "/fate_powm", argc > 3 ? atoi(argv[3]) : 16, argc > 4 ? atoi(argv[4]) : 1);
+    /* ./example tune [profile]: measure the backends and write the profile */
+    if (argc > 1 && strcmp(argv[1], "tune") == 0)
+    {
+        int ret = fate_autotune(argc > 2 ? argv[2] : NULL);
+        fate_tune_print(stdout);
+        return ret ? 1 : 0;
+    }
+    /* ./example test */
+    if (argc > 1 && strcmp(argv[1], "test") == 0)
+        return fate_test();
+
     int testNum = 8;
 
     fate_bignum* fate_b = (fate_bignum*)malloc(sizeof(fate_bignum));
@@ -1047,8 +8520,8 @@ int main()
     mpz_init(_e);
     mpz_init(_m);
     num2gmp(_DD, _b);
-    num2gmp(_N1, _e);
-    num2gmp(_D1, _m);
+    num2gmp(_D1, _e);
+    num2gmp(_N1, _m);
 
     for (int  i = 0; i < testNum; i++)
     {
@@ -1065,8 +8538,8 @@ int main()
         //mpz_setbit(fate_res_avx->bigint[i], 1023);
 
         mpz_set(fate_b->bigint[i], _b);
-        mpz_set(fate_b->bigint[i], _e);
-        mpz_set(fate_b->bigint[i], _m);
+        mpz_set(fate_e->bigint[i], _e);
+        mpz_set(fate_m->bigint[i], _m);
 
         /*genrand_gmp(fate_b->bigint[i]);
         genrand_gmp(fate_e->bigint[i]);
@@ -1093,12 +8566,20 @@ int main()
     fate_res_avx->num = testNum;
     fate_res_gmp->num = testNum;
 
+    /* _D1 is a private exponent: the result cache stays off, every lane is computed */
+
     ////avx
     clock_t str = clock();
-    powm_avx(fate_res_avx, fate_b, fate_e, fate_m, testNum);
+    int* status = (int*)malloc(sizeof(int) * testNum);
+    int failed = powm_avx(fate_res_avx, fate_b, fate_e, fate_m, testNum, status);
     clock_t end = clock();
     printf("avx cost time = %lf ms\n", \
         (((double)end - (double)str) / CLOCKS_PER_SEC) * (1000.f));
+    fate_stats_print(stdout);
+    for (int i = 0; i < testNum; i++)
+        if (status[i] != FATE_STS_MB)
+            printf("element %d: status = %d\n", i, status[i]);
+    printf("avx failed elements = %d\n", failed);
 
 
     //gmp
@@ -1118,25 +8599,41 @@ int main()
     gmp_printf("%Zd\n", fate_res_gmp->bigint[0]);
 
     //comp
-    //for (int i = 0; i < testNum; i++)
-    //{
-    //    assert(0 == mpz_cmp(fate_res_avx->bigint[i], fate_res_gmp->bigint[i]));
-    //}
-
-    ////free
-    //for (int i = 0; i < testNum; i++)
-    //{
-    //    mpz_clear(fate_b->bigint[i]);
-    //    mpz_clear(fate_e->bigint[i]);
-    //    mpz_clear(fate_m->bigint[i]);
-    //    mpz_clear(fate_res_avx->bigint[i]);
-    //    mpz_clear(fate_res_gmp->bigint[i]);
-    //}
-    //free(fate_b);
-    //free(fate_e);
-    //free(fate_m);
-    //free(fate_res_avx);
-    //free(fate_res_gmp);
+    int mismatch = 0;
+    for (int i = 0; i < testNum; i++)
+    {
+        if (mpz_cmp(fate_res_avx->bigint[i], fate_res_gmp->bigint[i]) != 0)
+        {
+            printf("element %d: avx and gmp results differ\n", i);
+            mismatch++;
+        }
+    }
+    printf("avx vs gmp: %s\n", mismatch ? "MISMATCH" : "match");
 
-    return 0;
-}
\ No newline at end of file
+    //free
+    for (int i = 0; i < testNum; i++)
+    {
+        mpz_clear(fate_b->bigint[i]);
+        mpz_clear(fate_e->bigint[i]);
+        mpz_clear(fate_m->bigint[i]);
+        mpz_clear(fate_res_avx->bigint[i]);
+        mpz_clear(fate_res_gmp->bigint[i]);
+    }
+    free(fate_b->bigint);
+    free(fate_e->bigint);
+    free(fate_m->bigint);
+    free(fate_res_avx->bigint);
+    free(fate_res_gmp->bigint);
+    free(fate_b);
+    free(fate_e);
+    free(fate_m);
+    free(fate_res_avx);
+    free(fate_res_gmp);
+    free(status);
+    mpz_clears(_b, _e, _m, NULL);
+    gmp_randclear(state);
+
+    return mismatch ? 1 : 0;
+}
+
+#endif /* FATE_POWM_NO_MAIN */